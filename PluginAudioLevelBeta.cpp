@@ -16,8 +16,12 @@
 #include <cmath>
 #include <cassert>
 #include <vector>
+#include <algorithm>
+#include <new>
 
 #include <thread>
+#include <mutex>
+#include <atomic>
 #include <chrono>
 #include <avrt.h>
 #pragma comment(lib, "Avrt.lib")
@@ -56,6 +60,256 @@ Channel=R
 #define EXIT_ON_ERROR(hres)		if (FAILED(hres)) { goto Exit; }
 #define SAFE_RELEASE(p)			if ((p) != NULL) { (p)->Release(); (p) = NULL; }
 #define CLAMP01(x)				max(0.0, min(1.0, (x)))
+#define ENVELOPE_BLOCK			64
+#define DOWNMIX_LANES			12
+
+// build with PROFILE_STAGES=0 to leave the per-stage time measurements out of the plugin
+#ifndef PROFILE_STAGES
+#define PROFILE_STAGES			1
+#endif
+
+// build with SIMD_SSE=0 for the scalar reference kernels, for example to record golden outputs
+#ifndef SIMD_SSE
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define SIMD_SSE				1
+#else
+#define SIMD_SSE				0
+#endif
+#endif
+
+#if (SIMD_SSE)
+#include <xmmintrin.h>
+#endif
+
+#if (PROFILE_STAGES)
+#include <intrin.h>
+// CPU time of the pipeline stages: start a mark, then add the time since the mark to a stage
+#define PROFILE_START(mark)					UINT64 mark = Profile::Ticks()
+#define PROFILE_SKIP(mark)					mark = Profile::Ticks()
+#define PROFILE_LAP(profile, stage, mark)	(profile)->Lap(Profile::stage, &mark)
+#define PROFILE_END_FRAME(profile, silent)	(profile)->EndFrame(silent)
+#else
+#define PROFILE_START(mark)
+#define PROFILE_SKIP(mark)
+#define PROFILE_LAP(profile, stage, mark)
+#define PROFILE_END_FRAME(profile, silent)
+#endif
+
+// debug builds count the heap allocations of each thread, to verify that the processing path does not allocate;
+// without the CRT debug heap, build with TRACK_ALLOCATIONS=1 and call AllocGuard::Count from the allocator
+#ifndef TRACK_ALLOCATIONS
+#if defined(_DEBUG) && defined(_MSC_VER)
+#define TRACK_ALLOCATIONS		1
+#else
+#define TRACK_ALLOCATIONS		0
+#endif
+#endif
+
+#if (TRACK_ALLOCATIONS)
+#ifdef _MSC_VER
+#include <crtdbg.h>
+#endif
+#define ALLOC_GUARD(armed)		AllocGuard allocGuard(armed)
+#else
+#define ALLOC_GUARD(armed)
+#endif
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION	0x00000002
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// common phase of all pacers, so parents with the same rate share their deadlines
+const Clock::time_point s_epoch = Clock::now();
+
+/**
+* Monotonic frame pacer for UpdatesPerSecond.  Deadlines are kept on a fixed
+* phase, so late updates do not accumulate drift, and the achieved rate and
+* jitter are tracked as moving averages.
+*/
+struct Pacer
+{
+	Clock::duration			m_period;					// target time between two updates
+	Clock::time_point		m_next;						// next deadline on the target phase
+	Clock::time_point		m_lastFire;					// time of the last update
+	double					m_interval;					// average time between two updates in seconds
+	double					m_jitter;					// average deviation from the target period in seconds
+	UINT64					m_nFired;					// number of updates
+
+	Pacer() :
+		m_period(0),
+		m_interval(0.0),
+		m_jitter(0.0),
+		m_nFired(0)
+	{
+	}
+
+	void SetRate(double updatesPerSecond)
+	{
+		Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / updatesPerSecond));
+		if (period != m_period)
+		{
+			// align the first deadline to the common phase
+			m_period = period;
+			m_next = s_epoch + ((Clock::now() - s_epoch) / m_period + 1) * m_period;
+			m_interval = 1.0 / updatesPerSecond;
+			m_jitter = 0.0;
+		}
+	}
+
+	bool IsDue(Clock::time_point now) const { return now >= m_next; }
+
+	void Fire(Clock::time_point now)
+	{
+		// update statistics, unless the pacer was idle (silence) since the last update
+		if (m_nFired && now - m_lastFire < 2 * m_period)
+		{
+			const double interval = std::chrono::duration<double>(now - m_lastFire).count();
+			const double period = std::chrono::duration<double>(m_period).count();
+			m_interval += 0.05 * (interval - m_interval);
+			m_jitter += 0.05 * (fabs(interval - period) - m_jitter);
+		}
+		m_lastFire = now;
+		++m_nFired;
+
+		// advance on the target phase, skip deadlines that were missed completely
+		m_next += m_period;
+		if (m_next <= now)
+		{
+			m_next += ((now - m_next) / m_period + 1) * m_period;
+		}
+	}
+
+	double Rate() const { return m_interval > 0.0 ? 1.0 / m_interval : 0.0; }
+};
+
+/**
+* End-to-end latency of the audio shown by the skins.  At each stage of the
+* pipeline, the age of the newest captured audio is counted in a histogram with
+* 4 logarithmic buckets per octave, from 1us to about 30s.  The counters are
+* atomic, so the capture threads and the dispatcher record without a lock.
+*/
+struct Latency
+{
+	enum Stage
+	{
+		STAGE_CAPTURE,							// packet read from the capture client
+		STAGE_FFT,								// spectra computed
+		STAGE_PUBLISH,							// update command queued
+		STAGE_DISPATCH,							// update command executed
+		// ... //
+		NUM_STAGES
+	};
+
+	enum Stat
+	{
+		STAT_P50,
+		STAT_P99,
+		STAT_MAX,
+		STAT_JITTER,							// P99 - P50
+		// ... //
+		NUM_STATS
+	};
+
+	static const int		s_nBuckets = 100;			// histogram buckets per stage
+	static const LPCWSTR	s_stageName[NUM_STAGES];
+	static const LPCWSTR	s_statName[NUM_STATS];
+
+	std::atomic<UINT32>		m_count[NUM_STAGES][s_nBuckets];	// number of samples per bucket
+	std::atomic<UINT32>		m_max[NUM_STAGES];			// largest sample in us
+	std::atomic<int>		m_logPeriod;				// seconds between two log dumps, 0: off (parsed from options)
+	std::atomic<INT64>		m_nextLog;					// time of the next log dump
+
+	static INT64 Now();
+	void Record(Stage stage, INT64 audioTime);
+	double Value(Stage stage, Stat stat) const;
+	void Reset();
+	void Log();
+};
+
+/**
+* CPU time of the pipeline stages of a parent.  The time of each stage is summed
+* over one display frame (one UpdateParent call, with the captures since the
+* previous one), and the frame sums are counted in histograms with 4 logarithmic
+* buckets per octave.  Time is measured in TSC ticks where available, which are
+* converted to ns when read.
+*/
+struct Profile
+{
+	enum Stage
+	{
+		STAGE_DRAIN,							// GetBuffer and ReleaseBuffer
+		STAGE_CONVERT,							// conversion to F32
+		STAGE_METERS,							// loudness, true-peak and ballistics meters
+		STAGE_DEINTERLEAVE,						// downmix, decimation and ring buffer write
+		STAGE_ENVELOPE,							// RMS and peak envelopes
+		STAGE_WINDOW,							// ring buffer copy and window function
+		STAGE_FFT,								// FFT
+		STAGE_SPECTRUM,							// power spectrum and FFT attack/decay
+		STAGE_BANDS,							// band integration
+		STAGE_SMOOTHING,						// band smoothing
+		STAGE_TOTAL,							// sum of all stages
+		// ... //
+		NUM_STAGES
+	};
+
+	enum Stat
+	{
+		STAT_MEAN,								// mean ns per frame
+		STAT_P99,								// 99th percentile of ns per frame
+		STAT_FPS,								// frames per second
+		STAT_SILENT,							// ratio of frames skipped due to silence
+		// ... //
+		NUM_STATS
+	};
+
+	static const int		s_nBuckets = 160;			// histogram buckets per stage
+	static const LPCWSTR	s_stageName[NUM_STAGES];
+	static const LPCWSTR	s_statName[NUM_STATS];
+
+	UINT64					m_frame[NUM_STAGES];		// ticks of the current frame
+	UINT64					m_sum[NUM_STAGES];			// ticks of all frames
+	UINT32					m_count[NUM_STAGES][s_nBuckets];	// number of frames per bucket
+	UINT64					m_nFrames;					// number of frames
+	UINT64					m_nSilent;					// number of frames skipped due to silence
+	UINT64					m_nWindowFrames;			// number of frames in the current second
+	Clock::time_point		m_windowStart;				// start of the current second
+	double					m_fps;						// frames per second
+
+	Profile() { Reset(); }
+
+	static UINT64 Ticks()
+	{
+#if defined(_M_X64) || defined(_M_IX86)
+		return __rdtsc();
+#else
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return counter.QuadPart;
+#endif
+	}
+
+	void Lap(Stage stage, UINT64* mark)
+	{
+		const UINT64 now = Ticks();
+		m_frame[stage] += now - *mark;
+		*mark = now;
+	}
+
+	static double NsPerTick();
+	void EndFrame(bool silent);
+	double Value(Stage stage, Stat stat) const;
+	void Reset();
+};
+
+struct Endpoint;
+struct Dispatcher;
+struct Loudness;
+struct TruePeak;
+struct Ballistics;
+struct Decimator;
+struct Parent;
 
 struct Measure
 {
@@ -95,10 +349,57 @@ struct Measure
 		TYPE_DEV_ID,
 		TYPE_DEV_LIST,
 		TYPE_BUFFERSTATUS,
+		TYPE_SKIPPEDFRAMES,
+		TYPE_UPDATERATE,
+		TYPE_UPDATEJITTER,
+		TYPE_DISPATCHRATE,
+		TYPE_LOUDNESS,
+		TYPE_TRUEPEAK,
+		TYPE_VU,
+		TYPE_PPM,
+		TYPE_PEAKHOLD,
+		TYPE_CLIP,
+		TYPE_GLITCHES,
+		TYPE_DROPPEDFRAMES,
+		TYPE_LATENCY,
+		TYPE_STATS,
 		// ... //
 		NUM_TYPES
 	};
 
+	enum GapMode
+	{
+		GAP_IGNORE,
+		GAP_ZEROS,
+		GAP_RESET,
+		// ... //
+		NUM_GAP_MODES
+	};
+
+	enum Window
+	{
+		WINDOW_HANN,
+		WINDOW_HAMMING,
+		WINDOW_BLACKMAN,
+		WINDOW_BLACKMANHARRIS,
+		WINDOW_NUTTALL,
+		WINDOW_FLATTOP,
+		WINDOW_KAISER,
+		WINDOW_RECTANGULAR,
+		// ... //
+		NUM_WINDOWS
+	};
+
+	enum LoudnessMode
+	{
+		LOUDNESS_MOMENTARY,
+		LOUDNESS_SHORTTERM,
+		LOUDNESS_INTEGRATED,
+		LOUDNESS_RANGE,
+		// ... //
+		NUM_LOUDNESS_MODES
+	};
+
 	enum Format
 	{
 		FMT_INVALID,
@@ -114,1095 +415,4465 @@ struct Measure
 		float x;
 	};
 
-	Port					m_port;						// port specifier (parsed from options)
-	Channel					m_channel;					// channel specifier (parsed from options)
 	Type					m_type;						// data type specifier (parsed from options)
-	Format					m_format;					// format specifier (detected in init)
-	int						m_envRMS[2];				// RMS attack/decay times in ms (parsed from options)
-	int						m_envPeak[2];				// peak attack/decay times in ms (parsed from options)
-	int						m_envFFT[2];				// FFT attack/decay times in ms (parsed from options)
-	int						m_fftSize;					// size of FFT (parsed from options)
-	int						m_fftBufferSize;			// size of FFT with zero-padding (parsed from options)
+	Channel					m_channel;					// channel specifier (parsed from options)
+	LoudnessMode			m_loudnessMode;				// loudness value to retrieve (parsed from options)
+	Latency::Stage			m_latencyStage;				// pipeline stage of the latency to retrieve (parsed from options)
+	Latency::Stat			m_latencyStat;				// latency statistic to retrieve (parsed from options)
+	Profile::Stage			m_profileStage;				// pipeline stage of the CPU time to retrieve (parsed from options)
+	Profile::Stat			m_profileStat;				// CPU time statistic to retrieve (parsed from options)
 	int						m_fftIdx;					// FFT index to retrieve (parsed from options)
 	int						m_waveIdx;					// WAVE index to retrieve (parsed from options)
-	int						m_nBands;					// number of frequency bands (parsed from options)
 	int						m_bandIdx;					// band index to retrieve (parsed from options)
+	int						m_meter;					// meter of the parent used by the type (Parent::Meter flag, 0 if none)
+	Parent*					m_parent;					// parent measure, if any
+	void*					m_skin;						// skin pointer
+	void*					m_rm;						// rainmeter pointer
+	LPCWSTR					m_rmName;					// measure name
+
+	Measure() :
+		m_type(TYPE_RMS),
+		m_channel(CHANNEL_SUM),
+		m_loudnessMode(LOUDNESS_MOMENTARY),
+		m_latencyStage(Latency::STAGE_DISPATCH),
+		m_latencyStat(Latency::STAT_P50),
+		m_profileStage(Profile::STAGE_TOTAL),
+		m_profileStat(Profile::STAT_MEAN),
+		m_fftIdx(-1),
+		m_waveIdx(0),
+		m_bandIdx(-1),
+		m_meter(0),
+		m_parent(NULL),
+		m_skin(NULL),
+		m_rm(NULL),
+		m_rmName(NULL)
+	{
+	}
+
+	Parent* ParentOrSelf();
+};
+
+/**
+* Per-frame state of a parent: everything the capture thread touches in ProcessChunk
+* and UpdateParent, packed together and aligned to a cache line.  Options that are
+* only needed to (re)build this state live in Parent.
+*/
+struct alignas(64) DSPState
+{
+	enum Smoothing
+	{
+		SMOOTH_CLAMP,									// SmoothingMode=0
+		SMOOTH_REPEAT,									// SmoothingMode=1
+		SMOOTH_REVERSE,									// SmoothingMode=2
+		SMOOTH_NONE,									// Smoothing=0
+		SMOOTH_HALF,									// wave bands, padded with 0.5
+	};
+
+	static const int		s_warmupUpdates = 8;		// updates after a reinit that may still allocate
+
+	WAVEFORMATEX*			m_wfx;						// audio format info (owned by the endpoint)
+	int						m_nAnalysis;				// number of analysis channels
+	UINT32					m_downmixMask;				// device channels with a non-zero weight
+	Decimator*				m_decimator;				// half-band decimator cascade ahead of the ring buffers, if any
+	Profile*				m_profile;					// CPU time of the pipeline stages, if compiled in
+	Loudness*				m_loudness;					// BS.1770 loudness meter, enabled by Type=Loudness measures
+	TruePeak*				m_truePeak;					// oversampled true-peak meter, enabled by Type=TruePeak measures
+	Ballistics*				m_ballistics;				// VU/PPM/peak hold/clip meters, enabled by measures of these types
+	float					m_kRMS[2];					// RMS attack/decay filter constants
+	float					m_kPeak[2];					// peak attack/decay filter constants
+	float					m_kRMSBlock[2];				// RMS attack/decay filter constants for a block of ENVELOPE_BLOCK samples
+	float					m_kPeakBlock[2];			// peak attack/decay filter constants for a block of ENVELOPE_BLOCK samples
+	int						m_envelopeMode;				// 0: per-sample ballistics, 1: per-block ballistics (parsed from options)
+	float					m_kFFT[2];					// FFT attack/decay filter constants
+	float					m_rms[Measure::MAX_CHANNELS];	// current RMS levels
+	float					m_peak[Measure::MAX_CHANNELS];	// current peak levels
+	int						m_fftSize;					// size of FFT (parsed from options)
+	int						m_fftBufferSize;			// size of FFT with zero-padding (parsed from options)
+	int						m_nBands;					// number of frequency bands (parsed from options)
 	int						m_smoothing;				// smoothing level (parsed from options)
 	int						m_smoothingMode;			// smoothing mode (parsed from options)
 	int						m_waveSize;					// size of WAVE (parsed from options)
 	int						m_ringBufferSize;			// size of the ring buffer for FFT and WAVE
+	int						m_ringBufW;					// write index for input ring buffers
+	int						m_hopSize;					// ring buffer samples between spectral frames, 0: one frame per update (parsed from options)
+	int						m_hopCount;					// ring buffer samples written since the last spectral frame
 	int						m_dynamicVolume;			// enable dynamic volume (parsed from options)
-	UINT32					m_nFramesNext;				// number of frames obtained on the UpdateParent call
 	UINT32					m_nSilentFrames;			// number of silent frames, used to calculate when to stop updating
-	double					m_gainRMS;					// RMS gain (parsed from options)
-	double					m_gainPeak;					// peak gain (parsed from options)
+	bool					m_silent;					// ring buffer filled with silence, skip the spectral stages
+	int						m_warmup;					// updates left until the processing path must be allocation-free
 	double					m_freqMin;					// min freq for band measurement
-	double					m_freqMax;					// max freq for band measurement
 	double					m_sensitivity;				// dB range for FFT/Band return values (parsed from options)
-	Measure*				m_parent;					// parent measure, if any
-	void*					m_skin;						// skin pointer
-	void*					m_rm;						// rainmeter pointer
-	LPCWSTR					m_rmName;					// measure name
-	IMMDeviceEnumerator*	m_enum;						// audio endpoint enumerator
-	IMMDevice*				m_dev;						// audio endpoint device
-	WAVEFORMATEX			m_wfxR;						// audio format request info
-	WAVEFORMATEX*			m_wfx;						// audio format info
-	IAudioClient*			m_clAudio;					// audio client instance
-	IAudioCaptureClient*	m_clCapture;				// capture client instance
-	IAudioClient*			m_clBugAudio;				// audio client for loopback events
-#if (WINDOWS_BUG_WORKAROUND)
-	IAudioRenderClient*		m_clBugRender;				// render client for dummy silent channel
-#endif
-	HANDLE					m_hReadyEvent;				// buffer-event handle to receive notifications
-	HANDLE					m_hStopEvent;				// skin closed handle to receive notifications
-	HANDLE					m_hTask;					// Multimedia Class Scheduler Service task
-	std::thread*			m_updateLoopThread;			// thread for running the update loop
-	std::chrono::system_clock::time_point
-							m_lastUpdate;				// time of last rainmeter update
-	std::chrono::duration<double>
-							m_waitUpdate;				// time to wait between updates
-	std::chrono::duration<double>
-							m_overheadUpdate;			// time that has been waited too long since last update
-	double					m_updatesPerSecond;			// updates per second
-	WCHAR					m_reqID[64];				// requested device ID (parsed from options)
-	WCHAR					m_devName[64];				// device friendly name (detected in init)
-	WCHAR					m_msgUpdate[256];			// rainmeter update command
-	float					m_kRMS[2];					// RMS attack/decay filter constants
-	float					m_kPeak[2];					// peak attack/decay filter constants
-	float					m_kFFT[2];					// FFT attack/decay filter constants
-	float*					m_bufChunk;					// buffer for latest data chunk copy
-	float					m_rms[MAX_CHANNELS];		// current RMS levels
-	float					m_peak[MAX_CHANNELS];		// current peak levels
 	float					m_fftMeanSquare;			// used for dynamic volume
+	float					m_df;						// delta freqency between two bins
+	float					m_dw;						// delta waveform values between two bands
+	float					m_fftScalar;				// FFT scalar
+	float					m_bandScalar;				// band scalar
+	float					m_waveScalar;				// wave scalar
+	float					m_smoothingScalar;			// smoothing scalar
 	PFFFT_Setup*			m_fftCfg;					// FFT states for each channel
 	float*					m_ringBuffer;				// ring buffer for audio data
 	float*					m_fftOut;					// buffer for FFT output
-	float*					m_fftKWdw;					// window function coefficients
+	const float*			m_fftKWdw;					// window function coefficients, in the arena or a compile-time table
 	float*					m_ringBufOut;				// buffer for audio data from the ring buffer
 	float*					m_fftTmpOut;				// temp FFT processing buffer
-	int						m_ringBufW;					// write index for input ring buffers
-	float*					m_bandFreq;					// buffer of band max frequencies
+	float*					m_fftWork;					// aligned work buffer shared by the FFTs of all analysis channels
+	const float*			m_bandFreq;					// buffer of band max frequencies, in the arena or a compile-time table
 	float*					m_bandOut;					// buffer of band values
 	float*					m_bandTmpOut;               // temp buffer of band values
 	float*					m_waveBandOut;				// buffer of wave values
 	float*					m_waveOut;					// temp buffer of wave values
 	float*					m_waveBandTmpOut;			// 2nd temp buffer of wave values
-	float					m_df;						// delta freqency between two bins
-	float					m_dw;						// delta waveform values between two bands
-	float					m_fftScalar;				// FFT scalar
-	float					m_bandScalar;				// band scalar
-	float					m_waveScalar;				// wave scalar
-	float					m_smoothingScalar;			// smoothing scalar
+	float					m_downmix[Measure::CHANNEL_SUM][DOWNMIX_LANES];	// downmix matrix, transposed: weight of a device channel in each analysis channel
 
-	Measure() :
-		m_port(PORT_OUTPUT),
-		m_channel(CHANNEL_SUM),
-		m_type(TYPE_RMS),
-		m_format(FMT_INVALID),
+	DSPState() :
+		m_wfx(NULL),
+		m_nAnalysis(1),
+		m_downmixMask((1 << Measure::CHANNEL_FL) | (1 << Measure::CHANNEL_FR)),
+		m_decimator(NULL),
+		m_profile(NULL),
+		m_loudness(NULL),
+		m_truePeak(NULL),
+		m_ballistics(NULL),
+		m_envelopeMode(0),
 		m_fftSize(0),
 		m_fftBufferSize(0),
-		m_fftIdx(-1),
-		m_fftScalar(0),
 		m_nBands(0),
-		m_bandIdx(-1),
-		m_bandScalar(0),
-		m_df(0),
-		m_dw(0),
 		m_smoothing(0),
 		m_smoothingMode(0),
-		m_smoothingScalar(0),
 		m_waveSize(0),
-		m_waveIdx(0),
-		m_waveScalar(0),
 		m_ringBufferSize(0),
-		m_nFramesNext(0),
-		m_nSilentFrames(0),
+		m_ringBufW(0),
+		m_hopSize(0),
+		m_hopCount(0),
 		m_dynamicVolume(0),
-		m_gainRMS(1.0),
-		m_gainPeak(1.0),
+		m_nSilentFrames(0),
+		m_silent(false),
+		m_warmup(0),
 		m_freqMin(20.0),
-		m_freqMax(20000.0),
 		m_sensitivity(0.0),
-		m_parent(NULL),
-		m_skin(NULL),
-		m_rm(NULL),
-		m_rmName(NULL),
-		m_enum(NULL),
-		m_dev(NULL),
-		m_wfxR({ 0 }),
-		m_wfx(NULL),
-		m_clAudio(NULL),
-		m_clCapture(NULL),
-		m_clBugAudio(NULL),
-#if (WINDOWS_BUG_WORKAROUND)
-		m_clBugRender(NULL),
-#endif
-		m_hReadyEvent(NULL),
-		m_hStopEvent(NULL),
-		m_hTask(NULL),
-		m_updateLoopThread(NULL),
-		m_waitUpdate(NULL),
-		m_overheadUpdate(NULL),
+		m_fftMeanSquare(0.0f),
+		m_df(0),
+		m_dw(0),
+		m_fftScalar(0),
+		m_bandScalar(0),
+		m_waveScalar(0),
+		m_smoothingScalar(0),
+		m_fftCfg(NULL),
+		m_ringBuffer(NULL),
+		m_fftOut(NULL),
 		m_fftKWdw(NULL),
 		m_ringBufOut(NULL),
 		m_fftTmpOut(NULL),
-		m_ringBufW(0),
-		m_bandFreq(NULL)
+		m_fftWork(NULL),
+		m_bandFreq(NULL),
+		m_bandOut(NULL),
+		m_bandTmpOut(NULL),
+		m_waveBandOut(NULL),
+		m_waveOut(NULL),
+		m_waveBandTmpOut(NULL)
 	{
-		m_envRMS[0] = 300;
-		m_envRMS[1] = 300;
-		m_envPeak[0] = 50;
-		m_envPeak[1] = 2500;
-		m_envFFT[0] = 300;
-		m_envFFT[1] = 300;
-		m_reqID[0] = '\0';
-		m_devName[0] = '\0';
-		m_msgUpdate[0] = '\0';
 		m_kRMS[0] = 0.0f;
 		m_kRMS[1] = 0.0f;
 		m_kPeak[0] = 0.0f;
 		m_kPeak[1] = 0.0f;
+		m_kRMSBlock[0] = 0.0f;
+		m_kRMSBlock[1] = 0.0f;
+		m_kPeakBlock[0] = 0.0f;
+		m_kPeakBlock[1] = 0.0f;
 		m_kFFT[0] = 0.0f;
 		m_kFFT[1] = 0.0f;
-		m_fftMeanSquare = 0.0f;
-		m_fftCfg = NULL;
-		m_bufChunk = NULL;
-		m_ringBuffer = NULL;
-		m_fftOut = NULL;
-		m_bandOut = NULL;
-		m_bandTmpOut = NULL;
-		m_waveBandOut = NULL;
-		m_waveOut = NULL;
-		m_waveBandTmpOut = NULL;
-	}
-
-	HRESULT DeviceInit();
-	void DeviceRelease();
-	HRESULT UpdateParent();
+		memset(m_downmix, 0, sizeof(m_downmix));
+		m_downmix[Measure::CHANNEL_FL][0] = 0.5f;
+		m_downmix[Measure::CHANNEL_FR][0] = 0.5f;
 
-	void DoCaptureLoop();
+		for (int iChan = 0; iChan < Measure::MAX_CHANNELS; ++iChan)
+		{
+			m_rms[iChan] = 0.0f;
+			m_peak[iChan] = 0.0f;
+		}
+	}
 };
 
-float pcmScalar = 1.0f / 0x7fff;
-
-const CLSID CLSID_MMDeviceEnumerator = __uuidof(MMDeviceEnumerator);
-const IID IID_IMMDeviceEnumerator = __uuidof(IMMDeviceEnumerator);
-const IID IID_IAudioClient = __uuidof(IAudioClient);
-//const IID IID_IAudioClient3 = __uuidof(IAudioClient3);
-const IID IID_IAudioCaptureClient = __uuidof(IAudioCaptureClient);
-const IID IID_IAudioRenderClient = __uuidof(IAudioRenderClient);
-
-std::vector<Measure*> s_parents;
-
-void Measure::DoCaptureLoop()
+/**
+* Parent measure: owns the options, the device and the DSP state that its child
+* measures read.  Children only allocate the small Measure part.
+*/
+struct Parent : Measure, DSPState
 {
-	// register thread with MMCSS
-	DWORD nTaskIndex = 0;
-	m_hTask = AvSetMmThreadCharacteristics(L"Pro Audio", &nTaskIndex);
-	if (!(m_hTask && AvSetMmThreadPriority(m_hTask, AVRT_PRIORITY_CRITICAL)))
+	enum Rebuild
 	{
-		DWORD dwErr = GetLastError();
-		RmLog(m_rm, LOG_WARNING, L"Failed to start multimedia task.");
-		return;
-	}
-
-	HANDLE waitArray[2] = { m_hReadyEvent, m_hStopEvent };
+		REBUILD_RING = 1,						// ring buffers and decimator
+		REBUILD_FFT = 2,						// smoothed spectra, the pffft setup follows FFTBufferSize
+		REBUILD_WINDOW = 4,						// window function
+		REBUILD_BANDS = 8,						// band frequencies
+		REBUILD_ALL = 15
+	};
 
-	while (1)
+	enum Meter
 	{
-		if (WAIT_OBJECT_0 != WaitForMultipleObjects(ARRAYSIZE(waitArray), waitArray, FALSE, INFINITE))
-			return;
+		METER_LOUDNESS = 1,						// BS.1770 loudness
+		METER_TRUEPEAK = 2,						// oversampled true peak
+		METER_BALLISTICS = 4,					// VU, PPM, peak hold and clip
+		NUM_METERS = 3
+	};
 
-		// update parent seperated from measure update function
-		HRESULT hr = UpdateParent();
+	Port					m_port;						// port specifier (parsed from options)
+	Channel					m_analysis[MAX_CHANNELS];	// analysis channels with their own ring buffer and spectra (parsed from options)
+	int						m_decimation;				// decimate the ring buffer input when FreqMax allows it (parsed from options)
+	GapMode					m_gapMode;					// handling of dropped frames and discontinuities (parsed from options)
+	Window					m_window;					// FFT window function (parsed from options)
+	double					m_kaiserBeta;				// shape of the Kaiser window (parsed from options)
+	int						m_envRMS[2];				// RMS attack/decay times in ms (parsed from options)
+	int						m_envPeak[2];				// peak attack/decay times in ms (parsed from options)
+	int						m_envFFT[2];				// FFT attack/decay times in ms (parsed from options)
+	int						m_adaptiveUpdate;			// enable adaptive update rate (parsed from options)
+	float					m_adaptiveThreshold;		// smallest visible change of a value (parsed from options)
+	int						m_adaptiveDivider;			// current divider of the update rate
+	int						m_adaptiveTicks;			// number of updates held back since the last shown one
+	float*					m_adaptiveOut;				// snapshot of the last shown values
+	double					m_gainRMS;					// RMS gain (parsed from options)
+	double					m_gainPeak;					// peak gain (parsed from options)
+	double					m_freqMax;					// max freq for band measurement
+	int						m_ppmType;					// PPM type, 1: IEC Type I (DIN), 2: IEC Type II (BBC/EBU) (parsed from options)
+	int						m_holdTime;					// peak hold time in ms (parsed from options)
+	double					m_fallRate;					// peak hold fall rate in dB/s (parsed from options)
+	double					m_vuReference;				// level of 0 VU in dBFS (parsed from options)
+	double					m_clipLevel;				// level counted as clipping in dBFS (parsed from options)
+	IMMDeviceEnumerator*	m_enum;						// audio endpoint enumerator
+	IMMDevice*				m_dev;						// audio endpoint device
+	Endpoint*				m_endpoint;					// shared capture stream of the audio endpoint
+	Dispatcher*				m_dispatcher;				// batches the update commands of paced parents
+	Parent*					m_dspSource;				// parent with identical DSP settings whose results are shared, if any
+	Pacer					m_pacer;					// paces the updates
+	double					m_updatesPerSecond;			// updates per second
+	HRESULT					m_hrUpdate;					// result of the last UpdateParent call
+	HRESULT					(Parent::*m_updateParent)();	// UpdateParent variant for the current settings
+	UINT64					m_nSkippedFrames;			// number of captures whose spectral stages were skipped (not due)
+	BYTE*					m_arena;					// aligned block holding all DSP buffers
+	size_t					m_arenaSize;				// bytes of the arena in use by the current settings
+	size_t					m_arenaCapacity;			// bytes allocated for the arena
+	int						m_fftCfgSize;				// FFT buffer size the pffft setup was created for
+	int						m_meters;					// meters used by the parent or its children (Meter flags)
+	int						m_meterUsers[NUM_METERS];	// number of measures using each meter, by bit of the Meter flags
+	WCHAR					m_reqID[64];				// requested device ID (parsed from options)
+	WCHAR					m_msgUpdate[256];			// rainmeter update commands, as a list of bracketed bangs
+
+	Parent() :
+		m_port(PORT_OUTPUT),
+		m_decimation(0),
+		m_gapMode(GAP_ZEROS),
+		m_window(WINDOW_HANN),
+		m_kaiserBeta(8.6),
+		m_adaptiveUpdate(0),
+		m_adaptiveThreshold(0.01f),
+		m_adaptiveDivider(1),
+		m_adaptiveTicks(0),
+		m_adaptiveOut(NULL),
+		m_gainRMS(1.0),
+		m_gainPeak(1.0),
+		m_freqMax(20000.0),
+		m_ppmType(2),
+		m_holdTime(1500),
+		m_fallRate(20.0),
+		m_vuReference(-18.0),
+		m_clipLevel(0.0),
+		m_enum(NULL),
+		m_dev(NULL),
+		m_endpoint(NULL),
+		m_dispatcher(NULL),
+		m_dspSource(NULL),
+		m_updatesPerSecond(-1),
+		m_hrUpdate(S_FALSE),
+		m_updateParent(&Parent::UpdateSpectra<false, SMOOTH_NONE>),
+		m_nSkippedFrames(0),
+		m_arena(NULL),
+		m_arenaSize(0),
+		m_arenaCapacity(0),
+		m_fftCfgSize(0),
+		m_meters(0)
+	{
+		m_analysis[0] = CHANNEL_SUM;
+		m_envRMS[0] = 300;
+		m_envRMS[1] = 300;
+		m_envPeak[0] = 50;
+		m_envPeak[1] = 2500;
+		m_envFFT[0] = 300;
+		m_envFFT[1] = 300;
+		m_reqID[0] = '\0';
+		m_msgUpdate[0] = '\0';
+		memset(m_meterUsers, 0, sizeof(m_meterUsers));
+	}
+
+	// the DSP state is cache line aligned, which plain new does not guarantee before C++17
+	static void* operator new(size_t size)
+	{
+		void* p = pffft_aligned_malloc(size);
+		if (!p) throw std::bad_alloc();
+		return p;
+	}
+	static void operator delete(void* p) { pffft_aligned_free(p); }
+
+	HRESULT ProcessChunk(const float* chunk, UINT32 nFrames, DWORD flags);
+	void EnvelopeSample(const float* chunk, UINT32 nFrames, int nChannels);
+	void EnvelopeBlock(const float* chunk, UINT32 nFrames, int nChannels);
+	HRESULT UpdateParent() { return (this->*m_updateParent)(); }
+	template <bool DYNAMIC_VOLUME, int SMOOTHING> HRESULT UpdateSpectra();
+	template <bool DYNAMIC_VOLUME> void SpectrumFrame(int iAna);
+	void SelectUpdate();
+	void BuffersInit(int nStages, int rebuild);
+	void BuffersRelease();
+	void FiltersInit();
+	void UseMeter(Measure* m, int meter);
+	void ResetStream();
+
+	bool IsCapturing() const;
+	bool IsUpdateDue(Clock::time_point now) const;
+	bool IsChangeVisible();
+	bool SameDSP(const Parent* other) const;
+	const Parent* DSP() const { return m_dspSource ? m_dspSource : this; }
+	int AnalysisIndex(Channel channel) const;
+};
+
+/**
+* The parent that computes the values of a measure: its parent, or the measure itself.
+*
+* @return		Parent measure.
+*/
+inline Parent* Measure::ParentOrSelf()
+{
+	return m_parent ? m_parent : static_cast<Parent*>(this);
+}
+
+/**
+* Follows the device position of the captured packets.  A packet that starts
+* after the end of the previous one means that frames were dropped (for example
+* after a stall of the capture thread), which is counted as a glitch, like the
+* discontinuities flagged by the audio engine.
+*/
+struct GapTracker
+{
+	UINT64					m_next;						// expected device position of the next packet
+	bool					m_valid;					// the expected position is known
+	UINT64					m_nPackets;					// number of tracked packets
+	UINT64					m_nGlitches;				// number of gaps and discontinuities
+	UINT64					m_nDropped;					// number of frames missing in the gaps
+
+	GapTracker() :
+		m_next(0),
+		m_valid(false),
+		m_nPackets(0),
+		m_nGlitches(0),
+		m_nDropped(0)
+	{
+	}
+
+	/**
+	* Track a captured packet.
+	*
+	* @param[in]	devPosition		Device position of the first frame of the packet.
+	* @param[in]	nFrames			Number of frames in the packet.
+	* @param[in]	flags			Buffer flags of the packet.
+	* @param[out]	nMissing		Number of frames missing before the packet.
+	* @return		True if there is a glitch before the packet.
+	*/
+	bool Track(UINT64 devPosition, UINT32 nFrames, DWORD flags, UINT64* nMissing)
+	{
+		*nMissing = 0;
+
+		if (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR)
+		{
+			// the position is unreliable, resynchronize on the next packet
+			m_valid = false;
+		}
+		else
+		{
+			if (m_valid && devPosition > m_next)
+			{
+				*nMissing = devPosition - m_next;
+			}
+			m_next = devPosition + nFrames;
+			m_valid = true;
+		}
+
+		// the first packet of a stream is flagged as a discontinuity
+		const bool first = m_nPackets++ == 0;
+		if (*nMissing || ((flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) && !first))
+		{
+			++m_nGlitches;
+			m_nDropped += *nMissing;
+			return true;
+		}
+
+		return false;
+	}
+};
+
+/**
+* Capture stream of one audio endpoint, shared by every parent measure monitoring it.
+* The endpoint owns the WASAPI clients and the capture thread, and fans out each
+* converted data chunk to the DSP pipeline of its subscribed parents.
+*/
+struct Endpoint
+{
+	struct Dispatch
+	{
+		void*				skin;
+		INT64				audioTime;					// capture time of the newest audio shown by the update
+		WCHAR				msg[256];
+	};
+
+	Measure::Port			m_port;						// port of the endpoint
+	bool					m_polled;					// no capture thread, captured on rainmeter update (UpdatesPerSecond=-2)
+	int						m_refCount;					// number of subscribed parents
+	WCHAR					m_id[256];					// endpoint device ID
+	WCHAR					m_devName[64];				// device friendly name (detected in init)
+	Measure::Format			m_format;					// format specifier (detected in init)
+	IMMDevice*				m_dev;						// audio endpoint device
+	WAVEFORMATEX			m_wfxR;						// audio format request info
+	WAVEFORMATEX*			m_wfx;						// audio format info
+	IAudioClient*			m_clAudio;					// audio client instance
+	IAudioCaptureClient*	m_clCapture;				// capture client instance
+	IAudioClient*			m_clBugAudio;				// audio client for loopback events
+#if (WINDOWS_BUG_WORKAROUND)
+	IAudioRenderClient*		m_clBugRender;				// render client for dummy silent channel
+#endif
+	HANDLE					m_hReadyEvent;				// buffer-event handle to receive notifications
+	HANDLE					m_hStopEvent;				// skin closed handle to receive notifications
+	HANDLE					m_hTask;					// Multimedia Class Scheduler Service task
+	std::thread*			m_captureThread;			// thread for running the capture loop
+	UINT32					m_nFramesNext;				// number of frames obtained on the last capture
+	Clock::time_point		m_lastCapture;				// time of the last captured data
+	float*					m_bufChunk;					// buffer for latest data chunk copy
+	UINT32					m_bufFrames;				// number of frames fitting into the chunk buffer
+	INT64					m_audioTime;				// capture time of the end of the newest packet
+#if (PROFILE_STAGES)
+	Profile					m_profile;					// CPU time of the drain and conversion since the last capture
+#endif
+	GapTracker				m_gaps;						// dropped frames and discontinuities of the stream
+	std::mutex				m_lock;						// guards the parents and their DSP state
+	std::vector<Parent*>	m_parents;					// subscribed parent measures
+	std::vector<Dispatch>	m_dispatch;					// pending update commands of the current capture
+
+	Endpoint() :
+		m_port(Measure::PORT_OUTPUT),
+		m_polled(false),
+		m_refCount(0),
+		m_format(Measure::FMT_INVALID),
+		m_dev(NULL),
+		m_wfxR({ 0 }),
+		m_wfx(NULL),
+		m_clAudio(NULL),
+		m_clCapture(NULL),
+		m_clBugAudio(NULL),
+#if (WINDOWS_BUG_WORKAROUND)
+		m_clBugRender(NULL),
+#endif
+		m_hReadyEvent(NULL),
+		m_hStopEvent(NULL),
+		m_hTask(NULL),
+		m_captureThread(NULL),
+		m_nFramesNext(0),
+		m_bufChunk(NULL),
+		m_bufFrames(0),
+		m_audioTime(0)
+	{
+		m_id[0] = '\0';
+		m_devName[0] = '\0';
+	}
+
+	~Endpoint()
+	{
+		if (m_hReadyEvent != NULL) { CloseHandle(m_hReadyEvent); }
+		if (m_hStopEvent != NULL) { CloseHandle(m_hStopEvent); }
+	}
+
+	static Endpoint* Acquire(Parent* parent);
+	static void Release(Parent* parent);
+
+	HRESULT DeviceInit();
+	void DeviceRelease();
+	HRESULT Capture();
+	void FillGap(UINT64 nMissing);
+	void ShareResults();
+	void ArmTimer(HANDLE hTimer, Clock::time_point now);
+
+	void DoCaptureLoop();
+};
+
+/**
+* Sends the update commands of all paced parents on a common display tick.  The
+* commands posted for a skin during one tick are merged into a single bang, with
+* duplicate group updates removed and the meter updates followed by one redraw.
+*/
+struct Dispatcher
+{
+	struct Pending
+	{
+		const Parent*		parent;
+		void*				skin;
+		INT64				audioTime;					// capture time of the newest audio shown by the bangs
+		WCHAR				msg[256];					// update commands of the parent
+	};
+
+	struct Flush
+	{
+		void*				skin;
+		INT64				audioTime;
+		std::wstring		bang;						// measure update bangs, then the meter updates and the redraw
+		std::wstring		meters;						// meter update bangs
+	};
+
+	HANDLE					m_hStopEvent;				// stops the dispatch thread
+	Clock::duration			m_period;					// time between two ticks (fastest registered rate)
+	std::mutex				m_lock;						// guards the registrations and pending commands
+	std::vector<Parent*>	m_parents;					// registered parents
+	std::vector<Pending>	m_pending;					// pending commands per parent
+	size_t					m_nPending;					// number of parents with pending commands
+	std::vector<Flush>		m_flush;					// merged commands per skin of the current tick
+	UINT64					m_nBangs;					// number of executed bangs
+	UINT64					m_nWindowBangs;				// number of executed bangs in the current second
+	Clock::time_point		m_windowStart;				// start of the current second
+	double					m_bangRate;					// executed bangs per second
+
+	Dispatcher() :
+		m_hStopEvent(CreateEvent(NULL, FALSE, FALSE, NULL)),
+		m_period(0),
+		m_nPending(0),
+		m_nBangs(0),
+		m_nWindowBangs(0),
+		m_windowStart(Clock::now()),
+		m_bangRate(0.0)
+	{
+	}
+
+	~Dispatcher()
+	{
+		if (m_hStopEvent != NULL) { CloseHandle(m_hStopEvent); }
+	}
+
+	static void Register(Parent* parent);
+	static void Unregister(Parent* parent);
+
+	void UpdatePeriod();
+	void Post(const Parent* parent, INT64 audioTime);
+	void DoFlush();
+
+	void DoDispatchLoop();
+};
+
+/**
+* ITU-R BS.1770 loudness meter.  The K-weighted mean squares of all channels are
+* summed in blocks of 100ms, the momentary (400ms) and short-term (3s) loudness
+* are computed from the last block sums, and the gated integrated loudness and
+* the loudness range (EBU Tech 3342) are computed from histograms of constant
+* size, so the memory does not grow with the measurement time.
+*/
+struct Loudness
+{
+	struct Biquad
+	{
+		double				b0, b1, b2;
+		double				a1, a2;
+	};
+
+	static const int		s_nBlocks = 30;				// 100ms blocks in the short-term window
+	static const int		s_nBins = 800;				// 0.1 LU histogram bins from -70 to +10 LUFS
+	static const double		s_floor;					// absolute gate, lowest reported loudness
+
+	Biquad					m_shelf;					// K-weighting stage 1: high shelf (head response)
+	Biquad					m_highpass;					// K-weighting stage 2: RLB high-pass
+	double					m_z[Measure::CHANNEL_SUM][4];	// filter states of both stages per channel
+	double					m_weight[Measure::CHANNEL_SUM];	// channel weights
+	UINT32					m_blockSize;				// number of frames in a 100ms block
+	UINT32					m_blockPos;					// number of frames in the current block
+	double					m_blockSum;					// weighted sum of squares of the current block
+	double					m_blocks[s_nBlocks];		// mean squares of the last 100ms blocks
+	int						m_iBlock;					// write index of the block mean squares
+	UINT64					m_nBlocks;					// number of completed blocks
+	double					m_momentary;				// momentary loudness in LUFS
+	double					m_shortTerm;				// short-term loudness in LUFS
+	double					m_integrated;				// integrated loudness in LUFS
+	double					m_range;					// loudness range in LU
+	UINT32					m_gateCount[s_nBins];		// number of 400ms gating blocks per loudness bin
+	double					m_gatePower[s_nBins];		// summed mean squares of the gating blocks per bin
+	UINT32					m_rangeCount[s_nBins];		// number of short-term values per loudness bin
+	double					m_rangePower[s_nBins];		// summed mean squares of the short-term values per bin
+
+	void Init(const WAVEFORMATEX* wfx);
+	void Reset();
+	void Process(const float* chunk, UINT32 nFrames, int nChannels);
+	void EndBlock();
+	double Value(Measure::LoudnessMode mode) const;
+
+	static double ToLUFS(double power) { return power > 0.0 ? max(s_floor, -0.691 + 10.0 * log10(power)) : s_floor; }
+	static void Gate(const UINT32* count, const double* power, double relGate, int* first, double* weight, double* n, double* sum);
+};
+
+/**
+* True-peak meter (BS.1770 Annex 2).  Each channel is deinterleaved into a planar
+* history, oversampled 4x with a 48-tap polyphase FIR, and the largest absolute
+* value of the 4 phases drives a peak envelope with the parent's ballistics.  With
+* SSE, the 4 phases of one input sample are computed together in one register.
+*/
+struct TruePeak
+{
+	static const int		s_nTaps = 12;				// taps per phase
+	static const int		s_nPhases = 4;				// oversampling factor
+	static const int		s_block = 256;				// frames deinterleaved at once
+	static const float		s_coef[s_nTaps][s_nPhases];	// polyphase coefficients, the 4 phases side by side
+	static const double		s_floor;					// lowest reported level in dBTP
+
+	float					m_history[Measure::CHANNEL_SUM][s_nTaps - 1 + s_block];	// planar input with filter history
+	float					m_peak[Measure::MAX_CHANNELS];	// true-peak envelopes, and their maximum as CHANNEL_SUM
+
+	void Reset();
+	void Process(const float* chunk, UINT32 nFrames, int nChannels, const float* kPeak);
+	double Value(Measure::Channel channel) const;
+};
+
+/**
+* Standard meter ballistics.  The rectified mean, the maximum and the number of
+* clipped samples of each channel are accumulated in blocks of ENVELOPE_BLOCK
+* frames, and the integrators run once per block on all channels at once:
+* - VU (IEC 60268-17): second order, 99% of a steady tone after 300ms, 1.5% overshoot.
+* - PPM (IEC 60268-10): quasi-peak integration with a linear-in-dB return.
+* - Peak hold: the block maximum is held for HoldTime, then falls with FallRate.
+*/
+struct Ballistics
+{
+	static const double		s_floor;					// lowest reported level in dB
+
+	float					m_vuGain;					// block sum of |x| to sine RMS
+	float					m_vuW2;						// VU needle stiffness (w^2)
+	float					m_vuDamp;					// VU needle damping (2 zeta w)
+	float					m_dt;						// block duration in seconds
+	float					m_vuScale;					// linear level to 0 VU
+	float					m_kPPMAttack;				// PPM integration constant per block
+	float					m_kPPMFall;					// PPM return factor per block
+	float					m_kHoldFall;				// peak hold fall factor per block
+	float					m_holdBlocks;				// peak hold time in blocks
+	float					m_clipLevel;				// linear clip level
+	int						m_blockPos;					// number of frames in the current block
+	float					m_sumAbs[8];				// sum of |x| in the current block
+	float					m_maxAbs[8];				// maximum of |x| in the current block
+	float					m_clips[8];					// number of clipped samples in the current block
+	float					m_vu[Measure::MAX_CHANNELS];	// VU needle position (linear, sine RMS)
+	float					m_vuVel[8];					// VU needle velocity
+	float					m_ppm[Measure::MAX_CHANNELS];	// PPM level (linear)
+	float					m_hold[Measure::MAX_CHANNELS];	// held peak level (linear)
+	float					m_holdLeft[8];				// remaining hold time in blocks
+	UINT64					m_nClips[Measure::MAX_CHANNELS];	// number of clipped samples since the last reset
+
+	void Configure(const Parent* parent);
+	void Reset();
+	void ResetHold();
+	void Process(const float* chunk, UINT32 nFrames, int nChannels);
+	void EndBlock(int nLanes);
+	double Value(Measure::Type type, Measure::Channel channel) const;
+};
+
+/**
+* Cascade of half-band decimators, each halving the sample rate of the analysis
+* channels ahead of the ring buffers.  Every other tap of a half-band filter is
+* zero, so each output costs one multiply per symmetric tap pair plus the center.
+*/
+struct Decimator
+{
+	static const int		s_maxStages = 5;			// up to 32x decimation
+	static const int		s_nTaps = 47;				// filter length
+	static const int		s_nPairs = (s_nTaps + 1) / 4;	// non-zero symmetric tap pairs
+	static const int		s_nLine = 64;				// delay line length, power of 2 >= s_nTaps
+
+	int						m_nStages;					// number of stages
+	int						m_nChannels;				// number of analysis channels
+	float					m_coef[s_nPairs];			// odd taps next to the center, outwards
+	int						m_pos[s_maxStages];			// write index of the delay lines
+	bool					m_odd[s_maxStages];			// an input is waiting for its pair
+	float					m_line[s_maxStages][Measure::MAX_CHANNELS][s_nLine * 2];	// delay lines, stored twice to read without wrapping
+
+	void Init(int nStages, int nChannels);
+	bool Push(float* frame);
+
+	static int Stages(double sampleRate, double freqMax);
+};
+
+float pcmScalar = 1.0f / 0x7fff;
+
+const CLSID CLSID_MMDeviceEnumerator = __uuidof(MMDeviceEnumerator);
+const IID IID_IMMDeviceEnumerator = __uuidof(IMMDeviceEnumerator);
+const IID IID_IAudioClient = __uuidof(IAudioClient);
+//const IID IID_IAudioClient3 = __uuidof(IAudioClient3);
+const IID IID_IAudioCaptureClient = __uuidof(IAudioCaptureClient);
+const IID IID_IAudioRenderClient = __uuidof(IAudioRenderClient);
+
+std::vector<Parent*> s_parents;
+std::vector<Endpoint*> s_endpoints;
+Dispatcher* s_dispatcher = NULL;
+Latency s_latency;
+
+// time after a tick the dispatcher waits for the parents to finish their calculations
+const Clock::duration s_dispatchSettle = std::chrono::milliseconds(2);
+
+// time without captured data after which the stream is considered idle and the pacer stops
+const Clock::duration s_idleTimeout = std::chrono::milliseconds(100);
+
+const LPCWSTR Latency::s_stageName[Latency::NUM_STAGES] = { L"Capture", L"FFT", L"Publish", L"Dispatch" };
+const LPCWSTR Latency::s_statName[Latency::NUM_STATS] = { L"P50", L"P99", L"Max", L"Jitter" };
+
+const LPCWSTR Profile::s_stageName[Profile::NUM_STAGES] =
+{
+	L"Drain", L"Convert", L"Meters", L"Deinterleave", L"Envelope", L"Window", L"FFT", L"Spectrum", L"Bands", L"Smoothing", L"Total"
+};
+const LPCWSTR Profile::s_statName[Profile::NUM_STATS] = { L"Mean", L"P99", L"FPS", L"SilentRatio" };
+
+// reference points to calibrate the profile ticks against the performance counter
+const UINT64 s_profileTicks = Profile::Ticks();
+const INT64 s_profileTime = Latency::Now();
+
+#if (TRACK_ALLOCATIONS)
+/**
+* Debug check of the allocation-free processing path.  A CRT allocation hook, or the
+* allocator of a test program, counts the heap allocations of each thread, and a
+* guard compares the count over its scope.
+*/
+struct AllocGuard
+{
+	static thread_local UINT32	s_nAllocs;				// heap allocations of the current thread
+	static std::atomic<UINT32>	s_nViolations;			// guarded scopes that allocated after warm-up
+#ifdef _MSC_VER
+	static _CRT_ALLOC_HOOK		s_prevHook;				// hook that was installed before, if any
+#endif
+
+	bool					m_armed;					// warm-up is over, allocations are violations
+	UINT32					m_nAllocs;					// allocation count at the start of the scope
+
+	AllocGuard(bool armed) : m_armed(armed), m_nAllocs(s_nAllocs) {}
+	~AllocGuard()
+	{
+		if (m_armed && s_nAllocs != m_nAllocs)
+		{
+			++s_nViolations;
+#ifdef _MSC_VER
+			_RPT1(_CRT_WARN, "AudioLevel: %u heap allocations in the processing path.\n", s_nAllocs - m_nAllocs);
+#endif
+		}
+	}
+
+	static void Count() { ++s_nAllocs; }
+
+#ifdef _MSC_VER
+	static int __cdecl Hook(int allocType, void* userData, size_t size, int blockType, long request, const unsigned char* file, int line)
+	{
+		if (allocType != _HOOK_FREE) Count();
+		return s_prevHook ? s_prevHook(allocType, userData, size, blockType, request, file, line) : TRUE;
+	}
+
+	static void Install() { s_prevHook = _CrtSetAllocHook(Hook); }
+	static void Uninstall() { _CrtSetAllocHook(s_prevHook); }
+#else
+	static void Install() {}
+	static void Uninstall() {}
+#endif
+};
+
+thread_local UINT32 AllocGuard::s_nAllocs = 0;
+std::atomic<UINT32> AllocGuard::s_nViolations(0);
+#ifdef _MSC_VER
+_CRT_ALLOC_HOOK AllocGuard::s_prevHook = NULL;
+#endif
+#endif
+
+const double Loudness::s_floor = -70.0;
+const double TruePeak::s_floor = -70.0;
+const double Ballistics::s_floor = -70.0;
+
+// BS.1770-4 Annex 2 interpolation filter, tap-major
+const float TruePeak::s_coef[TruePeak::s_nTaps][TruePeak::s_nPhases] =
+{
+	{  0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f },
+	{  0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f },
+	{ -0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f },
+	{  0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f },
+	{ -0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f },
+	{  0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f },
+	{  0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f },
+	{ -0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f },
+	{  0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f },
+	{ -0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f },
+	{  0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f },
+	{ -0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f },
+};
+
+/**
+* Histogram bucket of a value, with 4 logarithmic buckets per octave above 1.
+*
+* @param[in]	x				Value.
+* @param[in]	nBuckets		Number of buckets, larger values go into the last one.
+* @return		Bucket index.
+*/
+static inline int LogBucket(double x, int nBuckets)
+{
+	return x < 1.0 ? 0 : min(nBuckets - 1, 1 + (int)(4.0 * log2(x)));
+}
+
+/**
+* Percentile of a histogram with LogBucket buckets.
+*
+* @param[in]	count			Number of values per bucket.
+* @param[in]	nBuckets		Number of buckets.
+* @param[in]	p				Percentile (0.0 to 1.0).
+* @return		Geometric center of the bucket of the percentile, 0 for an empty histogram.
+*/
+static double LogPercentile(const UINT32* count, int nBuckets, double p)
+{
+	UINT64 n = 0;
+	for (int i = 0; i < nBuckets; ++i)
+	{
+		n += count[i];
+	}
+	if (!n) return 0.0;
+
+	const UINT64 rank = (UINT64)ceil(p * n);
+	UINT64 sum = 0;
+	int iBucket = 0;
+	for (; iBucket < nBuckets - 1; ++iBucket)
+	{
+		sum += count[iBucket];
+		if (sum >= rank) break;
+	}
+
+	return iBucket ? pow(2.0, (iBucket - 0.5) / 4.0) : 0.5;
+}
+
+/**
+* Current time on the clock of the audio time stamps.
+*
+* @return		Performance counter in 100ns units.
+*/
+INT64 Latency::Now()
+{
+	static LARGE_INTEGER s_freq = { 0 };
+	if (!s_freq.QuadPart) QueryPerformanceFrequency(&s_freq);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// split the conversion, so it does not overflow
+	return counter.QuadPart / s_freq.QuadPart * 10000000 + counter.QuadPart % s_freq.QuadPart * 10000000 / s_freq.QuadPart;
+}
+
+/**
+* Count the age of the newest captured audio when a stage is reached.
+*
+* @param[in]	stage			Stage of the pipeline.
+* @param[in]	audioTime		Capture time of the newest audio, see Now().
+*/
+void Latency::Record(Stage stage, INT64 audioTime)
+{
+	if (!audioTime) return;
+
+	const INT64 us = max(0LL, (Now() - audioTime) / 10);
+	m_count[stage][LogBucket((double)us, s_nBuckets)].fetch_add(1, std::memory_order_relaxed);
+
+	const UINT32 value = (UINT32)min(us, 0xffffffffLL);
+	UINT32 prev = m_max[stage].load(std::memory_order_relaxed);
+	while (value > prev && !m_max[stage].compare_exchange_weak(prev, value, std::memory_order_relaxed));
+}
+
+/**
+* Latency statistic of a stage since the last reset.
+*
+* @param[in]	stage			Stage of the pipeline.
+* @param[in]	stat			Statistic to retrieve.
+* @return		Latency in ms, 0 without samples.
+*/
+double Latency::Value(Stage stage, Stat stat) const
+{
+	if (stat == STAT_MAX)
+	{
+		return m_max[stage].load(std::memory_order_relaxed) * 0.001;
+	}
+	if (stat == STAT_JITTER)
+	{
+		return Value(stage, STAT_P99) - Value(stage, STAT_P50);
+	}
+
+	UINT32 count[s_nBuckets];
+	for (int i = 0; i < s_nBuckets; ++i)
+	{
+		count[i] = m_count[stage][i].load(std::memory_order_relaxed);
+	}
+
+	return LogPercentile(count, s_nBuckets, stat == STAT_P50 ? 0.50 : 0.99) * 0.001;
+}
+
+void Latency::Reset()
+{
+	for (int iStage = 0; iStage < NUM_STAGES; ++iStage)
+	{
+		for (int i = 0; i < s_nBuckets; ++i)
+		{
+			m_count[iStage][i].store(0, std::memory_order_relaxed);
+		}
+		m_max[iStage].store(0, std::memory_order_relaxed);
+	}
+}
+
+/**
+* Write the latencies of all stages to the log when the log period has passed.
+* Called by every capture thread, only one of them writes each dump.
+*/
+void Latency::Log()
+{
+	const int period = m_logPeriod.load(std::memory_order_relaxed);
+	if (period <= 0) return;
+
+	const INT64 now = Now();
+	INT64 next = m_nextLog.load(std::memory_order_relaxed);
+	if (now < next || !m_nextLog.compare_exchange_strong(next, now + period * 10000000LL)) return;
+	if (!next) return;	// first call, start the period
+
+	WCHAR msg[512];
+	int len = _snwprintf_s(msg, _TRUNCATE, L"AudioLevel: latency p50/p99/max in ms:");
+	for (int iStage = 0; iStage < NUM_STAGES && len >= 0; ++iStage)
+	{
+		const int n = _snwprintf_s(msg + len, _countof(msg) - len, _TRUNCATE, L" %s %.2f/%.2f/%.2f", s_stageName[iStage],
+			Value((Stage)iStage, STAT_P50), Value((Stage)iStage, STAT_P99), Value((Stage)iStage, STAT_MAX));
+		len = n < 0 ? -1 : len + n;
+	}
+	RmLog(NULL, LOG_NOTICE, msg);
+}
+
+/**
+* Duration of a profile tick, calibrated against the performance counter since the plugin was loaded.
+*
+* @return		Nanoseconds per tick.
+*/
+double Profile::NsPerTick()
+{
+	const UINT64 ticks = Ticks() - s_profileTicks;
+	return ticks ? (Latency::Now() - s_profileTime) * 100.0 / ticks : 0.0;
+}
+
+/**
+* Count the stage times of the current frame, and start a new one.
+*
+* @param[in]	silent			The spectral stages were skipped due to silence.
+*/
+void Profile::EndFrame(bool silent)
+{
+	UINT64 total = 0;
+	for (int iStage = 0; iStage < STAGE_TOTAL; ++iStage)
+	{
+		total += m_frame[iStage];
+	}
+	m_frame[STAGE_TOTAL] = total;
+
+	for (int iStage = 0; iStage < NUM_STAGES; ++iStage)
+	{
+		m_sum[iStage] += m_frame[iStage];
+		++m_count[iStage][LogBucket((double)m_frame[iStage], s_nBuckets)];
+		m_frame[iStage] = 0;
+	}
+
+	++m_nFrames;
+	if (silent) ++m_nSilent;
+
+	++m_nWindowFrames;
+	const Clock::time_point now = Clock::now();
+	if (now - m_windowStart >= std::chrono::seconds(1))
+	{
+		m_fps = m_nWindowFrames / std::chrono::duration<double>(now - m_windowStart).count();
+		m_nWindowFrames = 0;
+		m_windowStart = now;
+	}
+}
+
+/**
+* CPU time statistic of a stage since the last reset.
+*
+* @param[in]	stage			Stage of the pipeline, ignored for FPS and SilentRatio.
+* @param[in]	stat			Statistic to retrieve.
+* @return		Time in ns per frame, frames per second, or ratio of silent frames.
+*/
+double Profile::Value(Stage stage, Stat stat) const
+{
+	switch (stat)
+	{
+	case STAT_MEAN:
+		return m_nFrames ? (double)m_sum[stage] / m_nFrames * NsPerTick() : 0.0;
+	case STAT_P99:
+		return LogPercentile(m_count[stage], s_nBuckets, 0.99) * NsPerTick();
+	case STAT_FPS:
+		return m_fps;
+	case STAT_SILENT:
+		return m_nFrames ? (double)m_nSilent / m_nFrames : 0.0;
+	default:
+		break;
+	}
+
+	return 0.0;
+}
+
+void Profile::Reset()
+{
+	memset(m_frame, 0, sizeof(m_frame));
+	memset(m_sum, 0, sizeof(m_sum));
+	memset(m_count, 0, sizeof(m_count));
+	m_nFrames = 0;
+	m_nSilent = 0;
+	m_nWindowFrames = 0;
+	m_windowStart = Clock::now();
+	m_fps = 0.0;
+}
+
+bool Parent::IsCapturing() const
+{
+	return m_endpoint && m_endpoint->m_clCapture;
+}
+
+/**
+* Check if the next display deadline is due, so the spectral stages need to run.
+*
+* @param[in]	now				Current time.
+* @return		True if the results would be shown.
+*/
+bool Parent::IsUpdateDue(Clock::time_point now) const
+{
+	// without a rate limit, every capture is shown (or polled by rainmeter)
+	if (m_updatesPerSecond <= 0) return true;
+
+	return m_pacer.IsDue(now);
+}
+
+/**
+* Adaptive update rate: check if the values changed visibly since the last shown
+* update.  Transients return to the full rate instantly, while (nearly) static
+* values halve the rate with every held back update, down to a quarter.
+*
+* @return		True if the update should be shown.
+*/
+bool Parent::IsChangeVisible()
+{
+	static const int s_maxDivider = 4;
+
+	if (!m_adaptiveOut) return true;
+
+	// largest change of the band, wave band, RMS and peak values
+	const int nBands = m_nBands * m_nAnalysis;
+	float change = 0.0f;
+	float* last = m_adaptiveOut;
+	if (m_nBands && m_fftSize)
+	{
+		for (int iBand = 0; iBand < nBands; ++iBand)
+		{
+			change = max(change, fabsf(m_bandOut[iBand] - last[iBand]));
+		}
+	}
+	last += nBands;
+	if (m_nBands && m_waveSize)
+	{
+		for (int iBand = 0; iBand < nBands; ++iBand)
+		{
+			change = max(change, fabsf(m_waveBandOut[iBand] - last[iBand]));
+		}
+	}
+	last += nBands;
+	for (int iChan = 0; iChan < MAX_CHANNELS; ++iChan)
+	{
+		change = max(change, fabsf(sqrtf(m_rms[iChan]) - last[iChan]));
+		change = max(change, fabsf(m_peak[iChan] - last[MAX_CHANNELS + iChan]));
+	}
+
+	if (change >= m_adaptiveThreshold)
+	{
+		m_adaptiveDivider = 1;
+	}
+	else if (++m_adaptiveTicks < m_adaptiveDivider)
+	{
+		return false;
+	}
+	else
+	{
+		m_adaptiveDivider = min(m_adaptiveDivider * 2, s_maxDivider);
+	}
+	m_adaptiveTicks = 0;
+
+	// remember the shown values
+	last = m_adaptiveOut;
+	if (m_nBands && m_fftSize) memcpy(last, m_bandOut, nBands * sizeof(float));
+	last += nBands;
+	if (m_nBands && m_waveSize) memcpy(last, m_waveBandOut, nBands * sizeof(float));
+	last += nBands;
+	for (int iChan = 0; iChan < MAX_CHANNELS; ++iChan)
+	{
+		last[iChan] = sqrtf(m_rms[iChan]);
+		last[MAX_CHANNELS + iChan] = m_peak[iChan];
+	}
+
+	return true;
+}
+
+/**
+* Find the ring buffer and spectra of a channel.
+*
+* @param[in]	channel			Channel requested by a measure.
+* @return		Index of the analysis channel, the first one if the channel is not analyzed.
+*/
+int Parent::AnalysisIndex(Channel channel) const
+{
+	for (int iAna = 0; iAna < m_nAnalysis; ++iAna)
+	{
+		if (m_analysis[iAna] == channel) return iAna;
+	}
+
+	return 0;
+}
+
+/**
+* Compare the settings that determine the computed DSP results of two parents.
+*
+* @param[in]	other			Parent measure to compare with.
+* @return		True if both parents would compute identical results from the same audio.
+*/
+bool Parent::SameDSP(const Parent* other) const
+{
+	const bool envelopes = m_ringBufferSize || m_type == TYPE_RMS || m_type == TYPE_PEAK;
+	const bool otherEnvelopes = other->m_ringBufferSize || other->m_type == TYPE_RMS || other->m_type == TYPE_PEAK;
+
+	// loudness and ballistics meters are not shared, so each one can be reset independently
+	if (m_loudness || other->m_loudness || m_ballistics || other->m_ballistics) return false;
+
+	return envelopes == otherEnvelopes &&
+		(m_truePeak != NULL) == (other->m_truePeak != NULL) &&
+		m_updatesPerSecond == other->m_updatesPerSecond &&
+		m_channel == other->m_channel &&
+		m_nAnalysis == other->m_nAnalysis &&
+		m_decimation == other->m_decimation &&
+		m_gapMode == other->m_gapMode &&
+		m_window == other->m_window &&
+		m_kaiserBeta == other->m_kaiserBeta &&
+		memcmp(m_analysis, other->m_analysis, m_nAnalysis * sizeof(Channel)) == 0 &&
+		memcmp(m_downmix, other->m_downmix, sizeof(m_downmix)) == 0 &&
+		m_fftSize == other->m_fftSize &&
+		m_fftBufferSize == other->m_fftBufferSize &&
+		m_hopSize == other->m_hopSize &&
+		m_waveSize == other->m_waveSize &&
+		m_nBands == other->m_nBands &&
+		m_smoothing == other->m_smoothing &&
+		m_smoothingMode == other->m_smoothingMode &&
+		m_dynamicVolume == other->m_dynamicVolume &&
+		m_adaptiveUpdate == other->m_adaptiveUpdate &&
+		m_adaptiveThreshold == other->m_adaptiveThreshold &&
+		m_freqMin == other->m_freqMin &&
+		m_freqMax == other->m_freqMax &&
+		m_sensitivity == other->m_sensitivity &&
+		memcmp(m_envRMS, other->m_envRMS, sizeof(m_envRMS)) == 0 &&
+		memcmp(m_envPeak, other->m_envPeak, sizeof(m_envPeak)) == 0 &&
+		memcmp(m_envFFT, other->m_envFFT, sizeof(m_envFFT)) == 0 &&
+		m_envelopeMode == other->m_envelopeMode;
+}
+
+/**
+* Subscribe a parent measure to the capture stream of its device, creating the
+* stream if no other parent is monitoring the same endpoint yet.
+*
+* @param[in]	parent			Parent measure with a valid device.
+* @return		Shared endpoint, or NULL if the stream could not be initialized.
+*/
+Endpoint* Endpoint::Acquire(Parent* parent)
+{
+	const bool polled = parent->m_updatesPerSecond == -2;
+
+	LPWSTR id = NULL;
+	if (parent->m_dev->GetId(&id) != S_OK)
+	{
+		return NULL;
+	}
+
+	Endpoint* ep = NULL;
+	std::vector<Endpoint*>::const_iterator iter = s_endpoints.begin();
+	for (; iter != s_endpoints.end(); ++iter)
+	{
+		if ((*iter)->m_port == parent->m_port && (*iter)->m_polled == polled && _wcsicmp((*iter)->m_id, id) == 0)
+		{
+			// a stream whose device failed stays with its parents until they are released,
+			// new parents get a fresh stream
+			std::lock_guard<std::mutex> lock((*iter)->m_lock);
+			if ((*iter)->m_clCapture)
+			{
+				ep = (*iter);
+				break;
+			}
+		}
+	}
+
+	if (!ep)
+	{
+		ep = new Endpoint;
+		ep->m_port = parent->m_port;
+		ep->m_polled = polled;
+		ep->m_dev = parent->m_dev;
+		ep->m_dev->AddRef();
+		_snwprintf_s(ep->m_id, _TRUNCATE, L"%s", id);
+
+		if (ep->DeviceInit() != S_OK)
+		{
+			delete ep;
+			CoTaskMemFree(id);
+			return NULL;
+		}
+
+		s_endpoints.push_back(ep);
+
+		if (!ep->m_polled)
+		{
+			// create separate thread with event-driven capture loop
+			ep->m_captureThread = new std::thread(&Endpoint::DoCaptureLoop, ep);
+			ep->m_captureThread->detach();
+		}
+	}
+
+	CoTaskMemFree(id);
+
+	std::lock_guard<std::mutex> lock(ep->m_lock);
+	++ep->m_refCount;
+	ep->m_parents.push_back(parent);
+	parent->m_endpoint = ep;
+	parent->m_wfx = ep->m_wfx;
+	ep->ShareResults();
+
+	return ep;
+}
+
+/**
+* Unsubscribe a parent measure from its endpoint.  The last parent stops the
+* capture stream.
+*
+* @param[in]	parent			Parent measure.
+*/
+void Endpoint::Release(Parent* parent)
+{
+	Endpoint* ep = parent->m_endpoint;
+	if (!ep) return;
+
+	bool last;
+	{
+		std::lock_guard<std::mutex> lock(ep->m_lock);
+		ep->m_parents.erase(std::find(ep->m_parents.begin(), ep->m_parents.end(), parent));
+		ep->ShareResults();
+		last = --ep->m_refCount == 0;
+
+		parent->m_endpoint = NULL;
+		parent->m_dspSource = NULL;
+		parent->m_wfx = NULL;
+	}
+
+	if (last)
+	{
+		s_endpoints.erase(std::find(s_endpoints.begin(), s_endpoints.end(), ep));
+
+		if (ep->m_captureThread)
+		{
+			// the capture thread releases the device and the endpoint when it exits
+			SetEvent(ep->m_hStopEvent);
+		}
+		else
+		{
+			ep->DeviceRelease();
+			delete ep;
+		}
+	}
+}
+
+/**
+* Let parents with identical DSP settings use the results of the first such parent,
+* so the pipeline runs only once for them.  Must be called with the lock held.
+*/
+void Endpoint::ShareResults()
+{
+	for (size_t i = 0; i < m_parents.size(); ++i)
+	{
+		Parent* parent = m_parents[i];
+		parent->m_dspSource = NULL;
+
+		for (size_t j = 0; j < i; ++j)
+		{
+			if (!m_parents[j]->m_dspSource && parent->SameDSP(m_parents[j]))
+			{
+				parent->m_dspSource = m_parents[j];
+				break;
+			}
+		}
+	}
+}
+
+/**
+* Create a waitable timer for pacing, with high resolution if available.
+*
+* @return		Timer handle, or NULL on failure.
+*/
+HANDLE CreatePacerTimer()
+{
+	// high resolution timers need Windows 10 1803, fall back to a regular one
+	HANDLE hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!hTimer) hTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+	return hTimer;
+}
+
+/**
+* Arm a waitable timer for a point in time.
+*
+* @param[in]	hTimer			Waitable timer.
+* @param[in]	due				Time to signal the timer.
+* @param[in]	now				Current time.
+*/
+void SetPacerTimer(HANDLE hTimer, Clock::time_point due, Clock::time_point now)
+{
+	// relative due time in 100ns units
+	LARGE_INTEGER dueTime;
+	dueTime.QuadPart = -max(1LL, (LONGLONG)(std::chrono::duration_cast<std::chrono::nanoseconds>(due - now).count() / 100));
+	SetWaitableTimer(hTimer, &dueTime, 0, NULL, NULL, FALSE);
+}
+
+/**
+* Arm the waitable timer for the earliest deadline of the paced parents.  Idle
+* streams and silent parents are not woken up.  Must be called with the lock held.
+*
+* @param[in]	hTimer			Waitable timer of the capture thread.
+* @param[in]	now				Current time.
+*/
+void Endpoint::ArmTimer(HANDLE hTimer, Clock::time_point now)
+{
+	if (now - m_lastCapture >= s_idleTimeout) return;
+
+	bool found = false;
+	Clock::time_point next;
+
+	std::vector<Parent*>::const_iterator iter = m_parents.begin();
+	for (; iter != m_parents.end(); ++iter)
+	{
+		const Parent* parent = (*iter);
+		if (!parent->m_dspSource && parent->m_updatesPerSecond > 0 && !parent->m_silent &&
+			(!found || parent->m_pacer.m_next < next))
+		{
+			next = parent->m_pacer.m_next;
+			found = true;
+		}
+	}
+
+	if (found)
+	{
+		SetPacerTimer(hTimer, next, now);
+	}
+}
+
+void Endpoint::DoCaptureLoop()
+{
+	// register thread with MMCSS
+	DWORD nTaskIndex = 0;
+	m_hTask = AvSetMmThreadCharacteristics(L"Pro Audio", &nTaskIndex);
+	if (!(m_hTask && AvSetMmThreadPriority(m_hTask, AVRT_PRIORITY_CRITICAL)))
+	{
+		RmLog(NULL, LOG_WARNING, L"Failed to start multimedia task.");
+	}
+
+	// waitable timer to meet update deadlines between sparse buffer events
+	HANDLE hTimer = CreatePacerTimer();
+
+	HANDLE waitArray[3] = { m_hReadyEvent, m_hStopEvent, hTimer };
+
+	bool stopped = false;
+	while (1)
+	{
+		DWORD wait = WaitForMultipleObjects(hTimer ? 3 : 2, waitArray, FALSE, INFINITE);
+		if (wait != WAIT_OBJECT_0 && wait != WAIT_OBJECT_0 + 2)
+		{
+			stopped = wait == WAIT_OBJECT_0 + 1;
+			break;
+		}
+
+		HRESULT hr;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_dispatch.clear();
+
+			// drain the capture client once for all parents
+			hr = Capture();
+
+			const Clock::time_point now = Clock::now();
+			const bool captured = hr == S_OK;
+			if (captured)
+			{
+				m_lastCapture = now;
+			}
+
+			// without new data only paced parents are updated, as long as the stream is active
+			if (captured || (SUCCEEDED(hr) && now - m_lastCapture < s_idleTimeout))
+			{
+				std::vector<Parent*>::const_iterator iter = m_parents.begin();
+				for (; iter != m_parents.end(); ++iter)
+				{
+					Parent* parent = (*iter);
+					if (!captured && parent->m_updatesPerSecond <= 0) continue;
+
+					// keep draining audio into the ring on every event, but run the spectral
+					// stages only when the next display deadline is due
+					if (!parent->m_dspSource)
+					{
+						if (!parent->IsUpdateDue(now))
+						{
+							parent->m_hrUpdate = S_FALSE;
+							if (captured) ++parent->m_nSkippedFrames;
+							continue;
+						}
+
+						parent->m_hrUpdate = parent->UpdateParent();
+						if (parent->m_hrUpdate == S_OK)
+						{
+							s_latency.Record(Latency::STAGE_FFT, m_audioTime);
+						}
+
+						if (parent->m_hrUpdate == S_OK && parent->m_adaptiveUpdate && parent->m_updatesPerSecond > 0 &&
+							!parent->IsChangeVisible())
+						{
+							// (nearly) static values, hold back this update
+							parent->m_pacer.Fire(now);
+							parent->m_hrUpdate = S_FALSE;
+						}
+					}
+
+					if (parent->DSP()->m_hrUpdate != S_OK)
+					{
+						// silence detected or not due, no need to update
+						continue;
+					}
+
+					// everything is fine, update measures
+					bool update = false;
+
+					if (parent->m_updatesPerSecond > 0)
+					{
+						parent->m_pacer.Fire(now);
+						update = true;
+					}
+					// update as fast as possible
+					else if (parent->m_updatesPerSecond < 0 && parent->m_updatesPerSecond >= -1)
+					{
+						update = true;
+					}
+
+					if (update)
+					{
+						s_latency.Record(Latency::STAGE_PUBLISH, m_audioTime);
+					}
+
+					if (update && parent->m_dispatcher)
+					{
+						// paced parents are batched with the other skins on the display tick
+						parent->m_dispatcher->Post(parent, m_audioTime);
+					}
+					else if (update)
+					{
+						// copy the command, the parent may be finalized before it is executed
+						m_dispatch.push_back(Dispatch());
+						m_dispatch.back().skin = parent->m_skin;
+						m_dispatch.back().audioTime = m_audioTime;
+						_snwprintf_s(m_dispatch.back().msg, _TRUNCATE, L"%s", parent->m_msgUpdate);
+					}
+				}
+			}
+
+			// wake up for the next deadline in case it passes before the next buffer event
+			if (hTimer && SUCCEEDED(hr))
+			{
+				ArmTimer(hTimer, now);
+			}
+		}
+
+		// execute outside of the lock, so rainmeter can finalize measures in the meantime
+		std::vector<Dispatch>::const_iterator iter = m_dispatch.begin();
+		for (; iter != m_dispatch.end(); ++iter)
+		{
+			RmExecute(iter->skin, iter->msg);
+			s_latency.Record(Latency::STAGE_DISPATCH, iter->audioTime);
+		}
+
+		s_latency.Log();
+
+		if (hr == AUDCLNT_E_BUFFER_ERROR ||
+			hr == AUDCLNT_E_DEVICE_INVALIDATED ||
+			hr == AUDCLNT_E_SERVICE_NOT_RUNNING)
+		{
+			// error detected, release device
+			std::lock_guard<std::mutex> lock(m_lock);
+			DeviceRelease();
+			break;
+		}
+	}
+
+	// after an error, wait until the last parent released the endpoint
+	if (!stopped)
+	{
+		WaitForSingleObject(m_hStopEvent, INFINITE);
+	}
+
+	if (m_hTask) AvRevertMmThreadCharacteristics(m_hTask);
+	if (hTimer) CloseHandle(hTimer);
+
+	DeviceRelease();
+	delete m_captureThread;
+	delete this;
+}
+
+/**
+* Register a paced parent with the dispatcher, starting the dispatcher if needed.
+* Also updates the tick rate of an already registered parent.
+*
+* @param[in]	parent			Parent measure with UpdatesPerSecond > 0.
+*/
+void Dispatcher::Register(Parent* parent)
+{
+	Dispatcher* d = s_dispatcher;
+	const bool start = !d;
+	if (start)
+	{
+		d = s_dispatcher = new Dispatcher;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(d->m_lock);
+
+		if (std::find(d->m_parents.begin(), d->m_parents.end(), parent) == d->m_parents.end())
+		{
+			d->m_parents.push_back(parent);
+		}
+		parent->m_dispatcher = d;
+		d->UpdatePeriod();
+	}
+
+	if (start)
+	{
+		std::thread thread(&Dispatcher::DoDispatchLoop, d);
+		thread.detach();
+	}
+}
+
+/**
+* Unregister a parent from the dispatcher.  The last parent stops the dispatcher.
+*
+* @param[in]	parent			Parent measure.
+*/
+void Dispatcher::Unregister(Parent* parent)
+{
+	Dispatcher* d = parent->m_dispatcher;
+	if (!d) return;
+
+	bool last;
+	{
+		std::lock_guard<std::mutex> lock(d->m_lock);
+		d->m_parents.erase(std::find(d->m_parents.begin(), d->m_parents.end(), parent));
+		parent->m_dispatcher = NULL;
+		last = d->m_parents.empty();
+		if (!last) d->UpdatePeriod();
+
+		// drop the pending commands of the parent, the skin may be closing
+		for (size_t i = 0; i < d->m_nPending; ++i)
+		{
+			if (d->m_pending[i].parent == parent)
+			{
+				// keep the order of the other parents
+				std::rotate(d->m_pending.begin() + i, d->m_pending.begin() + i + 1, d->m_pending.begin() + d->m_nPending);
+				--d->m_nPending;
+				break;
+			}
+		}
+	}
+
+	if (last)
+	{
+		// the dispatch thread deletes the dispatcher when it exits
+		s_dispatcher = NULL;
+		SetEvent(d->m_hStopEvent);
+	}
+}
+
+/**
+* Tick with the fastest rate of the registered parents.  Must be called with the lock held.
+*/
+void Dispatcher::UpdatePeriod()
+{
+	m_period = m_parents.front()->m_pacer.m_period;
+	std::vector<Parent*>::const_iterator iter = m_parents.begin();
+	for (; iter != m_parents.end(); ++iter)
+	{
+		m_period = min(m_period, (*iter)->m_pacer.m_period);
+	}
+}
+
+/**
+* Queue the update commands of a parent for the next tick.  A parent posting again
+* before the tick replaces its commands.
+*
+* @param[in]	parent			Registered parent.
+* @param[in]	audioTime		Capture time of the newest audio shown by the update.
+*/
+void Dispatcher::Post(const Parent* parent, INT64 audioTime)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	Pending* p = NULL;
+	for (size_t i = 0; i < m_nPending; ++i)
+	{
+		if (m_pending[i].parent == parent)
+		{
+			p = &m_pending[i];
+			break;
+		}
+	}
+
+	if (!p)
+	{
+		if (m_nPending == m_pending.size())
+		{
+			m_pending.push_back(Pending());
+		}
+		p = &m_pending[m_nPending++];
+		p->parent = parent;
+	}
+
+	// copy the commands, the parent may be reloaded before the tick
+	p->skin = parent->m_skin;
+	p->audioTime = audioTime;
+	_snwprintf_s(p->msg, _TRUNCATE, L"%s", parent->m_msgUpdate);
+}
+
+/**
+* Execute the pending commands, one bang per skin.
+*/
+void Dispatcher::DoFlush()
+{
+	size_t nFlush = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		// merge the commands of the parents of each skin, in the order the skins posted
+		for (size_t i = 0; i < m_nPending; ++i)
+		{
+			const Pending& p = m_pending[i];
+
+			Flush* f = NULL;
+			for (size_t j = 0; j < nFlush; ++j)
+			{
+				if (m_flush[j].skin == p.skin)
+				{
+					f = &m_flush[j];
+					break;
+				}
+			}
+
+			if (!f)
+			{
+				if (nFlush == m_flush.size())
+				{
+					m_flush.push_back(Flush());
+				}
+				f = &m_flush[nFlush++];
+				f->skin = p.skin;
+				f->audioTime = p.audioTime;
+				f->bang.clear();
+				f->meters.clear();
+			}
+			f->audioTime = max(f->audioTime, p.audioTime);
+
+			// append the bangs that are not merged yet, meter updates after the measure updates
+			const WCHAR* b = p.msg;
+			while (*b == '[')
+			{
+				const WCHAR* e = wcschr(b, ']');
+				if (!e) break;
+
+				const size_t len = e - b + 1;
+				if (len == 9 && _wcsnicmp(b, L"[!Redraw]", 9) == 0)
+				{
+					// one redraw is added after the meter updates
+				}
+				else if (_wcsnicmp(b, L"[!UpdateMeter", 13) == 0)
+				{
+					if (f->meters.find(b, 0, len) == std::wstring::npos) f->meters.append(b, len);
+				}
+				else
+				{
+					if (f->bang.find(b, 0, len) == std::wstring::npos) f->bang.append(b, len);
+				}
+
+				b = e + 1;
+			}
+		}
+
+		for (size_t i = 0; i < nFlush; ++i)
+		{
+			Flush& f = m_flush[i];
+			if (!f.meters.empty())
+			{
+				f.bang += f.meters;
+				f.bang += L"[!Redraw]";
+			}
+		}
+
+		m_nPending = 0;
+	}
+
+	// execute outside of the lock, so the capture threads can post in the meantime
+	for (size_t i = 0; i < nFlush; ++i)
+	{
+		RmExecute(m_flush[i].skin, m_flush[i].bang.c_str());
+		s_latency.Record(Latency::STAGE_DISPATCH, m_flush[i].audioTime);
+	}
+
+	m_nBangs += nFlush;
+	m_nWindowBangs += nFlush;
+
+	const Clock::time_point now = Clock::now();
+	if (now - m_windowStart >= std::chrono::seconds(1))
+	{
+		m_bangRate = m_nWindowBangs / std::chrono::duration<double>(now - m_windowStart).count();
+		m_nWindowBangs = 0;
+		m_windowStart = now;
+	}
+}
+
+void Dispatcher::DoDispatchLoop()
+{
+	HANDLE hTimer = CreatePacerTimer();
+	HANDLE waitArray[2] = { m_hStopEvent, hTimer };
+
+	while (hTimer)
+	{
+		// next tick on the common phase of the pacers
+		Clock::time_point now = Clock::now();
+		Clock::time_point next;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			next = s_epoch + ((now - s_epoch) / m_period + 1) * m_period + s_dispatchSettle;
+		}
+		SetPacerTimer(hTimer, next, now);
+
+		if (WaitForMultipleObjects(ARRAYSIZE(waitArray), waitArray, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+			break;
+
+		DoFlush();
+	}
+
+	if (hTimer) CloseHandle(hTimer);
+	delete this;
+}
+
+/**
+* Create and initialize a measure instance.  Creates WASAPI loopback
+* device if not a child measure.
+*
+* @param[out]	data			Pointer address in which to return measure instance.
+* @param[in]	rm				Rainmeter context.
+*/
+PLUGIN_EXPORT void Initialize(void** data, void* rm)
+{
+	void* skin = RmGetSkin(rm);
+
+	// parse parent specifier, if appropriate
+	LPCWSTR parentName = RmReadString(rm, L"Parent", L"");
+	if (*parentName)
+	{
+		// match parent using measure name and skin handle
+		std::vector<Parent*>::const_iterator iter = s_parents.begin();
+		for (; iter != s_parents.end(); ++iter)
+		{
+			if (_wcsicmp((*iter)->m_rmName, parentName) == 0 &&
+				(*iter)->m_skin == skin &&
+				!(*iter)->m_parent)
+			{
+				// child measures only carry their own options
+				Measure* child = new Measure;
+				child->m_skin = skin;
+				child->m_rm = rm;
+				child->m_rmName = RmGetMeasureName(rm);
+				child->m_parent = (*iter);
+				*data = child;
+
+				return;
+			}
+		}
+
+		RmLogF(rm, LOG_ERROR, L"Couldn't find Parent measure '%s'.", parentName);
+	}
+
+	// this is a parent measure - add it to the global list
+	Parent* m = new Parent;
+	m->m_skin = skin;
+	m->m_rm = rm;
+	m->m_rmName = RmGetMeasureName(rm);
+	*data = static_cast<Measure*>(m);
+	s_parents.push_back(m);
+
+#if (TRACK_ALLOCATIONS)
+	if (s_parents.size() == 1) AllocGuard::Install();
+#endif
+
+#if (PROFILE_STAGES)
+	m->m_profile = new Profile;
+#endif
+
+	// parse port specifier
+	LPCWSTR port = RmReadString(rm, L"Port", L"");
+	if (port && *port)
+	{
+		if (_wcsicmp(port, L"Output") == 0)
+		{
+			m->m_port = Measure::PORT_OUTPUT;
+		}
+		else if (_wcsicmp(port, L"Input") == 0)
+		{
+			m->m_port = Measure::PORT_INPUT;
+		}
+		else
+		{
+			RmLogF(rm, LOG_ERROR, L"Invalid Port '%s', must be one of: Output or Input.", port);
+		}
+	}
+
+	// the update mode decides if the shared capture stream needs its own thread
+	m->m_updatesPerSecond = min(240, RmReadDouble(rm, L"UpdatesPerSecond", -1));
+
+	// parse requested device ID (optional)
+	LPCWSTR reqID = RmReadString(rm, L"ID", L"");
+	if (reqID)
+	{
+		_snwprintf_s(m->m_reqID, _TRUNCATE, L"%s", reqID);
+	}
+
+	// create the enumerator
+	EXIT_ON_ERROR(CoCreateInstance(CLSID_MMDeviceEnumerator, NULL, CLSCTX_ALL, IID_IMMDeviceEnumerator, (void**)& m->m_enum));
+
+	// if a specific ID was requested, search for that one, otherwise get the default
+	if (*m->m_reqID)
+	{
+		HRESULT hr = m->m_enum->GetDevice(m->m_reqID, &m->m_dev);
+		if (hr != S_OK)
+		{
+			WCHAR msg[256];
+			_snwprintf_s(msg, _TRUNCATE, L"Audio %s device '%s' not found (error 0x%08x).",
+				m->m_port == Measure::PORT_OUTPUT ? L"output" : L"input", m->m_reqID, hr);
+
+			RmLog(rm, LOG_WARNING, msg);
+		}
+	}
+	else
+	{
+		EXIT_ON_ERROR(m->m_enum->GetDefaultAudioEndpoint(m->m_port == Measure::PORT_OUTPUT ? eRender : eCapture, eConsole, &m->m_dev));
+	}
+
+	// subscribe to the capture stream of the device (if it fails, log debug message and quit)
+	if (m->m_dev && Endpoint::Acquire(m))
+	{
+		return;
+	}
+
+Exit:
+
+	SAFE_RELEASE(m->m_enum);
+}
+
+
+/**
+* Destroy the measure instance.
+*
+* @param[in]	data			Measure instance pointer.
+*/
+PLUGIN_EXPORT void Finalize(void* data)
+{
+	Measure* m = (Measure*)data;
+
+	if (m->m_parent)
+	{
+		// release the meter of the child, unless the parent was finalized first
+		if (std::find(s_parents.begin(), s_parents.end(), m->m_parent) != s_parents.end())
+		{
+			m->m_parent->UseMeter(m, 0);
+		}
+
+		delete m;
+		return;
+	}
+
+	Parent* parent = static_cast<Parent*>(m);
+	Endpoint::Release(parent);
+	Dispatcher::Unregister(parent);
+
+	parent->BuffersRelease();
+	delete parent->m_profile;
+	SAFE_RELEASE(parent->m_dev);
+	SAFE_RELEASE(parent->m_enum);
+
+	std::vector<Parent*>::iterator iter = std::find(s_parents.begin(), s_parents.end(), parent);
+	s_parents.erase(iter);
+
+#if (TRACK_ALLOCATIONS)
+	if (s_parents.empty()) AllocGuard::Uninstall();
+#endif
+
+	delete parent;
+}
+
+
+/**
+* (Re-)parse parameters from .ini file.
+*
+* @param[in]	data			Measure instance pointer.
+* @param[in]	rm				Rainmeter context.
+* @param[out]	maxValue		?
+*/
+PLUGIN_EXPORT void Reload(void* data, void* rm, double* maxValue)
+{
+	static const LPCWSTR s_typeName[Measure::NUM_TYPES] =
+	{
+		L"RMS",								// TYPE_RMS
+		L"Peak",							// TYPE_PEAK
+		L"FFT",								// TYPE_FFT
+		L"Wave",							// TYPE_WAVE
+		L"Band",							// TYPE_BAND
+		L"WaveBand",						// TYPE_WAVEBAND
+		L"FFTFreq",							// TYPE_FFTFREQ
+		L"BandFreq",						// TYPE_BANDFREQ
+		L"Format",							// TYPE_FORMAT
+		L"DeviceStatus",					// TYPE_DEV_STATUS
+		L"DeviceName",						// TYPE_DEV_NAME
+		L"DeviceID",						// TYPE_DEV_ID
+		L"DeviceList",						// TYPE_DEV_LIST
+		L"BufferStatus",					// TYPE_BUFFERSTATUS
+		L"SkippedFrames",					// TYPE_SKIPPEDFRAMES
+		L"UpdateRate",						// TYPE_UPDATERATE
+		L"UpdateJitter",					// TYPE_UPDATEJITTER
+		L"DispatchRate",					// TYPE_DISPATCHRATE
+		L"Loudness",						// TYPE_LOUDNESS
+		L"TruePeak",						// TYPE_TRUEPEAK
+		L"VU",								// TYPE_VU
+		L"PPM",								// TYPE_PPM
+		L"PeakHold",						// TYPE_PEAKHOLD
+		L"Clip",							// TYPE_CLIP
+		L"Glitches",						// TYPE_GLITCHES
+		L"DroppedFrames",					// TYPE_DROPPEDFRAMES
+		L"Latency",							// TYPE_LATENCY
+		L"Stats",							// TYPE_STATS
+	};
+
+	static const LPCWSTR s_loudnessName[Measure::NUM_LOUDNESS_MODES] =
+	{
+		L"Momentary",						// LOUDNESS_MOMENTARY
+		L"ShortTerm",						// LOUDNESS_SHORTTERM
+		L"Integrated",						// LOUDNESS_INTEGRATED
+		L"Range",							// LOUDNESS_RANGE
+	};
+
+	static const LPCWSTR s_chanName[Measure::MAX_CHANNELS][3] =
+	{
+		{ L"L",		L"FL",		L"0", },	// CHANNEL_FL
+		{ L"R",		L"FR",		L"1", },	// CHANNEL_FR
+		{ L"C",		L"",		L"2", },	// CHANNEL_C
+		{ L"LFE",	L"Sub",		L"3", },	// CHANNEL_LFE
+		{ L"BL",	L"",		L"4", },	// CHANNEL_BL
+		{ L"BR",	L"",		L"5", },	// CHANNEL_BR
+		{ L"SL",	L"",		L"6", },	// CHANNEL_SL
+		{ L"SR",	L"",		L"7", },	// CHANNEL_SR
+		{ L"Sum",	L"Avg",		L"", },		// CHANNEL_SUM
+	};
+
+	Measure* m = (Measure*)data;
+
+	// parse data type
+	LPCWSTR type = RmReadString(rm, L"Type", L"");
+	if (*type)
+	{
+		int iType;
+		for (iType = 0; iType < Measure::NUM_TYPES; ++iType)
+		{
+			if (_wcsicmp(type, s_typeName[iType]) == 0)
+			{
+				m->m_type = (Measure::Type)iType;
+				break;
+			}
+		}
+
+		if (iType >= Measure::NUM_TYPES)
+		{
+			WCHAR msg[512];
+			WCHAR* d = msg;
+			d += _snwprintf_s(d, _countof(msg) - (d - msg), _TRUNCATE,
+				L"Invalid Type '%s', must be one of:", type);
+
+			for (int i = 0; i < Measure::NUM_TYPES; ++i)
+			{
+				d += _snwprintf_s(d, _countof(msg) - (d - msg), _TRUNCATE,
+					L"%s%s%s", i ? L", " : L" ", i == (Measure::NUM_TYPES - 1) ? L"or " : L"", s_typeName[i]);
+			}
+
+			d += _snwprintf_s(d, _countof(msg) - (d - msg), _TRUNCATE, L".");
+			RmLogF(rm, LOG_ERROR, msg);
+		}
+	}
+
+	// parse channel specifier
+	LPCWSTR channel = RmReadString(rm, L"Channel", L"");
+	if (*channel)
+	{
+		bool found = false;
+		for (int iChan = 0; iChan <= Measure::CHANNEL_SUM && !found; ++iChan)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				if (_wcsicmp(channel, s_chanName[iChan][j]) == 0)
+				{
+					m->m_channel = (Measure::Channel)iChan;
+					found = true;
+					break;
+				}
+			}
+		}
+
+		if (!found)
+		{
+			WCHAR msg[512];
+			WCHAR* d = msg;
+			d += _snwprintf_s(d, _countof(msg) - (d - msg), _TRUNCATE,
+				L"Invalid Channel '%s', must be an integer between 0 and %d, or one of:", channel, Measure::MAX_CHANNELS - 2);
+
+			for (int i = 0; i <= Measure::CHANNEL_SUM; ++i)
+			{
+				d += _snwprintf_s(d, _countof(msg) - (d - msg), _TRUNCATE,
+					L"%s%s%s", i ? L", " : L" ", i == Measure::CHANNEL_SUM ? L"or " : L"", s_chanName[i][0]);
+			}
+
+			d += _snwprintf_s(d, _countof(msg) - (d - msg), _TRUNCATE, L".");
+			RmLogF(rm, LOG_ERROR, msg);
+		}
+	}
+
+	// parse envelope, fft and band values on parents only
+	if (!m->m_parent)
+	{
+		Parent* parent = static_cast<Parent*>(m);
+
+		// polled capture (UpdatesPerSecond=-2) and threaded capture use separate streams,
+		// so a change between them moves the parent to the stream of the new mode
+		bool formatChanged = false;
+		const double updatesPerSecond = min(240, RmReadDouble(rm, L"UpdatesPerSecond", -1));
+		if (parent->m_endpoint && parent->m_endpoint->m_polled != (updatesPerSecond == -2))
+		{
+			const DWORD sampleRate = parent->m_wfx->nSamplesPerSec;
+			const WORD nChannels = parent->m_wfx->nChannels;
+
+			Endpoint::Release(parent);
+			parent->m_updatesPerSecond = updatesPerSecond;
+			if (!Endpoint::Acquire(parent))
+			{
+				RmLog(rm, LOG_WARNING, L"Failed to reopen the capture stream for the new UpdatesPerSecond.");
+			}
+			formatChanged = !parent->m_wfx || parent->m_wfx->nSamplesPerSec != sampleRate || parent->m_wfx->nChannels != nChannels;
+		}
+
+		// keep the capture thread out of the pipeline while it is reconfigured
+		std::unique_lock<std::mutex> lock;
+		if (parent->m_endpoint)
+		{
+			lock = std::unique_lock<std::mutex>(parent->m_endpoint->m_lock);
+		}
+
+		int fftSize = RmReadInt(rm, L"FFTSize", parent->m_fftSize);
+		int fftBufferSize = RmReadInt(rm, L"FFTBufferSize", parent->m_fftBufferSize);
+		int nBands = RmReadInt(rm, L"Bands", parent->m_nBands);
+		int smoothing = max(0, RmReadInt(rm, L"Smoothing", parent->m_smoothing));
+		double freqMin = max(0.0, RmReadDouble(rm, L"FreqMin", parent->m_freqMin));
+		double freqMax = max(0.0, RmReadDouble(rm, L"FreqMax", parent->m_freqMax));
+		int waveSize = RmReadInt(rm, L"WAVESize", parent->m_waveSize);
+
+		// parse the analysis channels, each gets its own ring buffer and spectra
+		Measure::Channel analysis[Measure::MAX_CHANNELS];
+		int nAnalysis = 0;
+		LPCWSTR channels = RmReadString(rm, L"Channels", L"");
+		if (_wcsicmp(channels, L"All") == 0)
+		{
+			const int nChannels = parent->m_wfx ? min((int)parent->m_wfx->nChannels, (int)Measure::CHANNEL_SUM) : 2;
+			for (int iChan = 0; iChan < nChannels; ++iChan)
+			{
+				analysis[nAnalysis++] = (Measure::Channel)iChan;
+			}
+		}
+		else if (*channels)
+		{
+			WCHAR list[256];
+			WCHAR* context = NULL;
+			_snwprintf_s(list, _TRUNCATE, L"%s", channels);
+			for (WCHAR* token = wcstok_s(list, L" ,|", &context); token && nAnalysis < Measure::MAX_CHANNELS; token = wcstok_s(NULL, L" ,|", &context))
+			{
+				int iChan;
+				for (iChan = 0; iChan <= Measure::CHANNEL_SUM; ++iChan)
+				{
+					if (_wcsicmp(token, s_chanName[iChan][0]) == 0 || _wcsicmp(token, s_chanName[iChan][1]) == 0 || _wcsicmp(token, s_chanName[iChan][2]) == 0)
+					{
+						break;
+					}
+				}
+
+				if (iChan > Measure::CHANNEL_SUM)
+				{
+					RmLogF(rm, LOG_ERROR, L"Invalid channel '%s' in Channels.", token);
+				}
+				else if (std::find(analysis, analysis + nAnalysis, (Measure::Channel)iChan) == analysis + nAnalysis)
+				{
+					analysis[nAnalysis++] = (Measure::Channel)iChan;
+				}
+			}
+		}
+		if (!nAnalysis)
+		{
+			// single analysis channel selected with the Channel option
+			analysis[0] = parent->m_channel;
+			nAnalysis = 1;
+		}
+
+		// analysis channels select a device channel, Sum is the average of L and R (or L on mono devices)
+		float downmix[Measure::CHANNEL_SUM][DOWNMIX_LANES] = { 0 };
+		for (int iAna = 0; iAna < nAnalysis; ++iAna)
+		{
+			if (analysis[iAna] != Measure::CHANNEL_SUM)
+			{
+				downmix[analysis[iAna]][iAna] = 1.0f;
+			}
+			else if (parent->m_wfx && parent->m_wfx->nChannels < 2)
+			{
+				downmix[Measure::CHANNEL_FL][iAna] = 1.0f;
+			}
+			else
+			{
+				downmix[Measure::CHANNEL_FL][iAna] = 0.5f;
+				downmix[Measure::CHANNEL_FR][iAna] = 0.5f;
+			}
+		}
+
+		// parse the downmix matrix, its rows replace the analysis channels
+		LPCWSTR downmixName = RmReadString(rm, L"Downmix", L"");
+		if (*downmixName)
+		{
+			static const float s_itu = 0.7071f;
+			int nRows = 0;
+			bool invalidRow = false;
+			float rows[Measure::MAX_CHANNELS][Measure::CHANNEL_SUM] = { 0 };
+
+			if (_wcsicmp(downmixName, L"Mid") == 0)
+			{
+				// (L + R) / 2
+				rows[0][Measure::CHANNEL_FL] = 0.5f;
+				rows[0][Measure::CHANNEL_FR] = 0.5f;
+				nRows = 1;
+			}
+			else if (_wcsicmp(downmixName, L"Side") == 0)
+			{
+				// (L - R) / 2
+				rows[0][Measure::CHANNEL_FL] = 0.5f;
+				rows[0][Measure::CHANNEL_FR] = -0.5f;
+				nRows = 1;
+			}
+			else if (_wcsicmp(downmixName, L"LFE") == 0)
+			{
+				rows[0][Measure::CHANNEL_LFE] = 1.0f;
+				nRows = 1;
+			}
+			else if (_wcsicmp(downmixName, L"ITU") == 0)
+			{
+				// ITU-R BS.775 5.1/7.1 to 2.0: Lo = L + 0.707 C + 0.707 Ls, Ro = R + 0.707 C + 0.707 Rs, without LFE
+				rows[0][Measure::CHANNEL_FL] = 1.0f;
+				rows[0][Measure::CHANNEL_C] = s_itu;
+				rows[0][Measure::CHANNEL_BL] = s_itu;
+				rows[0][Measure::CHANNEL_SL] = s_itu;
+				rows[1][Measure::CHANNEL_FR] = 1.0f;
+				rows[1][Measure::CHANNEL_C] = s_itu;
+				rows[1][Measure::CHANNEL_BR] = s_itu;
+				rows[1][Measure::CHANNEL_SR] = s_itu;
+				nRows = 2;
+			}
+			else
+			{
+				// custom matrix: one row of device channel weights per analysis channel, rows separated by ';'
+				WCHAR matrix[512];
+				WCHAR* context = NULL;
+				_snwprintf_s(matrix, _TRUNCATE, L"%s", downmixName);
+				for (WCHAR* row = wcstok_s(matrix, L";", &context); row && nRows < Measure::MAX_CHANNELS; row = wcstok_s(NULL, L";", &context))
+				{
+					int nWeights = 0;
+					WCHAR* end = row;
+					while (true)
+					{
+						while (*end == L' ' || *end == L',') ++end;
+						if (!*end) break;
+
+						WCHAR* next = end;
+						const float weight = (float)wcstod(end, &next);
+						if (next == end || nWeights == Measure::CHANNEL_SUM)
+						{
+							nWeights = 0;
+							break;
+						}
+						rows[nRows][nWeights++] = weight;
+						end = next;
+					}
+
+					// a row without valid weights would mute its output, reject the whole matrix
+					if (!nWeights)
+					{
+						if (wcschr(downmixName, L';'))
+						{
+							RmLogF(rm, LOG_ERROR, L"Invalid Downmix row '%s', the analysis channels are kept.", row);
+							invalidRow = true;
+						}
+						nRows = 0;
+						break;
+					}
+					++nRows;
+				}
+			}
+
+			if (nRows)
+			{
+				// the outputs are selected by number, so Channel=L (0) and Channel=R (1) select Lo and Ro of ITU
+				memset(downmix, 0, sizeof(downmix));
+				for (int iRow = 0; iRow < nRows; ++iRow)
+				{
+					analysis[iRow] = (Measure::Channel)iRow;
+					for (int iChan = 0; iChan < Measure::CHANNEL_SUM; ++iChan)
+					{
+						downmix[iChan][iRow] = rows[iRow][iChan];
+					}
+				}
+				nAnalysis = nRows;
+			}
+			else if (!invalidRow)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid Downmix '%s', must be one of: ITU, Mid, Side, LFE, or a matrix.", downmixName);
+			}
+		}
+
+		// decimate ahead of the ring buffers, as far as FreqMax allows
+		const int decimation = max(0, RmReadInt(rm, L"Decimation", parent->m_decimation));
+		const int nStages = decimation && parent->m_wfx ? Decimator::Stages(parent->m_wfx->nSamplesPerSec, freqMax) : 0;
+		const int nCurrentStages = parent->m_decimator ? parent->m_decimator->m_nStages : 0;
+
+		// handling of gaps in the stream
+		LPCWSTR gapMode = RmReadString(rm, L"GapMode", L"");
+		if (*gapMode)
+		{
+			static const LPCWSTR s_gapName[Measure::NUM_GAP_MODES] = { L"Ignore", L"Zeros", L"Reset" };
+
+			int iMode;
+			for (iMode = 0; iMode < Measure::NUM_GAP_MODES; ++iMode)
+			{
+				if (_wcsicmp(gapMode, s_gapName[iMode]) == 0)
+				{
+					parent->m_gapMode = (Measure::GapMode)iMode;
+					break;
+				}
+			}
+
+			if (iMode >= Measure::NUM_GAP_MODES)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid GapMode '%s', must be one of: Ignore, Zeros or Reset.", gapMode);
+			}
+		}
+
+		// FFT window function, Kaiser takes its beta in parentheses
+		Measure::Window window = parent->m_window;
+		double kaiserBeta = parent->m_kaiserBeta;
+		LPCWSTR windowName = RmReadString(rm, L"Window", L"");
+		if (*windowName)
+		{
+			static const LPCWSTR s_windowName[Measure::NUM_WINDOWS] = { L"Hann", L"Hamming", L"Blackman", L"BlackmanHarris", L"Nuttall", L"FlatTop", L"Kaiser", L"Rectangular" };
+
+			int iWindow;
+			for (iWindow = 0; iWindow < Measure::NUM_WINDOWS; ++iWindow)
+			{
+				const size_t len = wcslen(s_windowName[iWindow]);
+				if (_wcsnicmp(windowName, s_windowName[iWindow], len) == 0 && (windowName[len] == '\0' || (iWindow == Measure::WINDOW_KAISER && windowName[len] == '(')))
+				{
+					window = (Measure::Window)iWindow;
+					if (windowName[len] == '(')
+					{
+						WCHAR* end = NULL;
+						kaiserBeta = wcstod(&windowName[len + 1], &end);
+						if (end == &windowName[len + 1] || *end != ')' || kaiserBeta < 0.0)
+						{
+							RmLogF(rm, LOG_ERROR, L"Invalid Kaiser beta in Window '%s', must be a number >= 0.", windowName);
+							kaiserBeta = parent->m_kaiserBeta;
+						}
+					}
+					break;
+				}
+			}
+
+			if (iWindow >= Measure::NUM_WINDOWS)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid Window '%s', must be one of: Hann, Hamming, Blackman, BlackmanHarris, Nuttall, FlatTop, Kaiser(beta) or Rectangular.", windowName);
+			}
+		}
+
+		if (fftSize < 0 || fftSize & 1)
+		{
+			RmLogF(rm, LOG_ERROR, L"Invalid FFTSize %ld: must be an even integer >= 0. (powers of 2 work best)", fftSize);
+			fftSize = 0;
+		}
+		fftBufferSize = max(fftSize, fftBufferSize);		// zero-padding only extends the FFT
+		if (waveSize < 0 || waveSize & 1)
+		{
+			RmLogF(rm, LOG_ERROR, L"Invalid WAVESize %ld: must be an even integer >= 0.", waveSize);
+			waveSize = 0;
+		}
+		if (nBands < 0)
+		{
+			RmLogF(rm, LOG_ERROR, L"Invalid Bands %ld: must be an integer >= 0.", nBands);
+			nBands = 0;
+		}
+
+		// diff the settings, and rebuild only the stages that depend on the changed ones
+		int rebuild = 0;
+		if (parent->m_nAnalysis		!= nAnalysis ||
+			nCurrentStages			!= nStages ||
+			formatChanged ||
+			memcmp(parent->m_analysis, analysis, nAnalysis * sizeof(Measure::Channel)) != 0 ||
+			memcmp(parent->m_downmix, downmix, sizeof(downmix)) != 0)
+		{
+			rebuild |= Parent::REBUILD_RING | Parent::REBUILD_FFT;
+		}
+		if (parent->m_fftSize		!= fftSize ||
+			parent->m_fftBufferSize	!= fftBufferSize)
+		{
+			rebuild |= Parent::REBUILD_FFT;
+		}
+		if (parent->m_fftSize		!= fftSize ||
+			parent->m_window		!= window ||
+			parent->m_kaiserBeta	!= kaiserBeta)
+		{
+			rebuild |= Parent::REBUILD_WINDOW;
+		}
+		if (parent->m_nBands		!= nBands ||
+			parent->m_freqMin		!= freqMin ||
+			parent->m_freqMax		!= freqMax)
+		{
+			rebuild |= Parent::REBUILD_BANDS;
+		}
+
+		// initialize smoothing, its buffers are laid out whether it is used or not
+		parent->m_smoothing = smoothing;
+		if (parent->m_smoothing)
+		{
+			parent->m_smoothingScalar = 1.0f / ((float)parent->m_smoothing * 2.0f + 1.0f);
+		}
+
+		// the buffer layout also depends on WAVESize, its buffers simply start over
+		if (!parent->m_arena || rebuild ||
+			parent->m_waveSize		!= waveSize)
+		{
+			parent->m_fftSize = fftSize;
+			parent->m_fftBufferSize = fftBufferSize;
+			parent->m_waveSize = waveSize;
+			parent->m_nBands = nBands;
+
+			// initialize min/max frequency
+			parent->m_freqMin = freqMin;
+			parent->m_freqMax = freqMax;
+
+			// initialize window function
+			parent->m_window = window;
+			parent->m_kaiserBeta = kaiserBeta;
+
+			parent->m_nAnalysis = nAnalysis;
+
+			parent->m_decimation = decimation;
+			parent->BuffersInit(nStages, rebuild);
+		}
+		memcpy(parent->m_analysis, analysis, nAnalysis * sizeof(Measure::Channel));
+		memcpy(parent->m_downmix, downmix, sizeof(downmix));
+		parent->m_downmixMask = 0;
+		for (int iChan = 0; iChan < Measure::CHANNEL_SUM; ++iChan)
+		{
+			for (int iAna = 0; iAna < nAnalysis; ++iAna)
+			{
+				if (downmix[iChan][iAna] != 0.0f) parent->m_downmixMask |= 1 << iChan;
+			}
+		}
+
+		// values that dont need fft/band reinitialization
+		parent->m_dynamicVolume = max(0, RmReadInt(rm, L"DynamicVolume", parent->m_dynamicVolume));
+		parent->m_smoothingMode = min(max(0, RmReadInt(rm, L"SmoothingMode", parent->m_smoothingMode)), 2);
+		parent->SelectUpdate();
+
+		// spectral frame cadence, HopSize in ring buffer samples or Overlap as a fraction of FFTSize
+		int hopSize = 0;
+		if (parent->m_fftSize)
+		{
+			hopSize = RmReadInt(rm, L"HopSize", 0);
+			const double overlap = RmReadDouble(rm, L"Overlap", 0.0);
+			if (hopSize < 0)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid HopSize %ld: must be an integer >= 0.", hopSize);
+				hopSize = 0;
+			}
+			else if (!hopSize && overlap != 0.0)
+			{
+				if (overlap < 0.0 || overlap >= 1.0)
+				{
+					RmLogF(rm, LOG_ERROR, L"Invalid Overlap %f: must be >= 0 and < 1.", overlap);
+				}
+				else
+				{
+					hopSize = max(1, (int)(parent->m_fftSize * (1.0 - overlap) + 0.5));
+				}
+			}
+		}
+		if (parent->m_hopSize != hopSize)
+		{
+			parent->m_hopSize = hopSize;
+			parent->m_hopCount = 0;
+		}
+
+		// adaptive update rate
+		parent->m_adaptiveUpdate = max(0, RmReadInt(rm, L"AdaptiveUpdate", parent->m_adaptiveUpdate));
+		parent->m_adaptiveThreshold = (float)max(0.0, RmReadDouble(rm, L"AdaptiveThreshold", parent->m_adaptiveThreshold));
+
+		// update wait time
+		parent->m_updatesPerSecond = updatesPerSecond;
+		if (parent->m_updatesPerSecond > 0) {
+			parent->m_pacer.SetRate(parent->m_updatesPerSecond);
+			Dispatcher::Register(parent);
+		}
+		else {
+			Dispatcher::Unregister(parent);
+		}
+
+		// update commands, groups are updated once per skin and tick
+		LPCWSTR measureGroup = RmReadString(rm, L"UpdateMeasureGroup", L"");
+		LPCWSTR meterGroup = RmReadString(rm, L"UpdateMeterGroup", L"");
+		WCHAR* d = parent->m_msgUpdate;
+		d += *measureGroup ?
+			_snwprintf_s(d, _countof(parent->m_msgUpdate), _TRUNCATE, L"[!UpdateMeasureGroup %s]", measureGroup) :
+			_snwprintf_s(d, _countof(parent->m_msgUpdate), _TRUNCATE, L"[!UpdateMeasure %s]", parent->m_rmName);
+		if (*meterGroup)
+		{
+			_snwprintf_s(d, _countof(parent->m_msgUpdate) - (d - parent->m_msgUpdate), _TRUNCATE, L"[!UpdateMeterGroup %s][!Redraw]", meterGroup);
+		}
+
+		// (re)parse envelope values
+		parent->m_envRMS[0] = max(0, RmReadInt(rm, L"RMSAttack", parent->m_envRMS[0]));
+		parent->m_envRMS[1] = max(0, RmReadInt(rm, L"RMSDecay", parent->m_envRMS[1]));
+		parent->m_envPeak[0] = max(0, RmReadInt(rm, L"PeakAttack", parent->m_envPeak[0]));
+		parent->m_envPeak[1] = max(0, RmReadInt(rm, L"PeakDecay", parent->m_envPeak[1]));
+		parent->m_envFFT[0] = max(0, RmReadInt(rm, L"FFTAttack", parent->m_envFFT[0]));
+		parent->m_envFFT[1] = max(0, RmReadInt(rm, L"FFTDecay", parent->m_envFFT[1]));
+		parent->m_envelopeMode = min(max(0, RmReadInt(rm, L"EnvelopeMode", parent->m_envelopeMode)), 1);
+
+		// (re)parse meter ballistics
+		LPCWSTR ppmType = RmReadString(rm, L"PPMType", L"");
+		if (*ppmType)
+		{
+			if (_wcsicmp(ppmType, L"I") == 0 || _wcsicmp(ppmType, L"1") == 0)
+			{
+				parent->m_ppmType = 1;
+			}
+			else if (_wcsicmp(ppmType, L"II") == 0 || _wcsicmp(ppmType, L"2") == 0)
+			{
+				parent->m_ppmType = 2;
+			}
+			else
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid PPMType '%s', must be one of: I or II.", ppmType);
+			}
+		}
+		parent->m_holdTime = max(0, RmReadInt(rm, L"HoldTime", parent->m_holdTime));
+		parent->m_fallRate = max(0.0, RmReadDouble(rm, L"FallRate", parent->m_fallRate));
+		parent->m_vuReference = RmReadDouble(rm, L"VUReference", parent->m_vuReference);
+		parent->m_clipLevel = RmReadDouble(rm, L"ClipLevel", parent->m_clipLevel);
+		if (parent->m_ballistics)
+		{
+			parent->m_ballistics->Configure(parent);
+		}
+
+		// periodic dump of the latency histograms, shared by all parents
+		s_latency.m_logPeriod = max(0, RmReadInt(rm, L"LatencyLog", s_latency.m_logPeriod));
+
+		// (re)parse gain constants
+		parent->m_gainRMS = max(0.0, RmReadDouble(rm, L"RMSGain", parent->m_gainRMS));
+		parent->m_gainPeak = max(0.0, RmReadDouble(rm, L"PeakGain", parent->m_gainPeak));
+
+		parent->m_sensitivity = 10 * log10(parent->m_fftSize);	// default dynamic range/noise floor
+		parent->m_sensitivity = 10 / max(1.0, RmReadDouble(rm, L"Sensitivity", parent->m_sensitivity));
+
+		// regenerate filter constants
+		parent->FiltersInit();
+
+		// settings may have changed, so re-evaluate which parents can share their results
+		if (parent->m_endpoint)
+		{
+			parent->m_endpoint->ShareResults();
+		}
+	}
+
+	// parse FFT index request
+	m->m_fftIdx = max(0, RmReadInt(rm, L"FFTIdx", m->m_fftIdx));
+	m->m_fftIdx = min(m->ParentOrSelf()->m_fftBufferSize / 2, m->m_fftIdx);
+
+	// parse WAVE index request
+	m->m_waveIdx = max(0, RmReadInt(rm, L"WaveIdx", m->m_waveIdx));
+	m->m_waveIdx = min(m->ParentOrSelf()->m_waveSize, m->m_waveIdx);
+
+	// parse band index request
+	m->m_bandIdx = max(0, RmReadInt(rm, L"BandIdx", m->m_bandIdx));
+	m->m_bandIdx = min(m->ParentOrSelf()->m_nBands, m->m_bandIdx);
+
+	// parse loudness mode, and enable the meter of the parent that computes this type
+	if (m->m_type == Measure::TYPE_LOUDNESS)
+	{
+		LPCWSTR mode = RmReadString(rm, L"LoudnessMode", L"");
+		if (*mode)
+		{
+			int iMode;
+			for (iMode = 0; iMode < Measure::NUM_LOUDNESS_MODES; ++iMode)
+			{
+				if (_wcsicmp(mode, s_loudnessName[iMode]) == 0)
+				{
+					m->m_loudnessMode = (Measure::LoudnessMode)iMode;
+					break;
+				}
+			}
+
+			if (iMode >= Measure::NUM_LOUDNESS_MODES)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid LoudnessMode '%s', must be one of: Momentary, ShortTerm, Integrated or Range.", mode);
+			}
+		}
+	}
+	else if (m->m_type == Measure::TYPE_LATENCY)
+	{
+		LPCWSTR stage = RmReadString(rm, L"Stage", L"");
+		if (*stage)
+		{
+			int iStage;
+			for (iStage = 0; iStage < Latency::NUM_STAGES; ++iStage)
+			{
+				if (_wcsicmp(stage, Latency::s_stageName[iStage]) == 0)
+				{
+					m->m_latencyStage = (Latency::Stage)iStage;
+					break;
+				}
+			}
+
+			if (iStage >= Latency::NUM_STAGES)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid Stage '%s', must be one of: Capture, FFT, Publish or Dispatch.", stage);
+			}
+		}
+
+		LPCWSTR stat = RmReadString(rm, L"Stat", L"");
+		if (*stat)
+		{
+			int iStat;
+			for (iStat = 0; iStat < Latency::NUM_STATS; ++iStat)
+			{
+				if (_wcsicmp(stat, Latency::s_statName[iStat]) == 0)
+				{
+					m->m_latencyStat = (Latency::Stat)iStat;
+					break;
+				}
+			}
+
+			if (iStat >= Latency::NUM_STATS)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid Stat '%s', must be one of: P50, P99, Max or Jitter.", stat);
+			}
+		}
+	}
+	else if (m->m_type == Measure::TYPE_STATS)
+	{
+		LPCWSTR stage = RmReadString(rm, L"Stage", L"");
+		if (*stage)
+		{
+			int iStage;
+			for (iStage = 0; iStage < Profile::NUM_STAGES; ++iStage)
+			{
+				if (_wcsicmp(stage, Profile::s_stageName[iStage]) == 0)
+				{
+					m->m_profileStage = (Profile::Stage)iStage;
+					break;
+				}
+			}
+
+			if (iStage >= Profile::NUM_STAGES)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid Stage '%s', must be one of: Drain, Convert, Meters, Deinterleave, Envelope, Window, FFT, Spectrum, Bands, Smoothing or Total.", stage);
+			}
+		}
+
+		LPCWSTR stat = RmReadString(rm, L"Stat", L"");
+		if (*stat)
+		{
+			int iStat;
+			for (iStat = 0; iStat < Profile::NUM_STATS; ++iStat)
+			{
+				if (_wcsicmp(stat, Profile::s_statName[iStat]) == 0)
+				{
+					m->m_profileStat = (Profile::Stat)iStat;
+					break;
+				}
+			}
+
+			if (iStat >= Profile::NUM_STATS)
+			{
+				RmLogF(rm, LOG_ERROR, L"Invalid Stat '%s', must be one of: Mean, P99, FPS or SilentRatio.", stat);
+			}
+		}
+	}
+
+	// the meter of the type is carved on the parent, the one of the previous type is released
+	int meter = 0;
+	switch (m->m_type)
+	{
+	case Measure::TYPE_LOUDNESS:
+		meter = Parent::METER_LOUDNESS;
+		break;
+	case Measure::TYPE_TRUEPEAK:
+		meter = Parent::METER_TRUEPEAK;
+		break;
+	case Measure::TYPE_VU:
+	case Measure::TYPE_PPM:
+	case Measure::TYPE_PEAKHOLD:
+	case Measure::TYPE_CLIP:
+		meter = Parent::METER_BALLISTICS;
+		break;
+	default:
+		break;
+	}
+	m->ParentOrSelf()->UseMeter(m, meter);
+}
+
+
+/**
+* Update the measure.
+*
+* @param[in]	data			Measure instance pointer.
+* @return		Latest value - typically an audio level between 0.0 and 1.0.
+*/
+PLUGIN_EXPORT double Update(void* data)
+{
+	Measure* m = (Measure*)data;
+	Parent* parent = m->ParentOrSelf();
+
+	// rainmeter style update loop - not recommended
+	if (!m->m_parent && parent->m_endpoint && parent->m_endpoint->m_polled)
+	{
+		Endpoint* ep = parent->m_endpoint;
+		std::lock_guard<std::mutex> lock(ep->m_lock);
+
+		HRESULT hr = ep->Capture();
+		if (SUCCEEDED(hr) && !parent->m_dspSource)
+		{
+			hr = parent->m_hrUpdate = parent->UpdateParent();
+			if (hr == S_OK)
+			{
+				// the values are read by rainmeter right after this update
+				s_latency.Record(Latency::STAGE_FFT, ep->m_audioTime);
+				s_latency.Record(Latency::STAGE_PUBLISH, ep->m_audioTime);
+				s_latency.Record(Latency::STAGE_DISPATCH, ep->m_audioTime);
+			}
+		}
+
+		switch (hr)
+		{
+		case S_OK:
+			// everything is fine, update measures
+			break;
+		case S_FALSE:
+			// silence detected, but ignore to still update other types of measures like FFTFREQ
+			break;
+		case AUDCLNT_E_BUFFER_ERROR:
+		case AUDCLNT_E_DEVICE_INVALIDATED:
+		case AUDCLNT_E_SERVICE_NOT_RUNNING:
+			// error detected, release device
+			ep->DeviceRelease();
+			return 0.0;
+		}
+	}
+
+	// parents with identical settings share the results of one pipeline
+	const Parent* dsp = parent->DSP();
+
+	switch (m->m_type)
+	{
+	case Measure::TYPE_BAND:
+		if (parent->IsCapturing() && dsp->m_nBands && m->m_bandIdx < dsp->m_nBands)
+		{
+			return dsp->m_bandOut[dsp->AnalysisIndex(m->m_channel) * dsp->m_nBands + m->m_bandIdx];
+		}
+		break;
+	case Measure::TYPE_WAVEBAND:
+		if (parent->IsCapturing() && dsp->m_nBands && dsp->m_waveSize && m->m_bandIdx < dsp->m_nBands)
+		{
+			return dsp->m_waveBandOut[dsp->AnalysisIndex(m->m_channel) * dsp->m_nBands + m->m_bandIdx];
+		}
+		break;
+	case Measure::TYPE_FFT:
+		if (parent->IsCapturing() && dsp->m_fftBufferSize && m->m_fftIdx < dsp->m_fftBufferSize)
+		{
+			return max(0, dsp->m_sensitivity * log10(CLAMP01(dsp->m_fftOut[dsp->AnalysisIndex(m->m_channel) * dsp->m_fftBufferSize + m->m_fftIdx])) + 1.0);
+		}
+		break;
+	case Measure::TYPE_FFTFREQ:
+		if (parent->IsCapturing() && dsp->m_fftBufferSize && m->m_fftIdx <= (dsp->m_fftBufferSize * 0.5))
+		{
+			return ((float)m->m_fftIdx) * dsp->m_df;
+		}
+		break;
+
+	case Measure::TYPE_BANDFREQ:
+		if (parent->IsCapturing() && dsp->m_nBands && m->m_bandIdx < dsp->m_nBands)
+		{
+			return dsp->m_bandFreq[m->m_bandIdx];
+		}
+		break;
+	case Measure::TYPE_WAVE:
+		if (parent->IsCapturing() && dsp->m_waveSize && m->m_waveIdx < dsp->m_waveSize)
+		{
+			return dsp->m_waveOut[dsp->AnalysisIndex(m->m_channel) * dsp->m_waveSize + m->m_waveIdx];
+		}
+		break;
+	case Measure::TYPE_RMS:
+		if (parent->IsCapturing())
+		{
+			return CLAMP01(sqrt(dsp->m_rms[m->m_channel]) * parent->m_gainRMS);
+		}
+		break;
+	case Measure::TYPE_PEAK:
+		if (parent->IsCapturing())
+		{
+			return CLAMP01(dsp->m_peak[m->m_channel] * parent->m_gainPeak);
+		}
+		break;
+	case Measure::TYPE_DEV_STATUS:
+		if (parent->m_dev)
+		{
+			DWORD state;
+			if (parent->m_dev->GetState(&state) == S_OK && state == DEVICE_STATE_ACTIVE)
+			{
+				return 1.0;
+			}
+		}
+		break;
+	case Measure::TYPE_BUFFERSTATUS:
+		if (parent->m_endpoint && parent->m_endpoint->m_nFramesNext > 0)
+		{
+			return parent->m_endpoint->m_nFramesNext;
+		}
+		break;
+	case Measure::TYPE_SKIPPEDFRAMES:
+		return (double)dsp->m_nSkippedFrames;
+	case Measure::TYPE_UPDATERATE:
+		if (parent->m_updatesPerSecond > 0)
+		{
+			return parent->m_pacer.Rate();
+		}
+		break;
+	case Measure::TYPE_UPDATEJITTER:
+		if (parent->m_updatesPerSecond > 0)
+		{
+			return parent->m_pacer.m_jitter * 1000.0;
+		}
+		break;
+	case Measure::TYPE_DISPATCHRATE:
+		if (s_dispatcher)
+		{
+			return s_dispatcher->m_bangRate;
+		}
+		break;
+	case Measure::TYPE_GLITCHES:
+		if (parent->m_endpoint)
+		{
+			return (double)parent->m_endpoint->m_gaps.m_nGlitches;
+		}
+		break;
+	case Measure::TYPE_DROPPEDFRAMES:
+		if (parent->m_endpoint)
+		{
+			return (double)parent->m_endpoint->m_gaps.m_nDropped;
+		}
+		break;
+	case Measure::TYPE_LATENCY:
+		return s_latency.Value(m->m_latencyStage, m->m_latencyStat);
+	case Measure::TYPE_STATS:
+		if (dsp->m_profile)
+		{
+			return dsp->m_profile->Value(m->m_profileStage, m->m_profileStat);
+		}
+		break;
+	case Measure::TYPE_LOUDNESS:
+		if (parent->IsCapturing() && parent->m_loudness)
+		{
+			return parent->m_loudness->Value(m->m_loudnessMode);
+		}
+		return m->m_loudnessMode == Measure::LOUDNESS_RANGE ? 0.0 : Loudness::s_floor;
+	case Measure::TYPE_TRUEPEAK:
+		if (parent->IsCapturing() && dsp->m_truePeak)
+		{
+			return dsp->m_truePeak->Value(m->m_channel);
+		}
+		return TruePeak::s_floor;
+	case Measure::TYPE_VU:
+	case Measure::TYPE_PPM:
+	case Measure::TYPE_PEAKHOLD:
+	case Measure::TYPE_CLIP:
+		if (parent->IsCapturing() && parent->m_ballistics)
+		{
+			return parent->m_ballistics->Value(m->m_type, m->m_channel);
+		}
+		return m->m_type == Measure::TYPE_CLIP ? 0.0 : Ballistics::s_floor;
+	default:
+		break;
+	}
+
+	return 0.0;
+}
+
+
+/**
+* Execute a command sent with !CommandMeasure.
+*
+* @param[in]	data			Measure instance pointer.
+* @param[in]	args			Command: "ResetLoudness" starts a new loudness measurement,
+*								"ResetHold" clears the held peaks and the clip counters,
+*								"ResetLatency" clears the latency histograms,
+*								"ResetStats" clears the CPU time statistics of the parent.
+*/
+PLUGIN_EXPORT void ExecuteBang(void* data, LPCWSTR args)
+{
+	Measure* m = (Measure*)data;
+	Parent* parent = m->ParentOrSelf();
+
+	if (_wcsicmp(args, L"ResetLoudness") == 0)
+	{
+		if (parent->m_endpoint && parent->m_loudness)
+		{
+			std::lock_guard<std::mutex> lock(parent->m_endpoint->m_lock);
+			parent->m_loudness->Reset();
+		}
+	}
+	else if (_wcsicmp(args, L"ResetHold") == 0)
+	{
+		if (parent->m_endpoint && parent->m_ballistics)
+		{
+			std::lock_guard<std::mutex> lock(parent->m_endpoint->m_lock);
+			parent->m_ballistics->ResetHold();
+		}
+	}
+	else if (_wcsicmp(args, L"ResetLatency") == 0)
+	{
+		s_latency.Reset();
+	}
+	else if (_wcsicmp(args, L"ResetStats") == 0)
+	{
+		if (parent->m_endpoint && parent->m_profile)
+		{
+			std::lock_guard<std::mutex> lock(parent->m_endpoint->m_lock);
+			parent->m_profile->Reset();
+		}
+	}
+	else
+	{
+		RmLogF(m->m_rm, LOG_WARNING, L"Unknown command '%s'.", args);
+	}
+}
+
+
+/**
+* Indicates that the application working directory will not be reset by the plugin.
+*/
+PLUGIN_EXPORT void OverrideDirectory()
+{
+}
+
+
+/**
+* Get a string value from the measure.
+*
+* @param[in]	data			Measure instance pointer.
+* @return		String value - must be copied out by the caller.
+*/
+PLUGIN_EXPORT LPCWSTR GetString(void* data)
+{
+	Measure* m = (Measure*)data;
+	Parent* parent = m->ParentOrSelf();
+
+	static WCHAR buffer[4096];
+	const WCHAR* s_fmtName[Measure::NUM_FORMATS] =
+	{
+		L"<invalid>",	// FMT_INVALID
+		L"PCM 16b",		// FMT_PCM_S16
+		L"PCM 32b",		// FMT_PCM_F32
+	};
+
+	buffer[0] = '\0';
+
+	switch (m->m_type)
+	{
+	default:
+		// return NULL for any numeric values, so Rainmeter can auto-convert them.
+		return NULL;
+
+	case Measure::TYPE_FORMAT:
+		if (parent->m_wfx)
+		{
+			_snwprintf_s(buffer, _TRUNCATE, L"%dHz %s %dch", parent->m_wfx->nSamplesPerSec,
+				s_fmtName[parent->m_endpoint->m_format], parent->m_wfx->nChannels);
+		}
+		break;
 
-		switch (hr)
+	case Measure::TYPE_DEV_NAME:
+		if (parent->m_endpoint)
 		{
-		case S_OK:
-			// everything is fine, update measures
+			return parent->m_endpoint->m_devName;
+		}
+		break;
 
-			// wait specified time (to not spam update calls)
-			if (m_updatesPerSecond > 0) 
+	case Measure::TYPE_DEV_ID:
+		if (parent->m_dev)
+		{
+			LPWSTR pwszID = NULL;
+			if (parent->m_dev->GetId(&pwszID) == S_OK)
 			{
-				auto now = std::chrono::system_clock::now();
-				auto elapsed = now - m_lastUpdate;
-				auto waitTime = m_waitUpdate;// - m_overheadUpdate;
-				if (elapsed >= waitTime)
-				{
-					// overheadUpdate should correct the overhead time making the update rate more accurate
-					// but i cant tell the difference and i dont know if it helps or does the opposite
-					// so i leave it disabled until i investigated further
-					//m_overheadUpdate = elapsed - waitTime;
-					//if (m_overheadUpdate > m_waitUpdate) {
-					//	m_overheadUpdate = std::chrono::duration<double>(0);
-					//}
-					m_lastUpdate = now;
-					RmExecute(m_skin, m_msgUpdate);
-				}
+				_snwprintf_s(buffer, _TRUNCATE, L"%s", pwszID);
+				CoTaskMemFree(pwszID);
 			}
-			// update as fast as possible
-			else if (m_updatesPerSecond < 0 && m_updatesPerSecond >= -1)
+		}
+		break;
+
+	case Measure::TYPE_DEV_LIST:
+		if (parent->m_enum)
+		{
+			IMMDeviceCollection* collection = NULL;
+			if (parent->m_enum->EnumAudioEndpoints(parent->m_port == Measure::PORT_OUTPUT ? eRender : eCapture,
+				DEVICE_STATE_ACTIVE | DEVICE_STATE_UNPLUGGED, &collection) == S_OK)
 			{
-				RmExecute(m_skin, m_msgUpdate);
+				WCHAR* d = &buffer[0];
+				UINT nDevices;
+				collection->GetCount(&nDevices);
+
+				for (ULONG iDevice = 0; iDevice < nDevices; ++iDevice)
+				{
+					IMMDevice* device = NULL;
+					IPropertyStore* props = NULL;
+					if (collection->Item(iDevice, &device) == S_OK && device->OpenPropertyStore(STGM_READ, &props) == S_OK)
+					{
+						LPWSTR id = NULL;
+						PROPVARIANT	varName;
+						PropVariantInit(&varName);
+
+						if (device->GetId(&id) == S_OK && props->GetValue(PKEY_Device_FriendlyName, &varName) == S_OK)
+						{
+							d += _snwprintf_s(d, _countof(buffer) - (d - buffer), _TRUNCATE,
+								L"%s%s: %s", iDevice > 0 ? L"\n" : L"", id, varName.pwszVal);
+						}
+
+						if (id) CoTaskMemFree(id);
+
+						PropVariantClear(&varName);
+					}
+
+					SAFE_RELEASE(props);
+					SAFE_RELEASE(device);
+				}
 			}
-			break;
-		case S_FALSE:
-			// silence detected, no need to update
-			break;
-		case AUDCLNT_E_BUFFER_ERROR:
-		case AUDCLNT_E_DEVICE_INVALIDATED:
-		case AUDCLNT_E_SERVICE_NOT_RUNNING:
-			// error detected, release device
-			DeviceRelease();
-			break;
+
+			SAFE_RELEASE(collection);
 		}
+		break;
 	}
+
+	return buffer;
 }
 
 /**
-* Create and initialize a measure instance.  Creates WASAPI loopback
-* device if not a child measure.
+* Handle a gap in the stream for every parent computing its own results, as
+* configured with GapMode: the missing frames are replaced by silence, or the
+* ring buffers and envelopes are cleared.  Must be called before the packet
+* following the gap is copied to the chunk buffer.
 *
-* @param[out]	data			Pointer address in which to return measure instance.
-* @param[in]	rm				Rainmeter context.
+* @param[in]	nMissing		Number of frames missing before the current packet.
 */
-PLUGIN_EXPORT void Initialize(void** data, void* rm)
+void Endpoint::FillGap(UINT64 nMissing)
 {
-	Measure* m = new Measure;
-	m->m_skin = RmGetSkin(rm);
-	m->m_rmName = RmGetMeasureName(rm);
-	*data = m;
+	// at most one second of silence, older audio has left the ring buffers by then
+	const UINT32 nZeros = (UINT32)min(nMissing, (UINT64)m_wfx->nSamplesPerSec);
+	if (nZeros)
+	{
+		memset(m_bufChunk, 0, min(nZeros, m_bufFrames) * m_wfx->nChannels * sizeof(float));
+		RmLogF(NULL, LOG_DEBUG, L"AudioLevel: %llu frames dropped.", nMissing);
+	}
 
-	// parse parent specifier, if appropriate
-	LPCWSTR parentName = RmReadString(rm, L"Parent", L"");
-	if (*parentName)
+	std::vector<Parent*>::const_iterator iter = m_parents.begin();
+	for (; iter != m_parents.end(); ++iter)
 	{
-		// match parent using measure name and skin handle
-		std::vector<Measure*>::const_iterator iter = s_parents.begin();
-		for (; iter != s_parents.end(); ++iter)
+		Parent* parent = *iter;
+		if (parent->m_dspSource) continue;
+
+		if (parent->m_gapMode == Measure::GAP_ZEROS)
 		{
-			if (_wcsicmp((*iter)->m_rmName, parentName) == 0 &&
-				(*iter)->m_skin == m->m_skin &&
-				!(*iter)->m_parent)
+			for (UINT32 n = nZeros; n > 0;)
 			{
-				m->m_parent = (*iter);
-
-				return;
+				const UINT32 nChunk = min(n, m_bufFrames);
+				parent->ProcessChunk(m_bufChunk, nChunk, 0);
+				n -= nChunk;
 			}
 		}
-
-		RmLogF(rm, LOG_ERROR, L"Couldn't find Parent measure '%s'.", parentName);
+		else if (parent->m_gapMode == Measure::GAP_RESET)
+		{
+			parent->ResetStream();
+		}
 	}
+}
 
-	// this is a parent measure - add it to the global list
-	s_parents.push_back(m);
-
-	// parse port specifier
-	LPCWSTR port = RmReadString(rm, L"Port", L"");
-	if (port && *port)
+/**
+* Convert captured samples to F32.
+*
+* @param[in]	format			Sample format of the captured data.
+* @param[in]	buffer			Captured data.
+* @param[out]	chunk			F32 samples.
+* @param[in]	nSamples		Number of samples (frames times channels).
+*/
+void ConvertChunk(Measure::Format format, const BYTE* buffer, float* chunk, UINT32 nSamples)
+{
+	if (format == Measure::FMT_PCM_F32)
 	{
-		if (_wcsicmp(port, L"Output") == 0)
+		memcpy(&chunk[0], &buffer[0], nSamples * sizeof(float));
+	}
+	else if (format == Measure::FMT_PCM_S16)
+	{
+		const INT16* buf = (const INT16*)buffer;
+		for (UINT32 iPcm = 0; iPcm < nSamples; ++iPcm)
 		{
-			m->m_port = Measure::PORT_OUTPUT;
+			chunk[iPcm] = (float)buf[iPcm] * pcmScalar;
 		}
-		else if (_wcsicmp(port, L"Input") == 0)
+	}
+}
+
+/**
+* Drain all pending packets from the capture client, convert them to F32 and
+* hand each chunk to the parents that compute their own results.
+*
+* @return		Result value, S_OK if new data was captured, S_FALSE if there was none.
+*/
+HRESULT Endpoint::Capture()
+{
+	BYTE* buffer;
+	UINT32 nFrames;
+	DWORD  flags;
+	UINT64 devPosition = 0;
+	UINT64 qpcPosition = 0;
+
+	if (!m_clCapture) return S_FALSE;
+
+	HRESULT hr = m_clCapture->GetNextPacketSize(&m_nFramesNext);
+	if (hr == S_OK)
+	{
+		if (m_nFramesNext <= 0) return S_FALSE;
+
+		PROFILE_START(mark);
+		while (m_clCapture->GetBuffer(&buffer, &nFrames, &flags, &devPosition, &qpcPosition) == S_OK)
 		{
-			m->m_port = Measure::PORT_INPUT;
+			// the time stamp is taken at the first frame of the packet, the packet is complete one duration later
+			m_audioTime = (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR) ? Latency::Now() :
+				(INT64)qpcPosition + nFrames * 10000000LL / m_wfx->nSamplesPerSec;
+			s_latency.Record(Latency::STAGE_CAPTURE, m_audioTime);
+
+			// dropped frames or a discontinuity: keep the ring buffers in time, or restart them
+			UINT64 nMissing;
+			if (m_gaps.Track(devPosition, nFrames, flags, &nMissing))
+			{
+				FillGap(nMissing);
+			}
+			PROFILE_LAP(&m_profile, STAGE_DRAIN, mark);
+
+			// if not F32, convert to F32
+			ConvertChunk(m_format, buffer, m_bufChunk, nFrames * m_wfx->nChannels);
+
+			PROFILE_LAP(&m_profile, STAGE_CONVERT, mark);
+
+			// release buffer immediately to resume capture
+			m_clCapture->ReleaseBuffer(nFrames);
+			PROFILE_LAP(&m_profile, STAGE_DRAIN, mark);
+
+			// fan out the chunk to every parent computing its own results
+			std::vector<Parent*>::const_iterator iter = m_parents.begin();
+			for (; iter != m_parents.end(); ++iter)
+			{
+				if (!(*iter)->m_dspSource)
+				{
+					(*iter)->ProcessChunk(m_bufChunk, nFrames, flags);
+				}
+			}
+			PROFILE_SKIP(mark);
 		}
-		else
+
+#if (PROFILE_STAGES)
+		// the drain and conversion are shared, count them in the next frame of every parent
+		std::vector<Parent*>::const_iterator iter = m_parents.begin();
+		for (; iter != m_parents.end(); ++iter)
 		{
-			RmLogF(rm, LOG_ERROR, L"Invalid Port '%s', must be one of: Output or Input.", port);
+			if (!(*iter)->m_dspSource)
+			{
+				(*iter)->m_profile->m_frame[Profile::STAGE_DRAIN] += m_profile.m_frame[Profile::STAGE_DRAIN];
+				(*iter)->m_profile->m_frame[Profile::STAGE_CONVERT] += m_profile.m_frame[Profile::STAGE_CONVERT];
+			}
 		}
+		m_profile.m_frame[Profile::STAGE_DRAIN] = 0;
+		m_profile.m_frame[Profile::STAGE_CONVERT] = 0;
+#endif
 	}
 
-	_snwprintf_s(m->m_msgUpdate, _TRUNCATE, L"!UpdateMeasure %s", m->m_rmName);
-
-	// create the enumerator
-	EXIT_ON_ERROR(CoCreateInstance(CLSID_MMDeviceEnumerator, NULL, CLSCTX_ALL, IID_IMMDeviceEnumerator, (void**)& m->m_enum));
+	return hr;
+}
 
-	// parse requested device ID (optional)
-	LPCWSTR reqID = RmReadString(rm, L"ID", L"");
-	if (reqID)
+#if (SIMD_SSE)
+/**
+* Load the samples of one frame into the channel lanes, unused lanes are zero.
+*
+* @param[in]	p				Interleaved samples of the frame.
+* @param[in]	n				Number of channels to load (1 to 4).
+*/
+static inline __m128 LoadLanes(const float* p, int n)
+{
+	switch (n)
 	{
-		_snwprintf_s(m->m_reqID, _TRUNCATE, L"%s", reqID);
+	case 1:		return _mm_load_ss(p);
+	case 2:		return _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)p);
+	case 3:		return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)p), _mm_load_ss(p + 2));
+	default:	return _mm_loadu_ps(p);
 	}
+}
 
-	// if a specific ID was requested, search for that one, otherwise get the default
-	if (*m->m_reqID)
+/**
+* One-pole attack/decay filter step: decay coefficient if x is below the envelope, attack otherwise.
+*/
+static inline __m128 EnvelopeStep(__m128 env, __m128 x, __m128 kAttack, __m128 kDecay)
+{
+	const __m128 decay = _mm_cmplt_ps(x, env);
+	const __m128 k = _mm_or_ps(_mm_and_ps(decay, kDecay), _mm_andnot_ps(decay, kAttack));
+	return _mm_add_ps(x, _mm_mul_ps(k, _mm_sub_ps(env, x)));
+}
+
+static inline __m128 AbsLanes(__m128 x)
+{
+	return _mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(), x));
+}
+#endif
+
+/**
+* Measure RMS and peak levels with per-sample ballistics.  Vectorized across
+* channels, up to 8 channels are processed in two SSE registers.
+*
+* @param[in]	chunk			Interleaved F32 frames.
+* @param[in]	nFrames			Number of frames in the chunk.
+* @param[in]	nChannels		Number of channels per frame.
+*/
+void Parent::EnvelopeSample(const float* chunk, UINT32 nFrames, int nChannels)
+{
+	const int nLanes = min(nChannels, (int)CHANNEL_SUM);
+
+#if (SIMD_SSE)
+	const __m128 kRmsA = _mm_set1_ps(m_kRMS[0]), kRmsD = _mm_set1_ps(m_kRMS[1]);
+	const __m128 kPeakA = _mm_set1_ps(m_kPeak[0]), kPeakD = _mm_set1_ps(m_kPeak[1]);
+	__m128 rms0 = _mm_loadu_ps(&m_rms[0]), rms1 = _mm_loadu_ps(&m_rms[4]);
+	__m128 peak0 = _mm_loadu_ps(&m_peak[0]), peak1 = _mm_loadu_ps(&m_peak[4]);
+
+	if (nLanes <= 4)
 	{
-		HRESULT hr = m->m_enum->GetDevice(m->m_reqID, &m->m_dev);
-		if (hr != S_OK)
+		for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame, chunk += nChannels)
 		{
-			WCHAR msg[256];
-			_snwprintf_s(msg, _TRUNCATE, L"Audio %s device '%s' not found (error 0x%08x).",
-				m->m_port == Measure::PORT_OUTPUT ? L"output" : L"input", m->m_reqID, hr);
-
-			RmLog(rm, LOG_WARNING, msg);
+			const __m128 x0 = LoadLanes(chunk, nLanes);
+			rms0 = EnvelopeStep(rms0, _mm_mul_ps(x0, x0), kRmsA, kRmsD);
+			peak0 = EnvelopeStep(peak0, AbsLanes(x0), kPeakA, kPeakD);
 		}
 	}
 	else
 	{
-		EXIT_ON_ERROR(m->m_enum->GetDefaultAudioEndpoint(m->m_port == Measure::PORT_OUTPUT ? eRender : eCapture, eConsole, &m->m_dev));
+		for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame, chunk += nChannels)
+		{
+			const __m128 x0 = _mm_loadu_ps(chunk);
+			const __m128 x1 = LoadLanes(chunk + 4, nLanes - 4);
+			rms0 = EnvelopeStep(rms0, _mm_mul_ps(x0, x0), kRmsA, kRmsD);
+			rms1 = EnvelopeStep(rms1, _mm_mul_ps(x1, x1), kRmsA, kRmsD);
+			peak0 = EnvelopeStep(peak0, AbsLanes(x0), kPeakA, kPeakD);
+			peak1 = EnvelopeStep(peak1, AbsLanes(x1), kPeakA, kPeakD);
+		}
 	}
 
-	// init the device (if it fails, log debug message and quit)
-	if (m->DeviceInit() == S_OK)
+	_mm_storeu_ps(&m_rms[0], rms0);
+	_mm_storeu_ps(&m_rms[4], rms1);
+	_mm_storeu_ps(&m_peak[0], peak0);
+	_mm_storeu_ps(&m_peak[4], peak1);
+#else
+	for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame, chunk += nChannels)
 	{
-		return;
+		for (int iChan = 0; iChan < nLanes; ++iChan)
+		{
+			float x = chunk[iChan];
+			float sqrX = x * x;
+			float absX = fabsf(x);
+			m_rms[iChan] = sqrX + m_kRMS[(sqrX < m_rms[iChan])] * (m_rms[iChan] - sqrX);
+			m_peak[iChan] = absX + m_kPeak[(absX < m_peak[iChan])] * (m_peak[iChan] - absX);
+		}
 	}
-
-Exit:
-
-	SAFE_RELEASE(m->m_enum);
+#endif
 }
 
-
 /**
-* Destroy the measure instance.
+* Measure RMS and peak levels with per-block ballistics.  The mean square and
+* maximum of each block are computed vectorized across channels, then the
+* attack/decay filter is applied once per block: env = x + k^n * (env - x).
 *
-* @param[in]	data			Measure instance pointer.
+* @param[in]	chunk			Interleaved F32 frames.
+* @param[in]	nFrames			Number of frames in the chunk.
+* @param[in]	nChannels		Number of channels per frame.
 */
-PLUGIN_EXPORT void Finalize(void* data)
+void Parent::EnvelopeBlock(const float* chunk, UINT32 nFrames, int nChannels)
 {
-	Measure* m = (Measure*)data;
+	const int nLanes = min(nChannels, (int)CHANNEL_SUM);
 
-	if (!m->m_parent)
+	for (UINT32 iBlock = 0; iBlock < nFrames; iBlock += ENVELOPE_BLOCK)
 	{
-		SetEvent(m->m_hStopEvent);
+		const UINT32 n = min(nFrames - iBlock, (UINT32)ENVELOPE_BLOCK);
 
-		m->DeviceRelease();
-		SAFE_RELEASE(m->m_enum);
+		// block filter constants, precomputed for full blocks
+		float kRMS[2], kPeak[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			kRMS[i] = n == ENVELOPE_BLOCK ? m_kRMSBlock[i] : powf(m_kRMS[i], (float)n);
+			kPeak[i] = n == ENVELOPE_BLOCK ? m_kPeakBlock[i] : powf(m_kPeak[i], (float)n);
+		}
 
-		std::vector<Measure*>::iterator iter = std::find(s_parents.begin(), s_parents.end(), m);
-		s_parents.erase(iter);
-	}
+		float sum[8], peak[8];
+#if (SIMD_SSE)
+		__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+		__m128 max0 = _mm_setzero_ps(), max1 = _mm_setzero_ps();
+		if (nLanes <= 4)
+		{
+			for (UINT32 iFrame = 0; iFrame < n; ++iFrame, chunk += nChannels)
+			{
+				const __m128 x0 = LoadLanes(chunk, nLanes);
+				sum0 = _mm_add_ps(sum0, _mm_mul_ps(x0, x0));
+				max0 = _mm_max_ps(max0, AbsLanes(x0));
+			}
+		}
+		else
+		{
+			for (UINT32 iFrame = 0; iFrame < n; ++iFrame, chunk += nChannels)
+			{
+				const __m128 x0 = _mm_loadu_ps(chunk);
+				const __m128 x1 = LoadLanes(chunk + 4, nLanes - 4);
+				sum0 = _mm_add_ps(sum0, _mm_mul_ps(x0, x0));
+				sum1 = _mm_add_ps(sum1, _mm_mul_ps(x1, x1));
+				max0 = _mm_max_ps(max0, AbsLanes(x0));
+				max1 = _mm_max_ps(max1, AbsLanes(x1));
+			}
+		}
+		_mm_storeu_ps(&sum[0], sum0);
+		_mm_storeu_ps(&sum[4], sum1);
+		_mm_storeu_ps(&peak[0], max0);
+		_mm_storeu_ps(&peak[4], max1);
+#else
+		memset(sum, 0, sizeof(sum));
+		memset(peak, 0, sizeof(peak));
+		for (UINT32 iFrame = 0; iFrame < n; ++iFrame, chunk += nChannels)
+		{
+			for (int iChan = 0; iChan < nLanes; ++iChan)
+			{
+				sum[iChan] += chunk[iChan] * chunk[iChan];
+				peak[iChan] = max(peak[iChan], fabsf(chunk[iChan]));
+			}
+		}
+#endif
 
-	delete m;
+		const float scalar = 1.0f / n;
+		for (int iChan = 0; iChan < nLanes; ++iChan)
+		{
+			const float sqrX = sum[iChan] * scalar;
+			const float absX = peak[iChan];
+			m_rms[iChan] = sqrX + kRMS[(sqrX < m_rms[iChan])] * (m_rms[iChan] - sqrX);
+			m_peak[iChan] = absX + kPeak[(absX < m_peak[iChan])] * (m_peak[iChan] - absX);
+		}
+	}
 }
 
-
 /**
-* (Re-)parse parameters from .ini file.
+* Demux a captured chunk into the ring buffer and measure RMS and peak levels.
 *
-* @param[in]	data			Measure instance pointer.
-* @param[in]	rm				Rainmeter context.
-* @param[out]	maxValue		?
+* @param[in]	chunk			Interleaved F32 frames.
+* @param[in]	nFrames			Number of frames in the chunk.
+* @param[in]	flags			Buffer flags of the capture client.
+* @return		Result value, S_FALSE if the ring buffer is filled with silence.
 */
-PLUGIN_EXPORT void Reload(void* data, void* rm, double* maxValue)
+HRESULT Parent::ProcessChunk(const float* chunk, UINT32 nFrames, DWORD flags)
 {
-	static const LPCWSTR s_typeName[Measure::NUM_TYPES] =
-	{
-		L"RMS",								// TYPE_RMS
-		L"Peak",							// TYPE_PEAK
-		L"FFT",								// TYPE_FFT
-		L"Wave",							// TYPE_WAVE
-		L"Band",							// TYPE_BAND
-		L"WaveBand",						// TYPE_WAVEBAND
-		L"FFTFreq",							// TYPE_FFTFREQ
-		L"BandFreq",						// TYPE_BANDFREQ
-		L"Format",							// TYPE_FORMAT
-		L"DeviceStatus",					// TYPE_DEV_STATUS
-		L"DeviceName",						// TYPE_DEV_NAME
-		L"DeviceID",						// TYPE_DEV_ID
-		L"DeviceList",						// TYPE_DEV_LIST
-		L"BufferStatus"						// TYPE_BUFFERSTATUS
-	};
+	// first silent check result (to process in the second silent check)
+	bool firstSilentCheckPassed = false;
 
-	static const LPCWSTR s_chanName[Measure::MAX_CHANNELS][3] =
-	{
-		{ L"L",		L"FL",		L"0", },	// CHANNEL_FL
-		{ L"R",		L"FR",		L"1", },	// CHANNEL_FR
-		{ L"C",		L"",		L"2", },	// CHANNEL_C
-		{ L"LFE",	L"Sub",		L"3", },	// CHANNEL_LFE
-		{ L"BL",	L"",		L"4", },	// CHANNEL_BL
-		{ L"BR",	L"",		L"5", },	// CHANNEL_BR
-		{ L"SL",	L"",		L"6", },	// CHANNEL_SL
-		{ L"SR",	L"",		L"7", },	// CHANNEL_SR
-		{ L"Sum",	L"Avg",		L"", },		// CHANNEL_SUM
-	};
+	// number of device frames that fill the ring buffer
+	const UINT32 ringFrames = m_decimator ? m_ringBufferSize << m_decimator->m_nStages : m_ringBufferSize;
 
-	Measure* m = (Measure*)data;
+	ALLOC_GUARD(m_warmup == 0);
+	PROFILE_START(mark);
+
+	// the loudness meter keeps integrating through silence
+	if (m_loudness)
+	{
+		m_loudness->Process(flags & AUDCLNT_BUFFERFLAGS_SILENT ? NULL : chunk, nFrames, m_wfx->nChannels);
+	}
+	if (m_truePeak)
+	{
+		m_truePeak->Process(flags & AUDCLNT_BUFFERFLAGS_SILENT ? NULL : chunk, nFrames, m_wfx->nChannels, m_kPeak);
+	}
+	if (m_ballistics)
+	{
+		m_ballistics->Process(flags & AUDCLNT_BUFFERFLAGS_SILENT ? NULL : chunk, nFrames, m_wfx->nChannels);
+	}
+	PROFILE_LAP(m_profile, STAGE_METERS, mark);
 
-	// parse data type
-	LPCWSTR type = RmReadString(rm, L"Type", L"");
-	if (*type)
+	// first test for discontinuity or silence (using audioclient flags)
+	if (flags & AUDCLNT_BUFFERFLAGS_SILENT) 
 	{
-		int iType;
-		for (iType = 0; iType < Measure::NUM_TYPES; ++iType)
+		// is the ring buffer filled with silence? then stop updating
+		if (m_nSilentFrames > ringFrames) 
 		{
-			if (_wcsicmp(type, s_typeName[iType]) == 0)
-			{
-				m->m_type = (Measure::Type)iType;
-				break;
-			}
+			m_silent = true;
+			return S_FALSE;
 		}
-
-		if (iType >= Measure::NUM_TYPES)
+		else 
 		{
-			WCHAR msg[512];
-			WCHAR* d = msg;
-			d += _snwprintf_s(d, (sizeof(msg) + (UINT32)msg - (UINT32)d) / sizeof(WCHAR), _TRUNCATE,
-				L"Invalid Type '%s', must be one of:", type);
-
-			for (int i = 0; i < Measure::NUM_TYPES; ++i)
+			// reset rms/peak because its silent
+			for (int iChan = 0; iChan < MAX_CHANNELS; ++iChan)
 			{
-				d += _snwprintf_s(d, (sizeof(msg) + (UINT32)msg - (UINT32)d) / sizeof(WCHAR), _TRUNCATE,
-					L"%s%s%s", i ? L", " : L" ", i == (Measure::NUM_TYPES - 1) ? L"or " : L"", s_typeName[i]);
+				m_rms[iChan] = 0.0;
+				m_peak[iChan] = 0.0;
 			}
 
-			d += _snwprintf_s(d, (sizeof(msg) + (UINT32)msg - (UINT32)d) / sizeof(WCHAR), _TRUNCATE, L".");
-			RmLogF(rm, LOG_ERROR, msg);
+			m_nSilentFrames += nFrames;
 		}
 	}
+	else if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
+	{
+		// not sure what to do with those frames... ignore them? use them? treat as silent frames?
+		// for now, ignore.
+		//continue;
+		firstSilentCheckPassed = true;
+	}
+	else 
+	{
+		// audio data is not silent, reset silent frames counter
+		firstSilentCheckPassed = true;
+	}
 
-	// parse channel specifier
-	LPCWSTR channel = RmReadString(rm, L"Channel", L"");
-	if (*channel)
+	const int nChannels = m_wfx->nChannels;
+
+	if (m_ringBufferSize)
 	{
-		bool found = false;
-		for (int iChan = 0; iChan <= Measure::CHANNEL_SUM && !found; ++iChan)
+		// demux streams: downmix each frame into the analysis channels, and store them in the planar ring buffers
+		int used[CHANNEL_SUM];
+		int nUsed = 0;
+		for (int iChan = 0; iChan < min(nChannels, (int)CHANNEL_SUM); ++iChan)
 		{
-			for (int j = 0; j < 3; ++j)
+			if (m_downmixMask & (1 << iChan)) used[nUsed++] = iChan;
+		}
+
+		const float* frame = chunk;
+		for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame, frame += nChannels)
+		{
+			float mix[DOWNMIX_LANES];
+			for (int iLane = 0; iLane < m_nAnalysis; iLane += 4)
 			{
-				if (_wcsicmp(channel, s_chanName[iChan][j]) == 0)
+#if (SIMD_SSE)
+				// 4 analysis channels at once: sum of the device channels times their weights
+				__m128 acc = _mm_setzero_ps();
+				for (int i = 0; i < nUsed; ++i)
 				{
-					m->m_channel = (Measure::Channel)iChan;
-					found = true;
-					break;
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(frame[used[i]]), _mm_loadu_ps(&m_downmix[used[i]][iLane])));
+				}
+				_mm_storeu_ps(&mix[iLane], acc);
+#else
+				for (int j = iLane; j < iLane + 4; ++j)
+				{
+					mix[j] = 0.0f;
+					for (int i = 0; i < nUsed; ++i)
+					{
+						mix[j] += frame[used[i]] * m_downmix[used[i]][j];
+					}
 				}
+#endif
 			}
-		}
 
-		if (!found)
-		{
-			WCHAR msg[512];
-			WCHAR* d = msg;
-			d += _snwprintf_s(d, (sizeof(msg) + (UINT32)msg - (UINT32)d) / sizeof(WCHAR), _TRUNCATE,
-				L"Invalid Channel '%s', must be an integer between 0 and %d, or one of:", channel, Measure::MAX_CHANNELS - 2);
+			// low-frequency analysis: only every 2^n-th frame reaches the ring buffers
+			if (m_decimator && !m_decimator->Push(mix)) continue;
 
-			for (int i = 0; i <= Measure::CHANNEL_SUM; ++i)
+			for (int iAna = 0; iAna < m_nAnalysis; ++iAna)
 			{
-				d += _snwprintf_s(d, (sizeof(msg) + (UINT32)msg - (UINT32)d) / sizeof(WCHAR), _TRUNCATE,
-					L"%s%s%s", i ? L", " : L" ", i == Measure::CHANNEL_SUM ? L"or " : L"", s_chanName[i][0]);
+				m_ringBuffer[iAna * m_ringBufferSize + m_ringBufW] = mix[iAna];
 			}
+			m_ringBufW = (m_ringBufW + 1) % m_ringBufferSize;	// move along the data-to-process buffer
 
-			d += _snwprintf_s(d, (sizeof(msg) + (UINT32)msg - (UINT32)d) / sizeof(WCHAR), _TRUNCATE, L".");
-			RmLogF(rm, LOG_ERROR, msg);
+			// with a hop size, the spectral frames follow the audio instead of the updates
+			if (m_hopSize && ++m_hopCount >= m_hopSize)
+			{
+				m_hopCount = 0;
+				PROFILE_LAP(m_profile, STAGE_DEINTERLEAVE, mark);
+				for (int iAna = 0; iAna < m_nAnalysis; ++iAna)
+				{
+					if (m_dynamicVolume) SpectrumFrame<true>(iAna);
+					else SpectrumFrame<false>(iAna);
+				}
+				PROFILE_SKIP(mark);
+			}
 		}
+		PROFILE_LAP(m_profile, STAGE_DEINTERLEAVE, mark);
 	}
 
-	// parse envelope, fft and band values on parents only
-	if (!m->m_parent)
+	if (m_ringBufferSize || m_type == Measure::TYPE_RMS || m_type == Measure::TYPE_PEAK)
+	{
+		// measure RMS and peak levels
+		if (m_envelopeMode == 1)
+		{
+			EnvelopeBlock(chunk, nFrames, nChannels);
+		}
+		else
+		{
+			EnvelopeSample(chunk, nFrames, nChannels);
+		}
+		PROFILE_LAP(m_profile, STAGE_ENVELOPE, mark);
+	}
+
+	// rms and peak values for sum channel
+	if (m_wfx->nChannels >= 2)
+	{
+		m_rms[Measure::CHANNEL_SUM] = (m_rms[Measure::CHANNEL_FL] + m_rms[Measure::CHANNEL_FR]) * 0.5f;
+		m_peak[Measure::CHANNEL_SUM] = (m_peak[Measure::CHANNEL_FL] + m_peak[Measure::CHANNEL_FR]) * 0.5f;
+	}
+	else
 	{
-		int fftSize = RmReadInt(rm, L"FFTSize", m->m_fftSize);
-		int fftBufferSize = max(m->m_fftSize, RmReadInt(rm, L"FFTBufferSize", m->m_fftBufferSize));
-		int nBands = RmReadInt(rm, L"Bands", m->m_nBands);
-		int smoothing = max(0, RmReadInt(rm, L"Smoothing", m->m_smoothing));
-		double freqMin = max(0.0, RmReadDouble(rm, L"FreqMin", m->m_freqMin));
-		double freqMax = max(0.0, RmReadDouble(rm, L"FreqMax", m->m_freqMax));
-		int waveSize = RmReadInt(rm, L"WAVESize", m->m_waveSize);
+		m_rms[Measure::CHANNEL_SUM] = m_rms[Measure::CHANNEL_FL];
+		m_peak[Measure::CHANNEL_SUM] = m_peak[Measure::CHANNEL_FL];
+	}
 
-		// if one of these values changed, reinitialize
-		if (m->m_fftSize		!= fftSize ||
-			m->m_fftBufferSize	!= fftBufferSize ||
-			m->m_freqMin		!= freqMin ||
-			m->m_freqMax		!= freqMax ||
-			m->m_waveSize		!= waveSize ||
-			m->m_nBands			!= nBands ||
-			m->m_smoothing		!= smoothing)
+	if (firstSilentCheckPassed)
+	{
+		// second silent check (using rms)
+		if ((m_rms[Measure::CHANNEL_SUM]) <= 0.0000001F)
 		{
-			// initialize FFT data
-			if (m->m_fftSize < 0 || m->m_fftSize & 1)
+			if (m_nSilentFrames > ringFrames)
 			{
-				RmLogF(rm, LOG_ERROR, L"Invalid FFTSize %ld: must be an even integer >= 0. (powers of 2 work best)", fftSize);
-				fftSize = 0;
+				m_silent = true;
+				return S_FALSE;
 			}
-			m->m_fftSize = fftSize;
-			m->m_fftBufferSize = fftBufferSize;
-
-			// initialize WAVE data
-			if (m->m_waveSize < 0 || m->m_waveSize & 1)
+			else 
 			{
-				RmLogF(rm, LOG_ERROR, L"Invalid WAVESize %ld: must be an even integer >= 0.", waveSize);
-				waveSize = 0;
+				m_nSilentFrames += nFrames;
 			}
-			m->m_waveSize = waveSize;
+		}
+		else
+		{
+			m_nSilentFrames = 0;
+		}
+	}
 
-			m->m_ringBufferSize = max(fftSize, waveSize);
+	m_silent = false;
+	return S_OK;
+}
 
-			// initialize frequency bands
-			if (nBands < 0)
-			{
-				RmLogF(rm, LOG_ERROR, L"Invalid Bands %ld: must be an integer >= 0.", nBands);
-				nBands = 0;
-			}
-			m->m_nBands = nBands;
+/**
+* Design the K-weighting filters for the sample rate of the stream, and reset the meter.
+*
+* @param[in]	wfx				Audio format of the stream.
+*/
+void Loudness::Init(const WAVEFORMATEX* wfx)
+{
+	const double fs = wfx->nSamplesPerSec;
 
-			// initialize smoothing
-			m->m_smoothing = smoothing;
-			if (m->m_smoothing)
-			{
-				m->m_smoothingScalar = 1.0f / ((float)m->m_smoothing * 2.0f + 1.0f);
-			}
+	// stage 1: high shelf, +4dB above ~1.7kHz (BS.1770 coefficients, redesigned for any sample rate)
+	{
+		const double f0 = 1681.974450955533;
+		const double G = 3.999843853973347;
+		const double Q = 0.7071752369554196;
+		const double K = tan(TWOPI * 0.5 * f0 / fs);
+		const double Vh = pow(10.0, G / 20.0);
+		const double Vb = pow(Vh, 0.4996667741545416);
+		const double a0 = 1.0 + K / Q + K * K;
+		m_shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+		m_shelf.b1 = 2.0 * (K * K - Vh) / a0;
+		m_shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+		m_shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+		m_shelf.a2 = (1.0 - K / Q + K * K) / a0;
+	}
 
-			// initialize min/max frequency
-			m->m_freqMin = freqMin;
-			m->m_freqMax = freqMax;
+	// stage 2: high-pass at ~38Hz
+	{
+		const double f0 = 38.13547087602444;
+		const double Q = 0.5003270373238773;
+		const double K = tan(TWOPI * 0.5 * f0 / fs);
+		const double a0 = 1.0 + K / Q + K * K;
+		m_highpass.b0 = 1.0;
+		m_highpass.b1 = -2.0;
+		m_highpass.b2 = 1.0;
+		m_highpass.a1 = 2.0 * (K * K - 1.0) / a0;
+		m_highpass.a2 = (1.0 - K / Q + K * K) / a0;
+	}
 
-			// setup ring buffer
-			if (m->m_ringBufferSize)
-			{
-				m->m_ringBuffer = (float*)calloc(m->m_ringBufferSize * sizeof(float), 1);
-				m->m_ringBufOut = (float*)calloc(max(m->m_ringBufferSize, m->m_fftBufferSize) * sizeof(float), 1);
-			}
+	// channel weights by position: the LFE channel is excluded, surround channels are weighted +1.5dB
+	for (int iChan = 0; iChan < Measure::CHANNEL_SUM; ++iChan)
+	{
+		m_weight[iChan] = iChan == Measure::CHANNEL_LFE ? 0.0 : iChan >= Measure::CHANNEL_BL ? 1.41 : 1.0;
+	}
 
-			// setup FFT buffers
-			if (m->m_fftSize)
-			{
-				m->m_fftKWdw = (float*)calloc(m->m_fftSize * sizeof(float), 1);
+	m_blockSize = max(1, (UINT32)(fs * 0.1 + 0.5));
+	Reset();
+}
 
-				m->m_fftCfg = pffft_new_setup(m->m_fftBufferSize, pffft_transform_t::PFFFT_REAL);
-				m->m_fftTmpOut = (float*)calloc(m->m_fftBufferSize * 2 * sizeof(float), 1);
+/**
+* Clear the filter states, windows and histograms, and start a new measurement.
+*/
+void Loudness::Reset()
+{
+	memset(m_z, 0, sizeof(m_z));
+	memset(m_blocks, 0, sizeof(m_blocks));
+	memset(m_gateCount, 0, sizeof(m_gateCount));
+	memset(m_gatePower, 0, sizeof(m_gatePower));
+	memset(m_rangeCount, 0, sizeof(m_rangeCount));
+	memset(m_rangePower, 0, sizeof(m_rangePower));
+	m_blockPos = 0;
+	m_blockSum = 0.0;
+	m_iBlock = 0;
+	m_nBlocks = 0;
+	m_momentary = s_floor;
+	m_shortTerm = s_floor;
+	m_integrated = s_floor;
+	m_range = 0.0;
+}
 
-				m->m_fftOut = (float*)calloc(m->m_fftBufferSize * sizeof(float), 1);
+/**
+* K-weight a captured chunk and accumulate it into the 100ms blocks.
+*
+* @param[in]	chunk			Interleaved F32 frames, or NULL for silence.
+* @param[in]	nFrames			Number of frames in the chunk.
+* @param[in]	nChannels		Number of channels per frame.
+*/
+void Loudness::Process(const float* chunk, UINT32 nFrames, int nChannels)
+{
+	const int nLanes = min(nChannels, (int)Measure::CHANNEL_SUM);
+	const Biquad s = m_shelf;
+	const Biquad h = m_highpass;
 
-				m->m_fftScalar = (float)(1.0 / sqrt(m->m_fftSize));
-				m->m_df = (float)m->m_wfx->nSamplesPerSec / m->m_fftBufferSize;
+	for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame)
+	{
+		double sum = 0.0;
+		for (int iChan = 0; iChan < nLanes; ++iChan)
+		{
+			if (m_weight[iChan] == 0.0) continue;
 
-				// zero-padding - https://jackschaedler.github.io/circles-sines-signals/zeropadding.html
-				for (int iBin = 0; iBin < m->m_fftBufferSize; ++iBin) m->m_ringBufOut[iBin] = 0.0;
+			const double x = chunk ? chunk[iChan] : 0.0;
+			double* z = m_z[iChan];
 
-				// calculate window function coefficients (http://en.wikipedia.org/wiki/Window_function#Hann_.28Hanning.29_window)
-				for (unsigned int iBin = 1; iBin < m->m_fftSize; ++iBin)
-					m->m_fftKWdw[iBin] = (float)(0.5 * (1.0 - cos(TWOPI * iBin / (m->m_fftSize + 1))));		// periodic version for FFT/spectral analysis
-				m->m_fftKWdw[0] = 0.0;
+			// transposed direct form II, both stages
+			const double y = s.b0 * x + z[0];
+			z[0] = s.b1 * x - s.a1 * y + z[1];
+			z[1] = s.b2 * x - s.a2 * y;
 
-				// calculate band frequencies and allocate band output buffers
-				if (m->m_nBands)
-				{
-					m->m_bandFreq = (float*)malloc(m->m_nBands * sizeof(float));
-					const double step = pow(2.0, (log(m->m_freqMax / m->m_freqMin) / m->m_nBands) / log(2.0));
-					m->m_bandFreq[0] = (float)(m->m_freqMin * step);
+			const double w = h.b0 * y + z[2];
+			z[2] = h.b1 * y - h.a1 * w + z[3];
+			z[3] = h.b2 * y - h.a2 * w;
 
-					m->m_bandScalar = 2.0f / (float)m->m_wfx->nSamplesPerSec;
-					m->m_bandOut = (float*)calloc(m->m_nBands * sizeof(float), 1);
+			sum += m_weight[iChan] * w * w;
+		}
+		if (chunk) chunk += nChannels;
 
-					for (int iBand = 1; iBand < m->m_nBands; ++iBand)
-					{
-						m->m_bandFreq[iBand] = (float)(m->m_bandFreq[iBand - 1] * step);
-					}
+		m_blockSum += sum;
+		if (++m_blockPos == m_blockSize)
+		{
+			EndBlock();
+		}
+	}
+}
 
-					if (m->m_smoothing) 
-					{
-						m->m_bandTmpOut = (float*)calloc(m->m_nBands * sizeof(float), 1);
-					}
-				}
-			}
+/**
+* Complete a 100ms block: update the momentary and short-term loudness, and add
+* the gating block (400ms, 75% overlap) and the short-term value to the histograms.
+*/
+void Loudness::EndBlock()
+{
+	m_blocks[m_iBlock] = m_blockSum / m_blockSize;
+	m_iBlock = (m_iBlock + 1) % s_nBlocks;
+	++m_nBlocks;
+	m_blockPos = 0;
+	m_blockSum = 0.0;
+
+	// mean squares of the sliding windows from the last block sums
+	double momentary = 0.0;
+	double shortTerm = 0.0;
+	for (int i = 1; i <= s_nBlocks; ++i)
+	{
+		const double block = m_blocks[(m_iBlock + s_nBlocks - i) % s_nBlocks];
+		if (i <= 4) momentary += block;
+		shortTerm += block;
+	}
+	momentary *= 0.25;
+	shortTerm *= 1.0 / s_nBlocks;
 
-			// setup WAVE buffers
-			if (m->m_waveSize)
-			{
-				m->m_waveOut = (float*)calloc(m->m_waveSize * sizeof(float), 1);
+	m_momentary = ToLUFS(momentary);
+	m_shortTerm = ToLUFS(shortTerm);
 
-				if (m->m_nBands)
-				{
-					m->m_dw = (float)m->m_waveSize / (float)m->m_nBands;
-					m->m_waveScalar = (float)(1.0f / m->m_dw);
-					m->m_waveBandOut = (float*)calloc(m->m_nBands * sizeof(float), 1);
+	// absolute gate: only blocks above -70 LUFS are histogrammed
+	if (m_nBlocks >= 4 && m_momentary > s_floor)
+	{
+		const int iBin = min(s_nBins - 1, (int)((m_momentary - s_floor) * 10.0));
+		++m_gateCount[iBin];
+		m_gatePower[iBin] += momentary;
+
+		// integrated: mean of the blocks above the relative gate (-10 LU)
+		int first;
+		double weight, nGated, sum;
+		Gate(m_gateCount, m_gatePower, -10.0, &first, &weight, &nGated, &sum);
+		m_integrated = nGated > 0.0 ? ToLUFS(sum / nGated) : s_floor;
+	}
 
-					// smoothing needs an additional temp buffer
-					if (m->m_smoothing)
-					{
-						m->m_waveBandTmpOut = (float*)calloc(m->m_nBands * sizeof(float), 1);
-					}
-				}
-			}
+	if (m_nBlocks >= s_nBlocks && m_shortTerm > s_floor)
+	{
+		const int iBin = min(s_nBins - 1, (int)((m_shortTerm - s_floor) * 10.0));
+		++m_rangeCount[iBin];
+		m_rangePower[iBin] += shortTerm;
+
+		// range: distance of the 10th and 95th percentiles above the relative gate (-20 LU)
+		int first;
+		double weight, nGated, sum;
+		Gate(m_rangeCount, m_rangePower, -20.0, &first, &weight, &nGated, &sum);
+
+		int iLow = -1, iHigh = -1;
+		double cum = 0.0;
+		for (int iBin = first; iBin < s_nBins && iHigh < 0; ++iBin)
+		{
+			cum += iBin == first ? m_rangeCount[iBin] * weight : m_rangeCount[iBin];
+			if (iLow < 0 && cum > nGated * 0.10) iLow = iBin;
+			if (cum > nGated * 0.95) iHigh = iBin;
 		}
+		m_range = iLow >= 0 && iHigh >= 0 ? (iHigh - iLow) * 0.1 : 0.0;
+	}
+}
 
-		// values that dont need fft/band reinitialization
-		m->m_dynamicVolume = max(0, RmReadInt(rm, L"DynamicVolume", m->m_dynamicVolume));
-		m->m_smoothingMode = min(max(0, RmReadInt(rm, L"SmoothingMode", m->m_smoothingMode)), 2);
+/**
+* Apply a relative gate to a loudness histogram.  The bin that contains the gate
+* is counted with the part of its 0.1 LU that lies above the gate.
+*
+* @param[in]	count			Number of values per bin.
+* @param[in]	power			Summed mean squares per bin.
+* @param[in]	relGate			Relative gate in LU, below the mean loudness of all values.
+* @param[out]	first			First bin above the gate, or containing it.
+* @param[out]	weight			Part of the first bin above the gate (0.0 to 1.0).
+* @param[out]	n				Number of values above the gate.
+* @param[out]	sum				Summed mean squares of the values above the gate.
+*/
+void Loudness::Gate(const UINT32* count, const double* power, double relGate, int* first, double* weight, double* n, double* sum)
+{
+	UINT64 nAll = 0;
+	double sumAll = 0.0;
+	for (int iBin = 0; iBin < s_nBins; ++iBin)
+	{
+		nAll += count[iBin];
+		sumAll += power[iBin];
+	}
 
-		// update wait time
-		m->m_updatesPerSecond = min(240, RmReadDouble(rm, L"UpdatesPerSecond", -1));
-		if (m->m_updatesPerSecond > 0) {
-			m->m_waitUpdate = std::chrono::duration<double>(1 / m->m_updatesPerSecond);
-		}
+	*first = 0;
+	*weight = 1.0;
+	*n = 0.0;
+	*sum = 0.0;
+	if (!nAll) return;
 
-		// (re)parse envelope values
-		m->m_envRMS[0] = max(0, RmReadInt(rm, L"RMSAttack", m->m_envRMS[0]));
-		m->m_envRMS[1] = max(0, RmReadInt(rm, L"RMSDecay", m->m_envRMS[1]));
-		m->m_envPeak[0] = max(0, RmReadInt(rm, L"PeakAttack", m->m_envPeak[0]));
-		m->m_envPeak[1] = max(0, RmReadInt(rm, L"PeakDecay", m->m_envPeak[1]));
-		m->m_envFFT[0] = max(0, RmReadInt(rm, L"FFTAttack", m->m_envFFT[0]));
-		m->m_envFFT[1] = max(0, RmReadInt(rm, L"FFTDecay", m->m_envFFT[1]));
+	// position of the gate in bins, the bin below it is split by the fractional part
+	const double gate = (ToLUFS(sumAll / nAll) + relGate - s_floor) * 10.0;
+	if (gate > 0.0)
+	{
+		*first = min(s_nBins, (int)gate);
+		*weight = 1.0 - (gate - *first);
+	}
 
-		// (re)parse gain constants
-		m->m_gainRMS = max(0.0, RmReadDouble(rm, L"RMSGain", m->m_gainRMS));
-		m->m_gainPeak = max(0.0, RmReadDouble(rm, L"PeakGain", m->m_gainPeak));
+	for (int iBin = *first; iBin < s_nBins; ++iBin)
+	{
+		const double w = iBin == *first ? *weight : 1.0;
+		*n += count[iBin] * w;
+		*sum += power[iBin] * w;
+	}
+}
+
+/**
+* Get the current value of the meter.
+*
+* @param[in]	mode			Loudness value to retrieve.
+* @return		Loudness in LUFS, or the loudness range in LU.
+*/
+double Loudness::Value(Measure::LoudnessMode mode) const
+{
+	switch (mode)
+	{
+	case Measure::LOUDNESS_MOMENTARY:	return m_momentary;
+	case Measure::LOUDNESS_SHORTTERM:	return m_shortTerm;
+	case Measure::LOUDNESS_INTEGRATED:	return m_integrated;
+	case Measure::LOUDNESS_RANGE:		return m_range;
+	default:							break;
+	}
 
-		m->m_sensitivity = 10 * log10(m->m_fftSize);	// default dynamic range/noise floor
-		m->m_sensitivity = 10 / max(1.0, RmReadDouble(rm, L"Sensitivity", m->m_sensitivity));
+	return s_floor;
+}
 
-		// regenerate filter constants
-		if (m->m_wfx)
-		{
-			const double freq = m->m_wfx->nSamplesPerSec;
-			m->m_kRMS[0] = (float)exp(log10(0.01) / (freq * (double)m->m_envRMS[0] * 0.001));
-			m->m_kRMS[1] = (float)exp(log10(0.01) / (freq * (double)m->m_envRMS[1] * 0.001));
-			m->m_kPeak[0] = (float)exp(log10(0.01) / (freq * (double)m->m_envPeak[0] * 0.001));
-			m->m_kPeak[1] = (float)exp(log10(0.01) / (freq * (double)m->m_envPeak[1] * 0.001));
+/**
+* Clear the filter history and the envelopes.
+*/
+void TruePeak::Reset()
+{
+	memset(m_history, 0, sizeof(m_history));
+	memset(m_peak, 0, sizeof(m_peak));
+}
 
-			if (m->m_fftSize)
+/**
+* Oversample a captured chunk and update the true-peak envelopes.
+*
+* @param[in]	chunk			Interleaved F32 frames, or NULL for silence.
+* @param[in]	nFrames			Number of frames in the chunk.
+* @param[in]	nChannels		Number of channels per frame.
+* @param[in]	kPeak			Peak attack/decay filter constants.
+*/
+void TruePeak::Process(const float* chunk, UINT32 nFrames, int nChannels, const float* kPeak)
+{
+	const int nLanes = min(nChannels, (int)Measure::CHANNEL_SUM);
+
+	while (nFrames)
+	{
+		const int n = (int)min(nFrames, (UINT32)s_block);
+
+		// deinterleave behind the history of the last block
+		for (int iChan = 0; iChan < nLanes; ++iChan)
+		{
+			float* x = &m_history[iChan][s_nTaps - 1];
+			for (int i = 0; i < n; ++i)
 			{
-				m->m_kFFT[0] = (float)exp(log10(0.01) / (freq * 0.001 * (double)m->m_envFFT[0] * 0.001));
-				m->m_kFFT[1] = (float)exp(log10(0.01) / (freq * 0.001 * (double)m->m_envFFT[1] * 0.001));
+				x[i] = chunk ? chunk[i * nChannels + iChan] : 0.0f;
 			}
 		}
 
-		if (!m->m_updateLoopThread && m->m_updatesPerSecond != -2)
+		for (int iChan = 0; iChan < nLanes; ++iChan)
 		{
-			// create separate thread with event-driven update loop
-			m->m_updateLoopThread = new std::thread(&Measure::DoCaptureLoop, m);
-			m->m_updateLoopThread->detach();
-		}
-		else if (m->m_updateLoopThread && m->m_updatesPerSecond == -2) 
-		{
-			SetEvent(m->m_hStopEvent);
-			//m->m_updateLoopThread->join();
-			//delete m->m_updateLoopThread;
-		}
-	}
+			float* h = m_history[iChan];
+			float env = m_peak[iChan];
 
-	// parse FFT index request
-	m->m_fftIdx = max(0, RmReadInt(rm, L"FFTIdx", m->m_fftIdx));
-	m->m_fftIdx = m->m_parent ?
-		min(m->m_parent->m_fftBufferSize / 2, m->m_fftIdx) :
-		min(m->m_fftBufferSize / 2, m->m_fftIdx);
+			for (int i = 0; i < n; ++i)
+			{
+				// x[i - k] is h[i + s_nTaps - 1 - k]
+				const float* x = &h[i + s_nTaps - 1];
+#if (SIMD_SSE)
+				__m128 acc = _mm_setzero_ps();
+				for (int k = 0; k < s_nTaps; ++k)
+				{
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(s_coef[k]), _mm_set1_ps(x[-k])));
+				}
+				acc = AbsLanes(acc);
+				acc = _mm_max_ps(acc, _mm_movehl_ps(acc, acc));
+				acc = _mm_max_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+				const float absX = _mm_cvtss_f32(acc);
+#else
+				float absX = 0.0f;
+				for (int iPhase = 0; iPhase < s_nPhases; ++iPhase)
+				{
+					float acc = 0.0f;
+					for (int k = 0; k < s_nTaps; ++k)
+					{
+						acc += s_coef[k][iPhase] * x[-k];
+					}
+					absX = max(absX, fabsf(acc));
+				}
+#endif
+				env = absX + kPeak[(absX < env)] * (env - absX);
+			}
 
-	// parse WAVE index request
-	m->m_waveIdx = max(0, RmReadInt(rm, L"WaveIdx", m->m_waveIdx));
-	m->m_waveIdx = m->m_parent ?
-		min(m->m_parent->m_waveSize, m->m_waveIdx) :
-		min(m->m_waveSize, m->m_waveIdx);
+			m_peak[iChan] = env;
+			memmove(h, &h[n], (s_nTaps - 1) * sizeof(float));
+		}
 
-	// parse band index request
-	m->m_bandIdx = max(0, RmReadInt(rm, L"BandIdx", m->m_bandIdx));
-	m->m_bandIdx = m->m_parent ?
-		min(m->m_parent->m_nBands, m->m_bandIdx) :
-		min(m->m_nBands, m->m_bandIdx);
+		if (chunk) chunk += n * nChannels;
+		nFrames -= n;
+	}
+
+	float peak = 0.0f;
+	for (int iChan = 0; iChan < nLanes; ++iChan)
+	{
+		peak = max(peak, m_peak[iChan]);
+	}
+	m_peak[Measure::CHANNEL_SUM] = peak;
 }
 
+/**
+* Get the true-peak level of a channel.
+*
+* @param[in]	channel			Channel, or CHANNEL_SUM for the maximum of all channels.
+* @return		Level in dBTP.
+*/
+double TruePeak::Value(Measure::Channel channel) const
+{
+	const float peak = m_peak[channel];
+	return peak > 0.0f ? max(s_floor, 20.0 * log10(peak)) : s_floor;
+}
 
 /**
-* Update the measure.
+* Derive the per-block constants from the sample rate and the options of the parent.
 *
-* @param[in]	data			Measure instance pointer.
-* @return		Latest value - typically an audio level between 0.0 and 1.0.
+* @param[in]	parent			Parent measure with a valid format.
 */
-PLUGIN_EXPORT double Update(void* data)
+void Ballistics::Configure(const Parent* parent)
 {
-	Measure* m = (Measure*)data;
-	Measure* parent = m->m_parent ? m->m_parent : m;
+	const double fs = parent->m_wfx->nSamplesPerSec;
+	const double dt = ENVELOPE_BLOCK / fs;
+	m_dt = (float)dt;
+
+	// full-wave rectified mean of a sine is 2/pi of its peak, calibrate to its RMS
+	m_vuGain = (float)(TWOPI * 0.25 / sqrt(2.0) / ENVELOPE_BLOCK);
+	m_vuScale = (float)pow(10.0, -parent->m_vuReference / 20.0);
+
+	// zeta = 0.8 overshoots 1.5%, w*t = 3.93 reaches 99% at t = 300ms
+	const double w = 3.9306 / 0.3;
+	m_vuW2 = (float)(w * w);
+	m_vuDamp = (float)(2.0 * 0.8 * w);
+
+	// Type I: a 5ms burst reads -2dB, 20dB return in 1.5s; Type II: 10ms burst, 24dB in 2.8s
+	const double burst = parent->m_ppmType == 1 ? 0.005 : 0.010;
+	const double fall = parent->m_ppmType == 1 ? 20.0 / 1.5 : 24.0 / 2.8;
+	const double tau = burst / -log(1.0 - pow(10.0, -2.0 / 20.0));
+	m_kPPMAttack = (float)exp(-dt / tau);
+	m_kPPMFall = (float)pow(10.0, -fall * dt / 20.0);
+
+	m_kHoldFall = (float)pow(10.0, -parent->m_fallRate * dt / 20.0);
+	m_holdBlocks = (float)(parent->m_holdTime * 0.001 / dt);
+	m_clipLevel = (float)pow(10.0, parent->m_clipLevel / 20.0);
+}
 
-	// rainmeter style update loop - not recommended
-	if (!m->m_parent && m->m_updatesPerSecond == -2)
-	{
-		HRESULT hr = m->UpdateParent();
+/**
+* Clear the integrators, the held peaks and the clip counters.
+*/
+void Ballistics::Reset()
+{
+	m_blockPos = 0;
+	memset(m_sumAbs, 0, sizeof(m_sumAbs));
+	memset(m_maxAbs, 0, sizeof(m_maxAbs));
+	memset(m_clips, 0, sizeof(m_clips));
+	memset(m_vu, 0, sizeof(m_vu));
+	memset(m_vuVel, 0, sizeof(m_vuVel));
+	memset(m_ppm, 0, sizeof(m_ppm));
+	ResetHold();
+}
 
-		switch (hr)
-		{
-		case S_OK:
-			// everything is fine, update measures
-			break;
-		case S_FALSE:
-			// silence detected, but ignore to still update other types of measures like FFTFREQ
-			break;
-		case AUDCLNT_E_BUFFER_ERROR:
-		case AUDCLNT_E_DEVICE_INVALIDATED:
-		case AUDCLNT_E_SERVICE_NOT_RUNNING:
-			// error detected, release device
-			m->DeviceRelease();
-			return 0.0;
-		}
-	}
+/**
+* Clear the held peaks and the clip counters.
+*/
+void Ballistics::ResetHold()
+{
+	memset(m_hold, 0, sizeof(m_hold));
+	memset(m_holdLeft, 0, sizeof(m_holdLeft));
+	memset(m_nClips, 0, sizeof(m_nClips));
+}
 
-	switch (m->m_type)
-	{
-	case Measure::TYPE_BAND:
-		if (parent->m_clCapture && parent->m_nBands && m->m_bandIdx < parent->m_nBands)
-		{
-			return parent->m_bandOut[m->m_bandIdx];
-		}
-		break;
-	case Measure::TYPE_WAVEBAND:
-		if (parent->m_clCapture && parent->m_nBands && parent->m_waveSize && m->m_bandIdx < parent->m_nBands)
-		{
-			return parent->m_waveBandOut[m->m_bandIdx];
-		}
-		break;
-	case Measure::TYPE_FFT:
-		if (parent->m_clCapture && parent->m_fftBufferSize && m->m_fftIdx < parent->m_fftBufferSize)
-		{
-			return max(0, parent->m_sensitivity * log10(CLAMP01(parent->m_fftOut[m->m_fftIdx])) + 1.0);
-		}
-		break;
-	case Measure::TYPE_FFTFREQ:
-		if (parent->m_clCapture && parent->m_fftBufferSize && m->m_fftIdx <= (parent->m_fftBufferSize * 0.5))
-		{
-			return ((float)m->m_fftIdx) * m->m_df;
-		}
-		break;
+/**
+* Accumulate a captured chunk into the blocks, and run the integrators on every completed block.
+*
+* @param[in]	chunk			Interleaved F32 frames, or NULL for silence.
+* @param[in]	nFrames			Number of frames in the chunk.
+* @param[in]	nChannels		Number of channels per frame.
+*/
+void Ballistics::Process(const float* chunk, UINT32 nFrames, int nChannels)
+{
+	static const float s_zero[8] = { 0 };
 
-	case Measure::TYPE_BANDFREQ:
-		if (parent->m_clCapture && parent->m_nBands && m->m_bandIdx < parent->m_nBands)
+	const int nLanes = min(nChannels, (int)Measure::CHANNEL_SUM);
+	const int stride = chunk ? nChannels : 0;
+	if (!chunk) chunk = s_zero;
+
+#if (SIMD_SSE)
+	const __m128 clipLevel = _mm_set1_ps(m_clipLevel);
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 sum0 = _mm_loadu_ps(&m_sumAbs[0]), sum1 = _mm_loadu_ps(&m_sumAbs[4]);
+	__m128 max0 = _mm_loadu_ps(&m_maxAbs[0]), max1 = _mm_loadu_ps(&m_maxAbs[4]);
+	__m128 clip0 = _mm_loadu_ps(&m_clips[0]), clip1 = _mm_loadu_ps(&m_clips[4]);
+
+	for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame, chunk += stride)
+	{
+		const __m128 x0 = AbsLanes(LoadLanes(chunk, min(nLanes, 4)));
+		const __m128 x1 = nLanes > 4 ? AbsLanes(LoadLanes(chunk + 4, nLanes - 4)) : _mm_setzero_ps();
+		sum0 = _mm_add_ps(sum0, x0);
+		sum1 = _mm_add_ps(sum1, x1);
+		max0 = _mm_max_ps(max0, x0);
+		max1 = _mm_max_ps(max1, x1);
+		clip0 = _mm_add_ps(clip0, _mm_and_ps(_mm_cmpge_ps(x0, clipLevel), one));
+		clip1 = _mm_add_ps(clip1, _mm_and_ps(_mm_cmpge_ps(x1, clipLevel), one));
+
+		if (++m_blockPos == ENVELOPE_BLOCK)
 		{
-			return parent->m_bandFreq[m->m_bandIdx];
+			_mm_storeu_ps(&m_sumAbs[0], sum0);
+			_mm_storeu_ps(&m_sumAbs[4], sum1);
+			_mm_storeu_ps(&m_maxAbs[0], max0);
+			_mm_storeu_ps(&m_maxAbs[4], max1);
+			_mm_storeu_ps(&m_clips[0], clip0);
+			_mm_storeu_ps(&m_clips[4], clip1);
+			EndBlock(nLanes);
+
+			sum0 = sum1 = max0 = max1 = clip0 = clip1 = _mm_setzero_ps();
 		}
-		break;
-	case Measure::TYPE_WAVE:
-		if (parent->m_clCapture && parent->m_waveSize && m->m_waveIdx < parent->m_waveSize)
+	}
+
+	_mm_storeu_ps(&m_sumAbs[0], sum0);
+	_mm_storeu_ps(&m_sumAbs[4], sum1);
+	_mm_storeu_ps(&m_maxAbs[0], max0);
+	_mm_storeu_ps(&m_maxAbs[4], max1);
+	_mm_storeu_ps(&m_clips[0], clip0);
+	_mm_storeu_ps(&m_clips[4], clip1);
+#else
+	for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame, chunk += stride)
+	{
+		for (int iChan = 0; iChan < nLanes; ++iChan)
 		{
-			return parent->m_waveOut[m->m_waveIdx];
+			const float x = fabsf(chunk[iChan]);
+			m_sumAbs[iChan] += x;
+			m_maxAbs[iChan] = max(m_maxAbs[iChan], x);
+			m_clips[iChan] += x >= m_clipLevel ? 1.0f : 0.0f;
 		}
-		break;
-	case Measure::TYPE_RMS:
-		if (parent->m_clCapture && parent->m_rms)
+
+		if (++m_blockPos == ENVELOPE_BLOCK)
 		{
-			return CLAMP01(sqrt(parent->m_rms[m->m_channel]) * parent->m_gainRMS);
+			EndBlock(nLanes);
+			memset(m_sumAbs, 0, sizeof(m_sumAbs));
+			memset(m_maxAbs, 0, sizeof(m_maxAbs));
+			memset(m_clips, 0, sizeof(m_clips));
 		}
-		break;
-	case Measure::TYPE_PEAK:
-		if (parent->m_clCapture && parent->m_peak)
+	}
+#endif
+}
+
+/**
+* Run the VU, PPM and peak hold integrators on a completed block, for all channels at once.
+*
+* @param[in]	nLanes			Number of channels.
+*/
+void Ballistics::EndBlock(int nLanes)
+{
+	m_blockPos = 0;
+
+#if (SIMD_SSE)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 dt = _mm_set1_ps(m_dt);
+	const __m128 vuGain = _mm_set1_ps(m_vuGain);
+	const __m128 vuW2 = _mm_set1_ps(m_vuW2);
+	const __m128 vuDamp = _mm_set1_ps(m_vuDamp);
+	const __m128 kAttack = _mm_set1_ps(m_kPPMAttack);
+	const __m128 kFall = _mm_set1_ps(m_kPPMFall);
+	const __m128 kHoldFall = _mm_set1_ps(m_kHoldFall);
+	const __m128 holdBlocks = _mm_set1_ps(m_holdBlocks);
+
+	for (int i = 0; i < nLanes; i += 4)
+	{
+		// VU: y'' = w^2 (x - y) - 2 zeta w y', semi-implicit Euler
+		const __m128 rect = _mm_mul_ps(_mm_loadu_ps(&m_sumAbs[i]), vuGain);
+		__m128 vu = _mm_loadu_ps(&m_vu[i]);
+		__m128 vel = _mm_loadu_ps(&m_vuVel[i]);
+		const __m128 acc = _mm_sub_ps(_mm_mul_ps(vuW2, _mm_sub_ps(rect, vu)), _mm_mul_ps(vuDamp, vel));
+		vel = _mm_add_ps(vel, _mm_mul_ps(acc, dt));
+		vu = _mm_add_ps(vu, _mm_mul_ps(vel, dt));
+		_mm_storeu_ps(&m_vu[i], vu);
+		_mm_storeu_ps(&m_vuVel[i], vel);
+
+		// PPM: integrate towards a higher peak, fall exponentially otherwise
+		const __m128 x = _mm_loadu_ps(&m_maxAbs[i]);
+		const __m128 ppm = _mm_loadu_ps(&m_ppm[i]);
+		const __m128 rise = _mm_cmpgt_ps(x, ppm);
+		const __m128 up = _mm_add_ps(x, _mm_mul_ps(kAttack, _mm_sub_ps(ppm, x)));
+		_mm_storeu_ps(&m_ppm[i], _mm_or_ps(_mm_and_ps(rise, up), _mm_andnot_ps(rise, _mm_mul_ps(ppm, kFall))));
+
+		// peak hold: a new peak restarts the hold time, after it the level falls
+		const __m128 hold = _mm_loadu_ps(&m_hold[i]);
+		const __m128 left = _mm_loadu_ps(&m_holdLeft[i]);
+		const __m128 peak = _mm_cmpge_ps(x, hold);
+		const __m128 holding = _mm_cmpgt_ps(left, zero);
+		const __m128 kept = _mm_or_ps(_mm_and_ps(holding, hold), _mm_andnot_ps(holding, _mm_mul_ps(hold, kHoldFall)));
+		_mm_storeu_ps(&m_hold[i], _mm_or_ps(_mm_and_ps(peak, x), _mm_andnot_ps(peak, kept)));
+		_mm_storeu_ps(&m_holdLeft[i], _mm_or_ps(_mm_and_ps(peak, holdBlocks), _mm_andnot_ps(peak, _mm_max_ps(zero, _mm_sub_ps(left, one)))));
+	}
+#else
+	for (int iChan = 0; iChan < nLanes; ++iChan)
+	{
+		const float rect = m_sumAbs[iChan] * m_vuGain;
+		const float acc = m_vuW2 * (rect - m_vu[iChan]) - m_vuDamp * m_vuVel[iChan];
+		m_vuVel[iChan] += acc * m_dt;
+		m_vu[iChan] += m_vuVel[iChan] * m_dt;
+
+		const float x = m_maxAbs[iChan];
+		m_ppm[iChan] = x > m_ppm[iChan] ? x + m_kPPMAttack * (m_ppm[iChan] - x) : m_ppm[iChan] * m_kPPMFall;
+
+		if (x >= m_hold[iChan])
 		{
-			return CLAMP01(parent->m_peak[m->m_channel] * parent->m_gainPeak);
+			m_hold[iChan] = x;
+			m_holdLeft[iChan] = m_holdBlocks;
 		}
-		break;
-	case Measure::TYPE_DEV_STATUS:
-		if (parent->m_dev)
+		else if (m_holdLeft[iChan] > 0.0f)
 		{
-			DWORD state;
-			if (parent->m_dev->GetState(&state) == S_OK && state == DEVICE_STATE_ACTIVE)
-			{
-				return 1.0;
-			}
+			m_holdLeft[iChan] = max(0.0f, m_holdLeft[iChan] - 1.0f);
 		}
-		break;
-	case Measure::TYPE_BUFFERSTATUS:
-		if (parent->m_nFramesNext > 0)
+		else
 		{
-			return parent->m_nFramesNext;
+			m_hold[iChan] *= m_kHoldFall;
 		}
-		break;
 	}
+#endif
 
-	return 0.0;
+	// clip counters, and the maximum of all channels
+	float vu = 0.0f, ppm = 0.0f, hold = 0.0f;
+	UINT64 nClips = 0;
+	for (int iChan = 0; iChan < nLanes; ++iChan)
+	{
+		m_nClips[iChan] += (UINT64)m_clips[iChan];
+		nClips += m_nClips[iChan];
+		vu = max(vu, m_vu[iChan]);
+		ppm = max(ppm, m_ppm[iChan]);
+		hold = max(hold, m_hold[iChan]);
+	}
+	m_vu[Measure::CHANNEL_SUM] = vu;
+	m_ppm[Measure::CHANNEL_SUM] = ppm;
+	m_hold[Measure::CHANNEL_SUM] = hold;
+	m_nClips[Measure::CHANNEL_SUM] = nClips;
 }
 
+/**
+* Get the current value of a meter.
+*
+* @param[in]	type			TYPE_VU, TYPE_PPM, TYPE_PEAKHOLD or TYPE_CLIP.
+* @param[in]	channel			Channel, or CHANNEL_SUM for the maximum (or the total clip count) of all channels.
+* @return		Level in VU or dBFS, or the number of clipped samples.
+*/
+double Ballistics::Value(Measure::Type type, Measure::Channel channel) const
+{
+	float level = 0.0f;
+	switch (type)
+	{
+	case Measure::TYPE_VU:			level = m_vu[channel] * m_vuScale; break;
+	case Measure::TYPE_PPM:			level = m_ppm[channel]; break;
+	case Measure::TYPE_PEAKHOLD:	level = m_hold[channel]; break;
+	case Measure::TYPE_CLIP:		return (double)m_nClips[channel];
+	default:						break;
+	}
+
+	return level > 0.0f ? max(s_floor, 20.0 * log10(level)) : s_floor;
+}
 
 /**
-* Indicates that the application working directory will not be reset by the plugin.
+* Set the meter used by a measure of this parent, on (re)load of a Loudness, TruePeak,
+* VU, PPM, PeakHold or Clip measure, or with 0 when the measure changes to another
+* type or is finalized.  A meter is carved from the arena while a measure uses it,
+* and released with its last measure, the other buffers are kept.
+*
+* @param[in]	m				The parent or one of its children.
+* @param[in]	meter			Meter used by the measure (Meter flag), or 0.
 */
-PLUGIN_EXPORT void OverrideDirectory()
+void Parent::UseMeter(Measure* m, int meter)
 {
+	if (m->m_meter == meter) return;
+
+	int meters = 0;
+	for (int iMeter = 0; iMeter < NUM_METERS; ++iMeter)
+	{
+		if (m->m_meter & (1 << iMeter)) --m_meterUsers[iMeter];
+		if (meter & (1 << iMeter)) ++m_meterUsers[iMeter];
+		if (m_meterUsers[iMeter] > 0) meters |= 1 << iMeter;
+	}
+	m->m_meter = meter;
+
+	if (meters == m_meters) return;
+
+	// keep the capture thread out of the pipeline while the arena is laid out again
+	std::unique_lock<std::mutex> lock;
+	if (m_endpoint)
+	{
+		lock = std::unique_lock<std::mutex>(m_endpoint->m_lock);
+	}
+
+	m_meters = meters;
+	if (m_arena)
+	{
+		BuffersInit(m_decimator ? m_decimator->m_nStages : 0, 0);
+	}
+	if (m_endpoint)
+	{
+		m_endpoint->ShareResults();
+	}
 }
 
+/**
+* Modified Bessel function of the first kind, order 0, for the Kaiser windows of
+* the decimator and the FFT.
+*/
+static double BesselI0(double x)
+{
+	double term = 1.0;
+	double sum = 1.0;
+	for (int k = 1; k < 64 && term > sum * 1e-12; ++k)
+	{
+		term *= (x * x) / (4.0 * k * k);
+		sum += term;
+	}
+
+	return sum;
+}
 
 /**
-* Get a string value from the measure.
+* Design the half-band filter and clear the delay lines.
 *
-* @param[in]	data			Measure instance pointer.
-* @return		String value - must be copied out by the caller.
+* @param[in]	nStages			Number of stages, the rate is divided by 2^nStages.
+* @param[in]	nChannels		Number of analysis channels.
 */
-PLUGIN_EXPORT LPCWSTR GetString(void* data)
+void Decimator::Init(int nStages, int nChannels)
 {
-	Measure* m = (Measure*)data;
-	Measure* parent = m->m_parent ? m->m_parent : m;
-
-	static WCHAR buffer[4096];
-	const WCHAR* s_fmtName[Measure::NUM_FORMATS] =
+	m_nStages = nStages;
+	m_nChannels = nChannels;
+
+	// windowed sinc at a quarter of the input rate, Kaiser window (beta 8, about -80dB)
+	const double beta = 8.0;
+	const int center = s_nTaps / 2;
+	double sum = 0.0;
+	for (int k = 0; k < s_nPairs; ++k)
 	{
-		L"<invalid>",	// FMT_INVALID
-		L"PCM 16b",		// FMT_PCM_S16
-		L"PCM 32b",		// FMT_PCM_F32
-	};
+		const int n = 2 * k + 1;
+		const double window = BesselI0(beta * sqrt(1.0 - (double)(n * n) / (center * center))) / BesselI0(beta);
 
-	buffer[0] = '\0';
+		m_coef[k] = (float)((k & 1 ? -1.0 : 1.0) / (TWOPI * 0.5 * n) * window);
+		sum += m_coef[k];
+	}
 
-	switch (m->m_type)
+	// unity gain at DC: the odd taps sum up to 0.25 on each side of the 0.5 center
+	for (int k = 0; k < s_nPairs; ++k)
 	{
-	default:
-		// return NULL for any numeric values, so Rainmeter can auto-convert them.
-		return NULL;
+		m_coef[k] = (float)(m_coef[k] * 0.25 / sum);
+	}
 
-	case Measure::TYPE_FORMAT:
-		if (parent->m_wfx)
+	memset(m_pos, 0, sizeof(m_pos));
+	memset(m_odd, 0, sizeof(m_odd));
+	memset(m_line, 0, sizeof(m_line));
+}
+
+/**
+* Feed one frame of the analysis channels through the cascade.
+*
+* @param[in,out]	frame		Samples of the analysis channels, replaced by the decimated ones.
+* @return		True if the last stage produced a frame.
+*/
+bool Decimator::Push(float* frame)
+{
+	const int center = s_nTaps / 2;
+
+	for (int iStage = 0; iStage < m_nStages; ++iStage)
+	{
+		const int pos = m_pos[iStage];
+		m_pos[iStage] = (pos + 1) & (s_nLine - 1);
+		for (int iChan = 0; iChan < m_nChannels; ++iChan)
 		{
-			_snwprintf_s(buffer, _TRUNCATE, L"%dHz %s %dch", parent->m_wfx->nSamplesPerSec,
-				s_fmtName[parent->m_format], parent->m_wfx->nChannels);
+			m_line[iStage][iChan][pos] = frame[iChan];
+			m_line[iStage][iChan][pos + s_nLine] = frame[iChan];
 		}
-		break;
 
-	case Measure::TYPE_DEV_NAME:
-		return parent->m_devName;
+		// every second input produces an output
+		m_odd[iStage] = !m_odd[iStage];
+		if (m_odd[iStage]) return false;
 
-	case Measure::TYPE_DEV_ID:
-		if (parent->m_dev)
+		const int first = (pos + s_nLine - (s_nTaps - 1)) & (s_nLine - 1);
+		for (int iChan = 0; iChan < m_nChannels; ++iChan)
 		{
-			LPWSTR pwszID = NULL;
-			if (parent->m_dev->GetId(&pwszID) == S_OK)
+			const float* x = &m_line[iStage][iChan][first + center];
+			float y = 0.5f * x[0];
+			for (int k = 0; k < s_nPairs; ++k)
 			{
-				_snwprintf_s(buffer, _TRUNCATE, L"%s", pwszID);
-				CoTaskMemFree(pwszID);
+				y += m_coef[k] * (x[-(2 * k + 1)] + x[2 * k + 1]);
 			}
+			frame[iChan] = y;
 		}
-		break;
+	}
 
-	case Measure::TYPE_DEV_LIST:
-		if (parent->m_enum)
-		{
-			IMMDeviceCollection* collection = NULL;
-			if (parent->m_enum->EnumAudioEndpoints(parent->m_port == Measure::PORT_OUTPUT ? eRender : eCapture,
-				DEVICE_STATE_ACTIVE | DEVICE_STATE_UNPLUGGED, &collection) == S_OK)
-			{
-				WCHAR* d = &buffer[0];
-				UINT nDevices;
-				collection->GetCount(&nDevices);
+	return true;
+}
 
-				for (ULONG iDevice = 0; iDevice < nDevices; ++iDevice)
-				{
-					IMMDevice* device = NULL;
-					IPropertyStore* props = NULL;
-					if (collection->Item(iDevice, &device) == S_OK && device->OpenPropertyStore(STGM_READ, &props) == S_OK)
-					{
-						LPWSTR id = NULL;
-						PROPVARIANT	varName;
-						PropVariantInit(&varName);
+/**
+* Find the number of stages that keeps FreqMax inside the clean passband.
+*
+* @param[in]	sampleRate		Device sample rate.
+* @param[in]	freqMax			Highest analyzed frequency.
+* @return		Number of stages.
+*/
+int Decimator::Stages(double sampleRate, double freqMax)
+{
+	// the 47-tap filter is alias free up to about 78% of the output Nyquist frequency
+	int nStages = 0;
+	while (nStages < s_maxStages && freqMax <= 0.78 * 0.5 * sampleRate / (2 << nStages))
+	{
+		++nStages;
+	}
 
-						if (device->GetId(&id) == S_OK && props->GetValue(PKEY_Device_FriendlyName, &varName) == S_OK)
-						{
-							d += _snwprintf_s(d, (sizeof(buffer) + (UINT32)buffer - (UINT32)d) / sizeof(WCHAR), _TRUNCATE,
-								L"%s%s: %s", iDevice > 0 ? L"\n" : L"", id, varName.pwszVal);
-						}
+	return nStages;
+}
 
-						if (id) CoTaskMemFree(id);
+/**
+* Clear the ring buffers, the decimator and the RMS/peak envelopes after a gap
+* in the stream, so audio from both sides of the gap is not spliced together.
+*/
+void Parent::ResetStream()
+{
+	if (m_ringBuffer)
+	{
+		memset(m_ringBuffer, 0, m_ringBufferSize * m_nAnalysis * sizeof(float));
+	}
 
-						PropVariantClear(&varName);
-					}
+	if (m_decimator)
+	{
+		m_decimator->Init(m_decimator->m_nStages, m_decimator->m_nChannels);
+	}
 
-					SAFE_RELEASE(props);
-					SAFE_RELEASE(device);
-				}
-			}
+	for (int iChan = 0; iChan < MAX_CHANNELS; ++iChan)
+	{
+		m_rms[iChan] = 0.0f;
+		m_peak[iChan] = 0.0f;
+	}
+}
 
-			SAFE_RELEASE(collection);
+/**
+* Sum of the 2n+1 bands around a band near the ends, where the smoothing mode decides
+* which band stands in for the ones past the ends.
+*
+* @param[in]	in				Band values.
+* @param[in]	nBands			Number of bands.
+* @param[in]	n				Smoothing level, bands on each side.
+* @param[in]	iBand			Center band.
+* @return		Sum of the bands.
+*/
+template <int SMOOTHING>
+inline float SmoothEdge(const float* in, int nBands, int n, int iBand)
+{
+	float x = 0;
+	for (int s = -n; s <= n; s++)
+	{
+		const int i = iBand + s;
+		if (SMOOTHING == DSPState::SMOOTH_HALF)
+		{
+			// pad: 0.5 at the ends
+			x += i < 0 || i >= nBands ? 0.5f : in[i];
+		}
+		else if (SMOOTHING == DSPState::SMOOTH_CLAMP)
+		{
+			// clamp: 1,2,3 at ends 3,3,3
+			x += in[i < 0 || i >= nBands ? iBand : i];
+		}
+		else if (SMOOTHING == DSPState::SMOOTH_REPEAT)
+		{
+			// repeat: 1,2,3 at ends 1,2,3
+			int j = i < 0 ? nBands + s : i;
+			j = j >= nBands ? s : j;
+			x += in[j];
+		}
+		else
+		{
+			// repeat reverse: 1,2,3 at ends: 3,2,1
+			int j = i < 0 ? -s : i;
+			j = j >= nBands ? nBands - s : j;
+			x += in[j];
 		}
-		break;
 	}
-
-	return buffer;
+	return x;
 }
 
-HRESULT Measure::UpdateParent()
+/**
+* Average of the bands iBand-n to iBand+n.  Away from the ends the window needs no
+* index checks, so only the n bands at each end take the smoothing mode into account.
+*
+* @param[in]	in				Band values.
+* @param[out]	out				Smoothed band values.
+* @param[in]	nBands			Number of bands.
+* @param[in]	n				Smoothing level, bands on each side.
+* @param[in]	scalar			1 / (2n+1).
+*/
+template <int SMOOTHING>
+void SmoothBands(const float* in, float* out, int nBands, int n, float scalar)
 {
-	BYTE* buffer;
-	UINT32 nFrames, m_nFramesNext;
-	DWORD  flags;
+	const int begin = min(n, nBands);
+	const int end = max(begin, nBands - n);
 
-	HRESULT hr = m_clCapture->GetNextPacketSize(&m_nFramesNext);
-	if (hr == S_OK)
+	for (int iBand = 0; iBand < begin; ++iBand)
 	{
-		if (m_nFramesNext <= 0) return S_FALSE;
-		
-		while (m_clCapture->GetBuffer(&buffer, &nFrames, &flags, NULL, NULL) == S_OK)
+		out[iBand] = SmoothEdge<SMOOTHING>(in, nBands, n, iBand) * scalar;
+	}
+
+	for (int iBand = begin; iBand < end; ++iBand)
+	{
+		float x = 0;
+		for (int s = -n; s <= n; s++)
 		{
-			// if not F32, convert to F32
-			if (m_format == Measure::FMT_PCM_F32)
-			{
-				memcpy(&m_bufChunk[0], &buffer[0], nFrames * m_wfx->nBlockAlign);
-			}
-			else if (m_format == Measure::FMT_PCM_S16)
-			{
-				INT16* buf = (INT16*)buffer;
-				for (int iPcm = 0; iPcm < nFrames * m_wfx->nChannels; ++iPcm)
-				{
-					m_bufChunk[iPcm] = (float)buf[iPcm] * pcmScalar;
-				}
-			}
+			x += in[iBand + s];
+		}
+		out[iBand] = x * scalar;
+	}
 
-			// release buffer immediately to resume capture
-			m_clCapture->ReleaseBuffer(nFrames);
+	for (int iBand = end; iBand < nBands; ++iBand)
+	{
+		out[iBand] = SmoothEdge<SMOOTHING>(in, nBands, n, iBand) * scalar;
+	}
+}
 
-			// first silent check result (to process in the second silent check)
-			bool firstSilentCheckPassed = false;
+/**
+* Run one spectral frame of an analysis channel: window the latest FFTSize samples
+* of its ring buffer, transform them, and filter the power spectrum into the
+* attack/decay smoothed FFT output.
+*
+* @param[in]	iAna			Analysis channel.
+*/
+template <bool DYNAMIC_VOLUME>
+void Parent::SpectrumFrame(int iAna)
+{
+	const float* ringBuffer = &m_ringBuffer[iAna * m_ringBufferSize];
+	float* fftOut = &m_fftOut[iAna * m_fftBufferSize];
 
-			// first test for discontinuity or silence (using audioclient flags)
-			if (flags & AUDCLNT_BUFFERFLAGS_SILENT) 
-			{
-				// is the ring buffer filled with silence? then stop updating
-				if (m_nSilentFrames > m_ringBufferSize) 
-				{
-					return S_FALSE;
-				}
-				else 
-				{
-					// reset rms/peak because its silent
-					for (int iChan = 0; iChan < MAX_CHANNELS; ++iChan)
-					{
-						m_rms[iChan] = 0.0;
-						m_peak[iChan] = 0.0;
-					}
+	PROFILE_START(mark);
 
-					m_nSilentFrames += nFrames;
-				}
-			}
-			else if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
-			{
-				// not sure what to do with those frames... ignore them? use them? treat as silent frames?
-				// for now, ignore.
-				//continue;
-				firstSilentCheckPassed = true;
-			}
-			else 
-			{
-				// audio data is not silent, reset silent frames counter
-				firstSilentCheckPassed = true;
-			}
+	// copy from the circular ring buffer to temp space
+	memcpy(&m_ringBufOut[0], &ringBuffer[m_ringBufW], (m_ringBufferSize - m_ringBufW) * sizeof(float));
+	memcpy(&m_ringBufOut[m_ringBufferSize - m_ringBufW], &ringBuffer[0], m_ringBufW * sizeof(float));
 
-			if (m_ringBufferSize)
-			{
-				// store data in ring buffers, demux streams, and measure RMS and peak levels
-				for (int iFrame = 0; iFrame < nFrames * m_wfx->nChannels;)
-				{
-					for (int iChan = 0; iChan < m_wfx->nChannels; ++iChan)
-					{
-						// store data in ring buffers, and demux streams
-						if (m_channel == Measure::CHANNEL_SUM)
-						{
-							if (iChan == Measure::CHANNEL_FL)
-							{
-								// cannot increment before evaluation
-								const float L = m_bufChunk[iFrame];
-
-								// stereo to mono: (L + R) / 2
-								m_ringBuffer[m_ringBufW] = 0.5f * (L + m_bufChunk[iFrame+1]);
-							}
-						}
-						else if (iChan == m_channel)
-						{
-							m_ringBuffer[m_ringBufW] = m_bufChunk[iFrame];
-						}
-						else { }	// move along the raw data buffer
-
-						// measure RMS and peak levels
-						float x = (float)m_bufChunk[iFrame++];
-						float sqrX = x * x;
-						float absX = abs(x);
-						m_rms[iChan] = sqrX + m_kRMS[(sqrX < m_rms[iChan])] * (m_rms[iChan] - sqrX);
-						m_peak[iChan] = absX + m_kPeak[(absX < m_peak[iChan])] * (m_peak[iChan] - absX);
-					}
-					m_ringBufW = (m_ringBufW + 1) % m_ringBufferSize;	// move along the data-to-process buffer
-				}
-			}
-			else if (m_type == Measure::TYPE_RMS || m_type == Measure::TYPE_PEAK) 
-			{
-				// measure RMS and peak levels
-				// loops unrolled for float, 16b and mono, stereo
-				for (int iFrame = 0; iFrame < nFrames * m_wfx->nChannels;)
-				{
-					for (int iChan = 0; iChan < m_wfx->nChannels; ++iChan)
-					{
-						float x = (float)m_bufChunk[iFrame++];
-						float sqrX = x * x;
-						float absX = abs(x);
-						m_rms[iChan] = sqrX + m_kRMS[(sqrX < m_rms[iChan])] * (m_rms[iChan] - sqrX);
-						m_peak[iChan] = absX + m_kPeak[(absX < m_peak[iChan])] * (m_peak[iChan] - absX);
-					}
-				}
-			}
+	// the FFT takes the latest m_fftSize samples, followed by the zero padding
+	float* fftIn = &m_ringBufOut[m_ringBufferSize - m_fftSize];
+	if (DYNAMIC_VOLUME && iAna == 0)
+	{
+		// apply the windowing function and calculate fft sized mean square
+		for (int iBin = 0; iBin < m_fftSize; ++iBin)
+		{
+			m_fftMeanSquare += fftIn[iBin] * fftIn[iBin];
+			fftIn[iBin] *= m_fftKWdw[iBin];
+		}
+		m_fftMeanSquare = m_fftMeanSquare / m_fftSize;
+		m_fftMeanSquare *= 10.0F;
+	}
+	else 
+	{
+		// apply the windowing function
+		for (int iBin = 0; iBin < m_fftSize; ++iBin)
+		{
+			fftIn[iBin] *= m_fftKWdw[iBin];
+		}
+	}
+	PROFILE_LAP(m_profile, STAGE_WINDOW, mark);
+
+	pffft_transform_ordered(m_fftCfg, fftIn, m_fftTmpOut, m_fftWork, pffft_direction_t::PFFFT_FORWARD);
+	PROFILE_LAP(m_profile, STAGE_FFT, mark);
+
+	const float kAttack = m_kFFT[0];
+	const float kDecay = m_kFFT[1];
+	const float fftScalar = m_fftScalar;
+	const float* fftTmpOut = m_fftTmpOut;
+	int iBin = 0;
+#if (SIMD_SSE)
+	// 4 bins at once: split the interleaved pairs, and pick the attack or decay constant with a mask
+	const __m128 attack = _mm_set1_ps(kAttack);
+	const __m128 decay = _mm_set1_ps(kDecay);
+	const __m128 scalar = _mm_set1_ps(fftScalar);
+	for (; iBin + 4 <= m_fftBufferSize; iBin += 4)
+	{
+		const __m128 lo = _mm_loadu_ps(&fftTmpOut[iBin * 2]);
+		const __m128 hi = _mm_loadu_ps(&fftTmpOut[iBin * 2 + 4]);
+		const __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const __m128 x0 = _mm_loadu_ps(&fftOut[iBin]);
+		const __m128 x1 = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)), scalar);
+		const __m128 falling = _mm_cmplt_ps(x1, x0);
+		const __m128 k = _mm_or_ps(_mm_and_ps(falling, decay), _mm_andnot_ps(falling, attack));
+		_mm_storeu_ps(&fftOut[iBin], _mm_add_ps(x1, _mm_mul_ps(k, _mm_sub_ps(x0, x1))));
+	}
+#endif
+	for (; iBin < m_fftBufferSize; ++iBin)
+	{
+		const int ifftBin = iBin * 2;
+
+		// old and new values
+		const float x0 = fftOut[iBin];
+		const float x1 = (fftTmpOut[ifftBin] * fftTmpOut[ifftBin] + fftTmpOut[ifftBin + 1] * fftTmpOut[ifftBin + 1]) * fftScalar;
+
+		fftOut[iBin] = x1 + (x1 < x0 ? kDecay : kAttack) * (x0 - x1);		// attack/decay filter
+	}
+	PROFILE_LAP(m_profile, STAGE_SPECTRUM, mark);
+}
+
+/**
+* Run the spectral stages of the pipeline on the contents of the ring buffer.  One
+* variant is compiled per combination of the options that are tested in the loops,
+* and SelectUpdate picks it when the settings change.
+*
+* @tparam		DYNAMIC_VOLUME	DynamicVolume is enabled.
+* @tparam		SMOOTHING		SmoothingMode, or SMOOTH_NONE without Smoothing.
+* @return		Result value, S_FALSE if silence was detected.
+*/
+template <bool DYNAMIC_VOLUME, int SMOOTHING>
+HRESULT Parent::UpdateSpectra()
+{
+	// after a few updates to settle, the processing path must not touch the heap
+	if (m_warmup) --m_warmup;
+	ALLOC_GUARD(m_warmup == 0);
 
-			// rms and peak values for sum channel
-			if (m_wfx->nChannels >= 2)
-			{
-				m_rms[Measure::CHANNEL_SUM] = (m_rms[Measure::CHANNEL_FL] + m_rms[Measure::CHANNEL_FR]) * 0.5f;
-				m_peak[Measure::CHANNEL_SUM] = (m_peak[Measure::CHANNEL_FL] + m_peak[Measure::CHANNEL_FR]) * 0.5f;
-			}
-			else
-			{
-				m_rms[Measure::CHANNEL_SUM] = m_rms[Measure::CHANNEL_FL];
-				m_peak[Measure::CHANNEL_SUM] = m_peak[Measure::CHANNEL_FL];
-			}
+	if (m_silent)
+	{
+		// the ring buffer is filled with silence, skip the spectral stages
+		PROFILE_END_FRAME(m_profile, true);
+		return S_FALSE;
+	}
 
-			if (firstSilentCheckPassed)
-			{
-				// second silent check (using rms)
-				if ((m_rms[Measure::CHANNEL_SUM]) <= 0.0000001F)
-				{
-					if (m_nSilentFrames > m_ringBufferSize)
-					{
-						return S_FALSE;
-					}
-					else 
-					{
-						m_nSilentFrames += nFrames;
-					}
-				}
-				else
-				{
-					m_nSilentFrames = 0;
-				}
-			}
-		}
+	PROFILE_START(mark);
+
+	// the analysis channels are processed as a batch, sharing the FFT setup and the temp buffers
+	for (int iAna = 0; iAna < m_nAnalysis; ++iAna)
+	{
+		const float* ringBuffer = &m_ringBuffer[iAna * m_ringBufferSize];
+		float* fftOut = &m_fftOut[iAna * m_fftBufferSize];
+		float* bandOut = &m_bandOut[iAna * m_nBands];
+		float* waveOut = &m_waveOut[iAna * m_waveSize];
+		float* waveBandOut = &m_waveBandOut[iAna * m_nBands];
 
 		// process FFTs
 		if (m_ringBufferSize)
 		{
-			// copy from the circular ring buffer to temp space
-			memcpy(&m_ringBufOut[0], &m_ringBuffer[m_ringBufW], (m_ringBufferSize - m_ringBufW) * sizeof(float));
-			memcpy(&m_ringBufOut[m_ringBufferSize - m_ringBufW], &m_ringBuffer[0], m_ringBufW * sizeof(float));
-
 			if (m_waveSize)
 			{
-				// copy waveform into wave output buffer
-				memcpy(&m_waveOut[0], &m_ringBufOut[m_ringBufferSize - m_waveSize], m_waveSize * sizeof(float));
+				// copy the latest waveform from the circular ring buffer into the wave output buffer
+				const int iStart = (m_ringBufW - m_waveSize + m_ringBufferSize) % m_ringBufferSize;
+				const int nFirst = min(m_waveSize, m_ringBufferSize - iStart);
+				memcpy(&waveOut[0], &ringBuffer[iStart], nFirst * sizeof(float));
+				memcpy(&waveOut[nFirst], &ringBuffer[0], (m_waveSize - nFirst) * sizeof(float));
 			}
+			PROFILE_LAP(m_profile, STAGE_WINDOW, mark);
 
-			if (m_fftSize)
+			// without a hop size, every update runs one spectral frame
+			if (m_fftSize && !m_hopSize)
 			{
-				if (m_dynamicVolume) 
-				{
-					// apply the windowing function and calculate fft sized mean square
-					for (int iBin = m_ringBufferSize - m_fftSize; iBin < m_fftSize; ++iBin)
-					{
-						m_fftMeanSquare += m_ringBufOut[iBin] * m_ringBufOut[iBin];
-						m_ringBufOut[iBin] *= m_fftKWdw[iBin];
-					}
-					m_fftMeanSquare = m_fftMeanSquare / m_fftSize;
-					m_fftMeanSquare *= 10.0F;
-				}
-				else 
-				{
-					// apply the windowing function
-					for (int iBin = m_ringBufferSize - m_fftSize; iBin < m_fftSize; ++iBin)
-					{
-						m_ringBufOut[iBin] *= m_fftKWdw[iBin];
-					}
-				}
-
-				pffft_transform_ordered(m_fftCfg, &m_ringBufOut[m_ringBufferSize - m_fftSize], m_fftTmpOut, NULL, pffft_direction_t::PFFFT_FORWARD);
-
-				int ifftBin;
-				for (int iBin = 0; iBin < m_fftBufferSize; ++iBin)
-				{
-					ifftBin = iBin * 2;
-
-					// old and new values
-					float x0 = m_fftOut[iBin];
-					const float x1 = (m_fftTmpOut[ifftBin] * m_fftTmpOut[ifftBin] + m_fftTmpOut[ifftBin + 1] * m_fftTmpOut[ifftBin + 1]) * m_fftScalar;
-
-					x0 = x1 + m_kFFT[(x1 < x0)] * (x0 - x1);		// attack/decay filter
-					m_fftOut[iBin] = x0;
-				}
+				SpectrumFrame<DYNAMIC_VOLUME>(iAna);
+				PROFILE_SKIP(mark);
 			}
 		}
 
@@ -1212,7 +4883,7 @@ HRESULT Measure::UpdateParent()
 			// if there are silent frames in the buffer, dont regulate the volume to allow a smooth fading into silence
 			float volumeScalar = 1;
 			float volumeScalar2 = 1;
-			if (m_dynamicVolume && m_nSilentFrames <= 0)
+			if (DYNAMIC_VOLUME && m_nSilentFrames <= 0)
 			{
 				//volumeScalar = m_rms[m_channel] > 0 ? (1 / (min(1, m_rms[m_channel] * 10))) : 1;
 				volumeScalar = m_fftMeanSquare > 0 ? (1 / (min(1, m_fftMeanSquare))) : 1;
@@ -1227,7 +4898,7 @@ HRESULT Measure::UpdateParent()
 				float w0 = 0.0f;
 
 				// use a temp buffer if smoothing is enabled, otherwise skip temp buffer
-				float* ptrWaveBuffer = m_smoothing ? m_waveBandTmpOut : m_waveBandOut;
+				float* ptrWaveBuffer = SMOOTHING != SMOOTH_NONE ? m_waveBandTmpOut : waveBandOut;
 				memset(ptrWaveBuffer, 0, m_nBands * sizeof(float));
 
 				while (iBin <= m_waveSize && iBand < m_nBands)
@@ -1238,33 +4909,27 @@ HRESULT Measure::UpdateParent()
 
 					if (wLin1 < bLin1)
 					{
-						y += (wLin1 - w0) * (m_waveOut[iBin]);
+						y += (wLin1 - w0) * (waveOut[iBin]);
 						w0 = wLin1;
 						iBin += 1;
 					}
 					else
 					{
-						y += (bLin1 - w0) * (m_waveOut[iBin]);
+						// the last band ends on the last sample, not past the buffer
+						y += (bLin1 - w0) * (waveOut[min(iBin, m_waveSize - 1)]);
 						y *= m_waveScalar * volumeScalar2 * 0.5f;
 						y += 0.5f;
 						w0 = bLin1;
 						iBand += 1;
 					}
 				}
+				PROFILE_LAP(m_profile, STAGE_BANDS, mark);
 
-				// smoothing
-				// calculate the average of the band indexes iBand-n to iBand+n (n = m_smoothing)
-				if (m_smoothing)
+				// smoothing, the wave bands are padded with their center value
+				if (SMOOTHING != SMOOTH_NONE)
 				{
-					for (iBand = 0; iBand < m_nBands; iBand++)
-					{
-						float x = 0;
-						for (int s = -m_smoothing; s <= m_smoothing; s++)
-						{
-							x += (iBand + s < 0) || (iBand + s >= m_nBands) ? 0.5f : ptrWaveBuffer[iBand + s];
-						}
-						m_waveBandOut[iBand] = x * m_smoothingScalar;
-					}
+					SmoothBands<SMOOTH_HALF>(m_waveBandTmpOut, waveBandOut, m_nBands, m_smoothing, m_smoothingScalar);
+					PROFILE_LAP(m_profile, STAGE_SMOOTHING, mark);
 				}
 			}
 
@@ -1276,7 +4941,7 @@ HRESULT Measure::UpdateParent()
 				float f0 = m_freqMin;
 
 				// use a temp buffer if smoothing is enabled, otherwise skip temp buffer
-				float* ptrBandBuffer = m_smoothing ? m_bandTmpOut : m_bandOut;
+				float* ptrBandBuffer = SMOOTHING != SMOOTH_NONE ? m_bandTmpOut : bandOut;
 				memset(ptrBandBuffer, 0, m_nBands * sizeof(float));
 
 				while (iBin <= (m_fftBufferSize * 0.5f) && iBand < m_nBands)
@@ -1287,13 +4952,13 @@ HRESULT Measure::UpdateParent()
 
 					if (fLin1 <= fLog1)
 					{
-						y += (fLin1 - f0) * m_fftOut[iBin];
+						y += (fLin1 - f0) * fftOut[iBin];
 						f0 = fLin1;
 						iBin += 1;
 					}
 					else
 					{
-						y += (fLog1 - f0) * m_fftOut[iBin];
+						y += (fLog1 - f0) * fftOut[iBin];
 						y *= m_bandScalar; // scaling
 						y *= volumeScalar; // dynamic volume
 						y = max(0, m_sensitivity * log10(CLAMP01(y)) + 1.0); // sensitivity
@@ -1301,61 +4966,36 @@ HRESULT Measure::UpdateParent()
 						iBand += 1;
 					}
 				}
+				PROFILE_LAP(m_profile, STAGE_BANDS, mark);
 
-				// smoothing
-				// calculate the average of the band indexes iBand-n to iBand+n (n = m_smoothing)
-				if (m_smoothing)
+				// smoothing, SmoothingMode decides which bands stand in for the ones past the ends
+				if (SMOOTHING != SMOOTH_NONE)
 				{
-					// smoothingMode decides what to do at values bigger than nBands or smaller than 0
-					if (m_smoothingMode == 0) 
-					{
-						// clamp: 1,2,3 at ends 3,3,3
-						for (iBand = 0; iBand < m_nBands; iBand++)
-						{
-							float x = 0;
-							for (int s = -m_smoothing; s <= m_smoothing; s++)
-							{
-								x += m_bandTmpOut[(iBand + s < 0) || (iBand + s >= m_nBands) ? iBand : iBand + s];
-							}
-							m_bandOut[iBand] = x * m_smoothingScalar;
-						}
-					}
-					else if (m_smoothingMode == 1)
-					{
-						// repeat: 1,2,3 at ends 1,2,3
-						for (iBand = 0; iBand < m_nBands; iBand++)
-						{
-							float x = 0;
-							for (int s = -m_smoothing; s <= m_smoothing; s++)
-							{
-								int i = iBand + s < 0 ? m_nBands + s : iBand + s;
-								i = i >= m_nBands ? s : i;
-								x += m_bandTmpOut[i];
-							}
-							m_bandOut[iBand] = x * m_smoothingScalar;
-						}
-					}
-					else // if (m_smoothingMode == 2)
-					{
-						// repeat reverse: 1,2,3 at ends: 3,2,1
-						for (iBand = 0; iBand < m_nBands; iBand++)
-						{
-							float x = 0;
-							for (int s = -m_smoothing; s <= m_smoothing; s++)
-							{
-								int i = iBand + s < 0 ? -s : iBand + s;
-								i = i >= m_nBands ? m_nBands - s : i;
-								x += m_bandTmpOut[i];
-							}
-							m_bandOut[iBand] = x * m_smoothingScalar;
-						}
-					}
+					SmoothBands<SMOOTHING>(m_bandTmpOut, bandOut, m_nBands, m_smoothing, m_smoothingScalar);
+					PROFILE_LAP(m_profile, STAGE_SMOOTHING, mark);
 				}
 			}
 		}
 	}
 
-	return hr;
+	PROFILE_END_FRAME(m_profile, false);
+	return S_OK;
+}
+
+/**
+* Pick the UpdateParent variant for the current DynamicVolume, Smoothing and SmoothingMode.
+*/
+void Parent::SelectUpdate()
+{
+	typedef HRESULT (Parent::*UpdateFunc)();
+	static const UpdateFunc s_variants[2][SMOOTH_NONE + 1] =
+	{
+		{ &Parent::UpdateSpectra<false, SMOOTH_CLAMP>, &Parent::UpdateSpectra<false, SMOOTH_REPEAT>, &Parent::UpdateSpectra<false, SMOOTH_REVERSE>, &Parent::UpdateSpectra<false, SMOOTH_NONE> },
+		{ &Parent::UpdateSpectra<true, SMOOTH_CLAMP>, &Parent::UpdateSpectra<true, SMOOTH_REPEAT>, &Parent::UpdateSpectra<true, SMOOTH_REVERSE>, &Parent::UpdateSpectra<true, SMOOTH_NONE> },
+	};
+
+	const int smoothing = m_smoothing ? min(max(0, m_smoothingMode), (int)SMOOTH_REVERSE) : SMOOTH_NONE;
+	m_updateParent = s_variants[m_dynamicVolume ? 1 : 0][smoothing];
 }
 
 
@@ -1364,12 +5004,12 @@ HRESULT Measure::UpdateParent()
 *
 * @return		Result value, S_OK on success.
 */
-HRESULT	Measure::DeviceInit()
+HRESULT	Endpoint::DeviceInit()
 {
 	HRESULT hr;
 
 	// get the device handle
-	assert(m_enum && m_dev);
+	assert(m_dev);
 
 	// store device name
 	IPropertyStore* props = NULL;
@@ -1392,7 +5032,7 @@ HRESULT	Measure::DeviceInit()
 	hr = m_dev->Activate(IID_IAudioClient, CLSCTX_ALL, NULL, (void**)&m_clBugAudio);
 	if (hr != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to create audio client for loopback events.");
+		RmLog(NULL, LOG_WARNING, L"Failed to create audio client for loopback events.");
 	}
 
 	// get the main audio client
@@ -1400,7 +5040,7 @@ HRESULT	Measure::DeviceInit()
 	//{
 	if (m_dev->Activate(IID_IAudioClient, CLSCTX_ALL, NULL, (void**)&m_clAudio) != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to create audio client.");
+		RmLog(NULL, LOG_WARNING, L"Failed to create audio client.");
 		goto Exit;
 	}
 	//}
@@ -1422,7 +5062,7 @@ HRESULT	Measure::DeviceInit()
 
 	if (m_clAudio->IsFormatSupported(AUDCLNT_SHAREMODE_SHARED, &m_wfxR, &m_wfx) != AUDCLNT_E_UNSUPPORTED_FORMAT)
 	{
-		m_format = FMT_PCM_F32;
+		m_format = Measure::FMT_PCM_F32;
 	}
 	else
 	{
@@ -1433,7 +5073,7 @@ HRESULT	Measure::DeviceInit()
 
 		if (m_clAudio->IsFormatSupported(AUDCLNT_SHAREMODE_SHARED, &m_wfxR, &m_wfx) != AUDCLNT_E_UNSUPPORTED_FORMAT)
 		{
-			m_format = FMT_PCM_S16;
+			m_format = Measure::FMT_PCM_S16;
 		}
 		else
 		{
@@ -1445,11 +5085,11 @@ HRESULT	Measure::DeviceInit()
 
 			if (m_clAudio->IsFormatSupported(AUDCLNT_SHAREMODE_SHARED, &m_wfxR, &m_wfx) != AUDCLNT_E_UNSUPPORTED_FORMAT)
 			{
-				m_format = FMT_PCM_S16;
+				m_format = Measure::FMT_PCM_S16;
 			}
 			else
 			{
-				RmLog(m_rm, LOG_WARNING, L"Invalid sample format.  Only PCM 16b integer or PCM 32b float are supported.");
+				RmLog(NULL, LOG_WARNING, L"Invalid sample format.  Only PCM 16b integer or PCM 32b float are supported.");
 				goto Exit;
 			}
 		}
@@ -1458,23 +5098,23 @@ HRESULT	Measure::DeviceInit()
 
 	hr = m_clBugAudio->Initialize(
 		AUDCLNT_SHAREMODE_SHARED,
-		(m_updatesPerSecond != -2 ? AUDCLNT_STREAMFLAGS_EVENTCALLBACK : 0),		// "Each time the client receives an event for the render stream, it must signal the capture client to run"
+		(!m_polled ? AUDCLNT_STREAMFLAGS_EVENTCALLBACK : 0),		// "Each time the client receives an event for the render stream, it must signal the capture client to run"
 		0,
 		0,
 		m_wfx,
 		NULL);
 	if (hr != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to initialize audio client for loopback events.");
+		RmLog(NULL, LOG_WARNING, L"Failed to initialize audio client for loopback events.");
 	}
 	EXIT_ON_ERROR(hr);
 
-	if (m_updatesPerSecond != -2)
+	if (!m_polled)
 	{
 		m_hReadyEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 		if (m_hReadyEvent == NULL)
 		{
-			RmLog(m_rm, LOG_WARNING, L"Failed to create buffer-event handle.");
+			RmLog(NULL, LOG_WARNING, L"Failed to create buffer-event handle.");
 			hr = E_FAIL;
 			goto Exit;
 		}
@@ -1490,7 +5130,7 @@ HRESULT	Measure::DeviceInit()
 	// ---------------------------------------------------------------------------------------
 	// Windows bug workaround: create a silent render client before initializing loopback mode
 	// see: http://social.msdn.microsoft.com/Forums/windowsdesktop/en-US/c7ba0a04-46ce-43ff-ad15-ce8932c00171/loopback-recording-causes-digital-stuttering?forum=windowspro-audiodevelopment
-	if (m_port == PORT_OUTPUT)
+	if (m_port == Measure::PORT_OUTPUT)
 	{
 		hr = m_clBugAudio->GetService(IID_IAudioRenderClient, (void**)&m_clBugRender);
 		EXIT_ON_ERROR(hr);
@@ -1512,7 +5152,7 @@ HRESULT	Measure::DeviceInit()
 	hr = m_clBugAudio->Start();
 	if (hr != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to start the stream for loopback events.");
+		RmLog(NULL, LOG_WARNING, L"Failed to start the stream for loopback events.");
 	}
 	EXIT_ON_ERROR(hr);
 
@@ -1529,7 +5169,7 @@ HRESULT	Measure::DeviceInit()
 
 	if (((IAudioClient3*)m_clAudio)->SetClientProperties(&props) != S_OK)
 	{
-	RmLog(m_rm, LOG_WARNING, L"Failed to set audio client properties.");
+	RmLog(NULL, LOG_WARNING, L"Failed to set audio client properties.");
 	goto Exit;
 	}
 
@@ -1538,24 +5178,24 @@ HRESULT	Measure::DeviceInit()
 	EXIT_ON_ERROR(hr);
 
 	// 0x88890021 AUDCLNT_E_INVALID_STREAM_FLAG - Loopback not supported?
-	hr = ((IAudioClient3*)m_clAudio)->InitializeSharedAudioStream((m_port == PORT_OUTPUT ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0)
+	hr = ((IAudioClient3*)m_clAudio)->InitializeSharedAudioStream((m_port == Measure::PORT_OUTPUT ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0)
 	, minFrames, m_wfx, NULL);
 	if (hr != S_OK)
 	{
-	RmLog(m_rm LOG_WARNING, L"Failed to initialize audio client (3).");
+	RmLog(NULL, LOG_WARNING, L"Failed to initialize audio client (3).");
 	goto Exit;
 	}
 	} else */
 
 	if (m_clAudio->Initialize(
 		AUDCLNT_SHAREMODE_SHARED,
-		(m_port == PORT_OUTPUT ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0),
+		(m_port == Measure::PORT_OUTPUT ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0),
 		0,
 		0,
 		m_wfx,
 		NULL) != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to initialize loopback audio client.");
+		RmLog(NULL, LOG_WARNING, L"Failed to initialize loopback audio client.");
 		goto Exit;
 	}
 
@@ -1563,7 +5203,7 @@ HRESULT	Measure::DeviceInit()
 	hr = m_clAudio->GetService(IID_IAudioCaptureClient, (void**)&m_clCapture);
 	if (hr != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to create audio capture client.");
+		RmLog(NULL, LOG_WARNING, L"Failed to create audio capture client.");
 	}
 	EXIT_ON_ERROR(hr);
 
@@ -1571,7 +5211,7 @@ HRESULT	Measure::DeviceInit()
 	hr = m_clAudio->Start();
 	if (hr != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to start the stream.");
+		RmLog(NULL, LOG_WARNING, L"Failed to start the stream.");
 	}
 	EXIT_ON_ERROR(hr);
 
@@ -1580,17 +5220,18 @@ HRESULT	Measure::DeviceInit()
 	hr = m_clAudio->GetBufferSize(&nMaxFrames);
 	if (hr != S_OK)
 	{
-		RmLog(m_rm, LOG_WARNING, L"Failed to determine max buffer size.");
+		RmLog(NULL, LOG_WARNING, L"Failed to determine max buffer size.");
 	}
 	EXIT_ON_ERROR(hr);
 
 	m_bufChunk = (float*)calloc(nMaxFrames * m_wfx->nBlockAlign * sizeof(float), 1);
+	m_bufFrames = nMaxFrames;
 
 	return S_OK;
 
 Exit:
 	DeviceRelease();
-	RmLogF(m_rm, LOG_ERROR, L"AudioLevel: Failed with HRESULT  %d", (int)hr);
+	RmLogF(NULL, LOG_ERROR, L"AudioLevel: Failed with HRESULT  %d", (int)hr);
 	return hr;
 }
 
@@ -1598,10 +5239,10 @@ Exit:
 /**
 * Release handles to audio resources.  (except the enumerator)
 */
-void Measure::DeviceRelease()
+void Endpoint::DeviceRelease()
 {
 
-	RmLog(m_rm, LOG_DEBUG, L"Releasing dummy stream audio device.");
+	RmLog(NULL, LOG_DEBUG, L"Releasing dummy stream audio device.");
 	if (m_clBugAudio)
 	{
 		m_clBugAudio->Stop();
@@ -1611,7 +5252,7 @@ void Measure::DeviceRelease()
 #endif
 	SAFE_RELEASE(m_clBugAudio);
 
-	RmLog(m_rm, LOG_DEBUG, L"Releasing audio device.");
+	RmLog(NULL, LOG_DEBUG, L"Releasing audio device.");
 
 	if (m_clAudio)
 	{
@@ -1622,61 +5263,511 @@ void Measure::DeviceRelease()
 	SAFE_RELEASE(m_clAudio);
 	SAFE_RELEASE(m_dev);
 
-	if (m_hReadyEvent != NULL) { CloseHandle(m_hReadyEvent); }
-	if (m_hStopEvent != NULL) { CloseHandle(m_hStopEvent); }
-	//if (m_hTask != NULL) { AvRevertMmThreadCharacteristics(m_hTask); }
+	if (m_bufChunk) free(m_bufChunk);
+	m_bufChunk = NULL;
 
-	delete m_updateLoopThread;
+	m_devName[0] = '\0';
+	m_format = Measure::FMT_INVALID;
+}
 
-	if (m_fftCfg) pffft_destroy_setup(m_fftCfg);
-	m_fftCfg = NULL;
 
-	if (m_bufChunk) free(m_bufChunk);
-	m_bufChunk = NULL;
+/**
+* Sine of a small angle, by its Taylor series (compile-time).
+*/
+constexpr double ConstSin(double x)
+{
+	double term = x;
+	double sum = x;
+	for (int i = 1; i < 12; ++i)
+	{
+		term *= -x * x / ((2 * i) * (2 * i + 1));
+		sum += term;
+	}
+	return sum;
+}
 
-	if (m_ringBuffer) free(m_ringBuffer);
-	m_ringBuffer = NULL;
+/**
+* Natural logarithm, by the series of atanh after reducing x to [1, 2) (compile-time).
+*/
+constexpr double ConstLog(double x)
+{
+	int e = 0;
+	for (; x >= 2.0; x *= 0.5) ++e;
+	for (; x < 1.0; x *= 2.0) --e;
+
+	const double y = (x - 1.0) / (x + 1.0);
+	double term = y;
+	double sum = 0.0;
+	for (int i = 1; i < 64; i += 2)
+	{
+		sum += term / i;
+		term *= y * y;
+	}
+	return 2.0 * sum + e * 0.69314718055994530942;
+}
 
-	if (m_fftOut) free(m_fftOut);
-	m_fftOut = NULL;
+/**
+* Exponential of a small argument, by its Taylor series (compile-time).
+*/
+constexpr double ConstExp(double x)
+{
+	double term = 1.0;
+	double sum = 1.0;
+	for (int i = 1; i < 30; ++i)
+	{
+		term *= x / i;
+		sum += term;
+	}
+	return sum;
+}
 
-	if (m_bandOut) free(m_bandOut);
-	m_bandOut = NULL;
+/**
+* Periodic Hann window of N bins, generated at compile time.  The half angle is
+* rotated from bin to bin, and the window is its squared sine, which stays accurate
+* in the small coefficients at both ends.  Each bin takes tens of evaluation steps,
+* so the sizes stay far below the default /constexpr:steps limit of MSVC (1048576),
+* and the larger windows are computed at run time by WindowInit.
+*/
+template <int N>
+struct HannTable
+{
+	float					w[N];
 
-	if (m_bandTmpOut) free(m_bandTmpOut);
-	m_bandTmpOut = NULL;
+	constexpr HannTable() : w()
+	{
+		const double half = TWOPI / (2.0 * (N + 1));
+		const double s1 = ConstSin(half);
+		const double c1 = ConstSin(TWOPI / 4.0 - half);
+		double s = 0.0;
+		double c = 1.0;
+		for (int i = 1; i < N; ++i)
+		{
+			const double t = s * c1 + c * s1;
+			c = c * c1 - s * s1;
+			s = t;
+			w[i] = (float)(s * s);
+		}
+	}
+};
 
-	if (m_waveBandOut) free(m_waveBandOut);
-	m_waveBandOut = NULL;
+/**
+* Band frequencies of N log-spaced bands between two frequencies, generated at
+* compile time the same way BuffersInit computes them.
+*/
+template <int N>
+struct BandTable
+{
+	float					f[N];
 
-	if (m_waveOut) free(m_waveOut);
-	m_waveOut = NULL;
+	constexpr BandTable(double freqMin, double freqMax) : f()
+	{
+		const double step = ConstExp(ConstLog(freqMax / freqMin) / N);
+		f[0] = (float)(freqMin * step);
+		for (int i = 1; i < N; ++i)
+		{
+			f[i] = (float)(f[i - 1] * step);
+		}
+	}
+};
 
-	if (m_waveBandTmpOut) free(m_waveBandTmpOut);
-	m_waveBandTmpOut = NULL;
+static constexpr HannTable<256> s_hann256;
+static constexpr HannTable<512> s_hann512;
+static constexpr HannTable<1024> s_hann1024;
+static constexpr HannTable<2048> s_hann2048;
 
-	for (int iChan = 0; iChan < Measure::MAX_CHANNELS; ++iChan)
+static constexpr BandTable<16> s_bands16(20.0, 20000.0);
+static constexpr BandTable<32> s_bands32(20.0, 20000.0);
+static constexpr BandTable<64> s_bands64(20.0, 20000.0);
+static constexpr BandTable<128> s_bands128(20.0, 20000.0);
+static constexpr BandTable<256> s_bands256(20.0, 20000.0);
+
+/**
+* Window coefficients of one of the standard FFT sizes.
+*
+* @param[in]	fftSize			FFT size.
+* @return		Compile-time table, or NULL if it has to be computed.
+*/
+const float* HannWindow(int fftSize)
+{
+	switch (fftSize)
 	{
-		m_rms[iChan] = 0.0;
-		m_peak[iChan] = 0.0;
+	case 256:	return s_hann256.w;
+	case 512:	return s_hann512.w;
+	case 1024:	return s_hann1024.w;
+	case 2048:	return s_hann2048.w;
+	}
+	return NULL;
+}
+
+/**
+* Band frequencies of one of the common band presets, with the default FreqMin and FreqMax.
+*
+* @param[in]	nBands			Number of bands.
+* @param[in]	freqMin			Lower frequency of the first band.
+* @param[in]	freqMax			Upper frequency of the last band.
+* @return		Compile-time table, or NULL if it has to be computed.
+*/
+const float* BandFrequencies(int nBands, double freqMin, double freqMax)
+{
+	if (freqMin != 20.0 || freqMax != 20000.0) return NULL;
+
+	switch (nBands)
+	{
+	case 16:	return s_bands16.f;
+	case 32:	return s_bands32.f;
+	case 64:	return s_bands64.f;
+	case 128:	return s_bands128.f;
+	case 256:	return s_bands256.f;
+	}
+	return NULL;
+}
+
+/**
+* Compute the coefficients of a window function.  All windows are scaled to the
+* coherent gain of the Hann window of previous versions, so a sine wave keeps its
+* level in the spectrum whichever window is selected.
+*
+* @param[out]	w				Coefficients.
+* @param[in]	n				Window size.
+* @param[in]	window			Window function.
+* @param[in]	beta			Shape of the Kaiser window.
+*/
+void WindowInit(float* w, int n, Measure::Window window, double beta)
+{
+	// cosine-sum windows (https://en.wikipedia.org/wiki/Window_function#Cosine-sum_windows)
+	static const double s_cosineSum[Measure::NUM_WINDOWS][5] =
+	{
+		{ 0.5, 0.5 },												// Hann
+		{ 0.54, 0.46 },												// Hamming
+		{ 0.42, 0.5, 0.08 },										// Blackman
+		{ 0.35875, 0.48829, 0.14128, 0.01168 },						// Blackman-Harris
+		{ 0.355768, 0.487396, 0.144232, 0.012604 },					// Nuttall
+		{ 0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368 },	// flat top
+		{ 0 },														// Kaiser
+		{ 1.0 },													// rectangular
+	};
+
+	if (window == Measure::WINDOW_HANN)
+	{
+		// periodic version of previous versions (http://en.wikipedia.org/wiki/Window_function#Hann_.28Hanning.29_window)
+		for (int i = 1; i < n; ++i)
+			w[i] = (float)(0.5 * (1.0 - cos(TWOPI * i / (n + 1))));
+		w[0] = 0.0;
+		return;
 	}
 
-	if (m_bandFreq)
+	double sum = 0.0;
+	if (window == Measure::WINDOW_KAISER)
 	{
-		free(m_bandFreq);
-		m_bandFreq = NULL;
+		const double scalar = 1.0 / BesselI0(beta);
+		for (int i = 0; i < n; ++i)
+		{
+			const double x = 2.0 * i / n - 1.0;
+			w[i] = (float)(BesselI0(beta * sqrt(1.0 - x * x)) * scalar);
+			sum += w[i];
+		}
+	}
+	else
+	{
+		// periodic windows, denominator n
+		const double* a = s_cosineSum[window];
+		for (int i = 0; i < n; ++i)
+		{
+			double x = 0.0;
+			for (int k = 0; k < 5; ++k)
+			{
+				x += (k & 1 ? -a[k] : a[k]) * cos(TWOPI * k * i / n);
+			}
+			w[i] = (float)x;
+			sum += w[i];
+		}
 	}
 
-	if (m_fftTmpOut)
+	// fold the gain correction into the coefficients, the Hann window above sums to (n + cos(2 pi / (n + 1))) / 2
+	const double gain = 0.5 * (n + cos(TWOPI / (n + 1))) / sum;
+	for (int i = 0; i < n; ++i)
 	{
-		free(m_fftTmpOut);
-		free(m_ringBufOut);
-		free(m_fftKWdw);
-		m_fftTmpOut = NULL;
-		m_ringBufOut = NULL;
-		m_fftKWdw = NULL;
+		w[i] = (float)(w[i] * gain);
 	}
+}
 
-	m_devName[0] = '\0';
-	m_format = FMT_INVALID;
+/**
+* Carve the ring buffers, the FFT, band and wave buffers for the current settings
+* and the requested meters from the arena, and compute the window function and the band frequencies.  The arena
+* is sized from the settings and reused as a whole when they change, so neither a
+* reload nor the processing path allocates per buffer.
+*
+* Only the stages in rebuild start over.  The others and the meters keep their contents, moved to
+* their new place if the layout changed, and a resized ring buffer keeps its latest
+* samples, so a reload doesn't blank the visuals.
+*
+* @param[in]	nStages			Number of decimation stages ahead of the ring buffers.
+* @param[in]	rebuild			Stages to rebuild, combination of Parent::Rebuild flags.
+*/
+void Parent::BuffersInit(int nStages, int rebuild)
+{
+	static const size_t s_align = 64;					// cache line, also satisfies the SIMD loads of pffft
+
+	if (!m_arena) rebuild = REBUILD_ALL;
+
+	const int ringSize = m_ringBufferSize;
+	m_ringBufferSize = max(m_fftSize, m_waveSize);
+
+	const bool decimate = nStages && m_ringBufferSize;
+	const bool fft = m_fftSize != 0;
+	const bool fftBands = fft && m_nBands;
+	const bool wave = m_waveSize != 0;
+	const bool waveBands = wave && m_nBands;
+
+	// standard window sizes and band presets come from compile-time tables
+	const float* window = fft && m_window == WINDOW_HANN ? HannWindow(m_fftSize) : NULL;
+	const float* bandFreq = fftBands ? BandFrequencies(m_nBands, m_freqMin, m_freqMax) : NULL;
+	float* windowOut = NULL;
+	float* bandFreqOut = NULL;
+
+	// buffers of the previous settings that are carried over, NULL if their stage is rebuilt
+	const float* ringBuffer = rebuild & REBUILD_RING ? NULL : m_ringBuffer;
+	const void* keepDecimator = rebuild & REBUILD_RING ? NULL : m_decimator;
+	const void* keepRing = ringSize == m_ringBufferSize ? ringBuffer : NULL;
+	const void* keepSpectrum = rebuild & REBUILD_FFT ? NULL : m_fftOut;
+	const void* keepWindow = rebuild & REBUILD_WINDOW ? NULL : m_fftKWdw;
+	const void* keepBandFreq = rebuild & REBUILD_BANDS ? NULL : m_bandFreq;
+	const void* keepLoudness = m_loudness;
+	const void* keepTruePeak = m_truePeak;
+	const void* keepBallistics = m_ballistics;
+	const bool resizeRing = ringBuffer && !keepRing && m_ringBufferSize;
+
+	// lay out the buffers twice: without an arena to measure it, then to carve it.  Buffers
+	// that are not kept start zeroed, the kept ones go first so they rarely have to move
+	BYTE* base = NULL;
+	size_t size = 0;
+	bool moved = resizeRing;							// the old ring has to outlive the new one
+	auto carve = [&](bool used, size_t nBytes, const void* keep) -> float*
+	{
+		if (!used) return NULL;
+		const size_t offset = size;
+		size += (nBytes + s_align - 1) & ~(s_align - 1);
+		if (!base)
+		{
+			if (keep && (size_t)((const BYTE*)keep - m_arena) != offset) moved = true;
+			return NULL;
+		}
+
+		float* p = (float*)(base + offset);
+		if (!keep) memset(p, 0, nBytes);
+		else if (p != keep) memcpy(p, keep, nBytes);
+		return p;
+	};
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		size = 0;
+		m_decimator = (Decimator*)carve(decimate, sizeof(Decimator), keepDecimator);
+		m_ringBuffer = carve(m_ringBufferSize != 0, m_ringBufferSize * m_nAnalysis * sizeof(float), keepRing);
+		m_fftOut = carve(fft, m_fftBufferSize * m_nAnalysis * sizeof(float), keepSpectrum);
+		windowOut = carve(fft && !window, m_fftSize * sizeof(float), keepWindow);
+		bandFreqOut = carve(fftBands && !bandFreq, m_nBands * sizeof(float), keepBandFreq);
+		m_loudness = (Loudness*)carve((m_meters & METER_LOUDNESS) != 0, sizeof(Loudness), keepLoudness);
+		m_truePeak = (TruePeak*)carve((m_meters & METER_TRUEPEAK) != 0, sizeof(TruePeak), keepTruePeak);
+		m_ballistics = (Ballistics*)carve((m_meters & METER_BALLISTICS) != 0, sizeof(Ballistics), keepBallistics);
+		m_ringBufOut = carve(m_ringBufferSize != 0, (m_ringBufferSize - m_fftSize + m_fftBufferSize) * sizeof(float), NULL);
+		m_fftTmpOut = carve(fft, m_fftBufferSize * 2 * sizeof(float), NULL);
+		m_fftWork = carve(fft, m_fftBufferSize * sizeof(float), NULL);
+		m_bandOut = carve(fftBands, m_nBands * m_nAnalysis * sizeof(float), NULL);
+		m_bandTmpOut = carve(fftBands, m_nBands * sizeof(float), NULL);
+		m_waveOut = carve(wave, m_waveSize * m_nAnalysis * sizeof(float), NULL);
+		m_waveBandOut = carve(waveBands, m_nBands * m_nAnalysis * sizeof(float), NULL);
+		m_waveBandTmpOut = carve(waveBands, m_nBands * sizeof(float), NULL);
+		m_adaptiveOut = carve(true, (m_nBands * m_nAnalysis * 2 + MAX_CHANNELS * 2) * sizeof(float), NULL);
+
+		if (pass == 0)
+		{
+			// keep the arena unless it is too small, more than twice too large, or kept buffers move
+			base = m_arena;
+			if (size > m_arenaCapacity || size * 2 < m_arenaCapacity || moved)
+			{
+				base = (BYTE*)pffft_aligned_malloc(size);
+				m_arenaCapacity = size;
+			}
+			m_arenaSize = size;
+		}
+	}
+
+	// a resized ring buffer keeps its latest samples, unrolled so the write index starts over
+	if (resizeRing)
+	{
+		const int nKeep = min(ringSize, m_ringBufferSize);
+		for (int iAna = 0; iAna < m_nAnalysis; ++iAna)
+		{
+			const float* src = &ringBuffer[iAna * ringSize];
+			float* dst = &m_ringBuffer[iAna * m_ringBufferSize + m_ringBufferSize - nKeep];
+			for (int i = 0; i < nKeep; ++i)
+			{
+				dst[i] = src[(m_ringBufW - nKeep + i + ringSize) % ringSize];
+			}
+		}
+	}
+	if (!keepRing) m_ringBufW = 0;
+
+	if (base != m_arena)
+	{
+		if (m_arena) pffft_aligned_free(m_arena);
+		m_arena = base;
+	}
+
+	// the window and the band frequencies are set again below if they are used
+	m_fftKWdw = NULL;
+	m_bandFreq = NULL;
+
+	// setup decimator, the spectra are computed at the decimated rate
+	if (m_decimator && !keepDecimator)
+	{
+		m_decimator->Init(nStages, m_nAnalysis);
+	}
+	const float sampleRate = m_wfx ? (float)(m_wfx->nSamplesPerSec >> (m_decimator ? nStages : 0)) : 0.0f;
+
+	// meters keep their state, a newly requested one starts from its initial state
+	if (m_loudness && !keepLoudness && m_wfx)
+	{
+		m_loudness->Init(m_wfx);
+	}
+	if (m_truePeak && !keepTruePeak)
+	{
+		m_truePeak->Reset();
+	}
+	if (m_ballistics && !keepBallistics && m_wfx)
+	{
+		m_ballistics->Configure(this);
+		m_ballistics->Reset();
+	}
+
+	// setup FFT, the setup only depends on the FFT buffer size and is kept as long as it doesn't change
+	if (m_fftCfg && (!fft || m_fftCfgSize != m_fftBufferSize))
+	{
+		pffft_destroy_setup(m_fftCfg);
+		m_fftCfg = NULL;
+	}
+	if (fft)
+	{
+		if (!m_fftCfg)
+		{
+			m_fftCfg = pffft_new_setup(m_fftBufferSize, pffft_transform_t::PFFFT_REAL);
+			m_fftCfgSize = m_fftBufferSize;
+		}
+
+		m_fftScalar = (float)(1.0 / sqrt(m_fftSize));
+		m_df = sampleRate / m_fftBufferSize;
+
+		// zero-padding - https://jackschaedler.github.io/circles-sines-signals/zeropadding.html
+		for (int iBin = 0; iBin < m_ringBufferSize - m_fftSize + m_fftBufferSize; ++iBin) m_ringBufOut[iBin] = 0.0;
+
+		// calculate window function coefficients
+		if (!window)
+		{
+			if (!keepWindow) WindowInit(windowOut, m_fftSize, m_window, m_kaiserBeta);
+			window = windowOut;
+		}
+		m_fftKWdw = window;
+
+		// calculate band frequencies
+		if (m_nBands)
+		{
+			if (!bandFreq && keepBandFreq)
+			{
+				bandFreq = bandFreqOut;
+			}
+			else if (!bandFreq)
+			{
+				const double step = pow(2.0, (log(m_freqMax / m_freqMin) / m_nBands) / log(2.0));
+				bandFreqOut[0] = (float)(m_freqMin * step);
+
+				for (int iBand = 1; iBand < m_nBands; ++iBand)
+				{
+					bandFreqOut[iBand] = (float)(bandFreqOut[iBand - 1] * step);
+				}
+				bandFreq = bandFreqOut;
+			}
+			m_bandFreq = bandFreq;
+
+			m_bandScalar = 2.0f / sampleRate;
+		}
+	}
+
+	// setup WAVE bands
+	if (waveBands)
+	{
+		m_dw = (float)m_waveSize / (float)m_nBands;
+		m_waveScalar = (float)(1.0f / m_dw);
+	}
+
+	m_warmup = s_warmupUpdates;
+}
+
+/**
+* Compute the attack/decay filter constants of the envelopes for the sample rate of the stream.
+*/
+void Parent::FiltersInit()
+{
+	if (!m_wfx) return;
+
+	const double freq = m_wfx->nSamplesPerSec;
+	m_kRMS[0] = (float)exp(log10(0.01) / (freq * (double)m_envRMS[0] * 0.001));
+	m_kRMS[1] = (float)exp(log10(0.01) / (freq * (double)m_envRMS[1] * 0.001));
+	m_kPeak[0] = (float)exp(log10(0.01) / (freq * (double)m_envPeak[0] * 0.001));
+	m_kPeak[1] = (float)exp(log10(0.01) / (freq * (double)m_envPeak[1] * 0.001));
+
+	for (int i = 0; i < 2; ++i)
+	{
+		m_kRMSBlock[i] = powf(m_kRMS[i], (float)ENVELOPE_BLOCK);
+		m_kPeakBlock[i] = powf(m_kPeak[i], (float)ENVELOPE_BLOCK);
+	}
+
+	if (m_fftSize)
+	{
+		// with a hop size, the attack/decay filter steps once per spectral frame
+		const double frameRate = m_hopSize ? (freq / (m_decimator ? 1 << m_decimator->m_nStages : 1)) / m_hopSize : freq * 0.001;
+		m_kFFT[0] = (float)exp(log10(0.01) / (frameRate * (double)m_envFFT[0] * 0.001));
+		m_kFFT[1] = (float)exp(log10(0.01) / (frameRate * (double)m_envFFT[1] * 0.001));
+	}
+}
+
+/**
+* Release the DSP buffers and the meters of a parent measure.
+*/
+void Parent::BuffersRelease()
+{
+	if (m_fftCfg) pffft_destroy_setup(m_fftCfg);
+	m_fftCfg = NULL;
+	m_fftCfgSize = 0;
+
+	// all DSP buffers live in the arena
+	if (m_arena) pffft_aligned_free(m_arena);
+	m_arena = NULL;
+	m_arenaSize = 0;
+	m_arenaCapacity = 0;
+
+	m_decimator = NULL;
+	m_ringBuffer = NULL;
+	m_ringBufOut = NULL;
+	m_fftKWdw = NULL;
+	m_fftTmpOut = NULL;
+	m_fftWork = NULL;
+	m_fftOut = NULL;
+	m_bandFreq = NULL;
+	m_bandOut = NULL;
+	m_bandTmpOut = NULL;
+	m_waveOut = NULL;
+	m_waveBandOut = NULL;
+	m_waveBandTmpOut = NULL;
+	m_adaptiveOut = NULL;
+	m_loudness = NULL;
+	m_truePeak = NULL;
+	m_ballistics = NULL;
+	m_meters = 0;
+
+	for (int iChan = 0; iChan < Measure::MAX_CHANNELS; ++iChan)
+	{
+		m_rms[iChan] = 0.0;
+		m_peak[iChan] = 0.0;
+	}
 }
\ No newline at end of file
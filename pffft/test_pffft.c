@@ -20,6 +20,10 @@
   build without SIMD instructions:
   gcc -o test_pffft -DPFFFT_SIMD_DISABLE -O3 -Wall -W pffft.c test_pffft.c fftpack.c -lm
 
+  AudioLevel workload (window, ordered FFT, magnitude, attack/decay and log bands per frame):
+  ./test_pffft --plugin-workload
+  build it once with and once without -DPFFFT_SIMD_DISABLE to compare the SIMD and scalar paths.
+
  */
 
 #include "pffft.h"
@@ -361,6 +365,140 @@ void benchmark_ffts(int N, int cplx) {
   pffft_aligned_free(Z);
 }
 
+/* the stages of one AudioLevel frame, timed separately: fftSize samples are windowed and
+   zero-padded to fftBufferSize, transformed, turned into a power spectrum with attack/decay
+   smoothing, and integrated into nBands log-spaced bands from 20Hz to 20kHz at 48kHz */
+enum { STAGE_WINDOW, STAGE_FFT, STAGE_MAGNITUDE, STAGE_ATTACK_DECAY, STAGE_BANDS, NUM_STAGES };
+static const char *stage_name[NUM_STAGES] = { "window", "fft", "magnitude", "attack/decay", "bands" };
+
+double benchmark_workload(int fftSize, int fftBufferSize, int nBands, double *stage_ns) {
+  const float sampleRate = 48000, freqMin = 20, freqMax = 20000;
+  const float kFFT[2] = { 0.9f, 0.95f };
+  const int nBins = fftBufferSize/2;
+  float *ring = pffft_aligned_malloc(fftSize*sizeof(float));
+  float *in = pffft_aligned_malloc(fftBufferSize*sizeof(float));
+  float *out = pffft_aligned_malloc(fftBufferSize*sizeof(float));
+  float *work = pffft_aligned_malloc(fftBufferSize*sizeof(float));
+  float *window = malloc(fftSize*sizeof(float));
+  float *power = malloc((nBins+1)*sizeof(float));
+  float *spectrum = calloc(nBins+1, sizeof(float));
+  float *bandFreq = malloc(nBands*sizeof(float));
+  float *bands = malloc(nBands*sizeof(float));
+  const float df = sampleRate/fftBufferSize;
+  const double step = pow(freqMax/freqMin, 1.0/nBands);
+  double t0, t1, total = 0;
+  int k, iter, stage;
+  int max_iter = 5120000/fftBufferSize;
+  PFFFT_Setup *s = pffft_new_setup(fftBufferSize, PFFFT_REAL);
+
+  if (!s) return -1;
+  for (k = 0; k < fftSize; ++k) {
+    ring[k] = frand()*2-1;
+    window[k] = 0.5f*(1 - cos(2*M_PI*k/(fftSize+1)));
+  }
+  for (k = 0; k < nBands; ++k) bandFreq[k] = freqMin*pow(step, k+1);
+  memset(in, 0, fftBufferSize*sizeof(float));
+
+  for (stage = 0; stage < NUM_STAGES; ++stage) {
+    t0 = uclock_sec();
+    for (iter = 0; iter < max_iter; ++iter) {
+      switch (stage) {
+      case STAGE_WINDOW:
+        for (k = 0; k < fftSize; ++k) in[k] = ring[k]*window[k];
+        break;
+      case STAGE_FFT:
+        pffft_transform_ordered(s, in, out, work, PFFFT_FORWARD);
+        break;
+      case STAGE_MAGNITUDE:
+        /* the ordered real transform stores the DC and Nyquist bins in out[0] and out[1] */
+        power[0] = out[0]*out[0];
+        power[nBins] = out[1]*out[1];
+        for (k = 1; k < nBins; ++k) power[k] = out[2*k]*out[2*k] + out[2*k+1]*out[2*k+1];
+        break;
+      case STAGE_ATTACK_DECAY:
+        for (k = 0; k <= nBins; ++k) {
+          float x0 = spectrum[k], x1 = power[k];
+          spectrum[k] = x1 + kFFT[x1 < x0]*(x0 - x1);
+        }
+        break;
+      case STAGE_BANDS: {
+        /* piecewise linear integration of the bins into the bands, like the plugin */
+        int iBin = (int)ceilf(freqMin/df), iBand = 0;
+        float f0 = freqMin;
+        memset(bands, 0, nBands*sizeof(float));
+        while (iBin <= nBins && iBand < nBands) {
+          float fLin1 = iBin*df, fLog1 = bandFreq[iBand];
+          if (fLin1 <= fLog1) {
+            bands[iBand] += (fLin1 - f0)*spectrum[iBin];
+            f0 = fLin1;
+            ++iBin;
+          } else {
+            bands[iBand] += (fLog1 - f0)*spectrum[iBin];
+            bands[iBand] = 10*log10f(bands[iBand] + 1e-30f);
+            f0 = fLog1;
+            ++iBand;
+          }
+        }
+        break;
+      }
+      }
+    }
+    t1 = uclock_sec();
+    stage_ns[stage] = (t1 - t0)/max_iter*1e9;
+    total += stage_ns[stage];
+  }
+
+  pffft_destroy_setup(s);
+  pffft_aligned_free(ring); pffft_aligned_free(in); pffft_aligned_free(out); pffft_aligned_free(work);
+  free(window); free(power); free(spectrum); free(bandFreq); free(bands);
+  return total;
+}
+
+/* times the workload for the FFT sizes supported by pffft between 1024 and 65536, with and
+   without 2x zero-padding, and recommends the sizes for which no larger size is faster */
+void benchmark_plugin_workload(int nBands) {
+  int sizes[128], nSizes = 0;
+  double frame_ns[128][2];
+  int n, i, j, pad;
+
+  for (n = 1024; n <= 65536; n += 32) {
+    /* pffft supports N = 2^a*3^b*5^c with a >= 5 for real transforms */
+    int m = n;
+    while (m % 2 == 0) m /= 2;
+    while (m % 3 == 0) m /= 3;
+    while (m % 5 == 0) m /= 5;
+    if (m == 1 && nSizes < 128) sizes[nSizes++] = n;
+  }
+
+  printf("AudioLevel workload, %s, %d bands, ns per frame\n", pffft_simd_size() > 1 ? "SIMD" : "scalar", nBands);
+  printf("%8s %8s", "FFTSize", "padding");
+  for (i = 0; i < NUM_STAGES; ++i) printf(" %12s", stage_name[i]);
+  printf(" %12s\n", "total");
+
+  for (i = 0; i < nSizes; ++i) {
+    for (pad = 0; pad < 2; ++pad) {
+      double stage_ns[NUM_STAGES];
+      int k;
+      frame_ns[i][pad] = benchmark_workload(sizes[i], sizes[i] << pad, nBands, stage_ns);
+      printf("%8d %7dx", sizes[i], 1 << pad);
+      for (k = 0; k < NUM_STAGES; ++k) printf(" %12.0f", stage_ns[k]);
+      printf(" %12.0f\n", frame_ns[i][pad]);
+      fflush(stdout);
+    }
+  }
+
+  printf("\nrecommended FFTSize / FFTBufferSize:\n");
+  for (pad = 0; pad < 2; ++pad) {
+    for (i = 0; i < nSizes; ++i) {
+      int fast = 1;
+      for (j = i+1; j < nSizes; ++j) {
+        if (frame_ns[j][pad] < frame_ns[i][pad]) fast = 0;
+      }
+      if (fast) printf("  FFTSize=%d FFTBufferSize=%d (%.0f ns per frame)\n", sizes[i], sizes[i] << pad, frame_ns[i][pad]);
+    }
+  }
+}
+
 #ifndef PFFFT_SIMD_DISABLE
 void validate_pffft_simd(); // a small function inside pffft.c that will detect compiler bugs with respect to simd instruction 
 #endif
@@ -372,6 +510,11 @@ int main(int argc, char **argv) {
   if (argc > 1 && strcmp(argv[1], "--array-format") == 0) {
     array_output_format = 1;
   }
+  if (argc > 1 && strcmp(argv[1], "--plugin-workload") == 0) {
+    pffft_validate(0);
+    benchmark_plugin_workload(argc > 2 ? atoi(argv[2]) : 64);
+    return 0;
+  }
 
 #ifndef PFFFT_SIMD_DISABLE
   validate_pffft_simd();
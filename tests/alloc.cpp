@@ -0,0 +1,129 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Allocations of the processing path: the meters live in the arena, the
+// processing does not allocate after warm-up, and a failed allocation of a
+// parent throws.
+
+#include "harness.h"
+
+/**
+* True if a meter lies within the arena of its parent.
+*/
+bool InArena(const Parent* b, const void* p, size_t size)
+{
+	return p && (const BYTE*)p >= b->m_arena && (const BYTE*)p + size <= b->m_arena + b->m_arenaSize;
+}
+
+int main()
+{
+	static const int s_sampleRate = 48000;
+	static const int s_nChunk = 800;
+	static const int s_nUpdates = 60;
+
+	WAVEFORMATEX wfx = MakeFormat(WAVE_FORMAT_IEEE_FLOAT, 2, s_sampleRate);
+	std::vector<float> signal(s_nChunk * 2);
+	for (int i = 0; i < s_nChunk; ++i)
+	{
+		signal[i * 2] = (float)(0.5 * sin(TWOPI * 1000.0 * i / s_sampleRate));
+		signal[i * 2 + 1] = signal[i * 2];
+	}
+
+	// a parent of a capture stream, with every meter requested by its children
+	Endpoint ep;
+	ep.m_wfx = &wfx;
+
+	const PrivateConfig config = { 2048, 4096, 64, 2, 1, 1024, 1, 2, 1 };
+	Parent* b = new Parent;
+	PrivateInit(b, &wfx, config);
+	b->m_endpoint = &ep;
+#if (PROFILE_STAGES)
+	Profile profile;
+	b->m_profile = &profile;
+#endif
+
+	Measure loudness, vu, truePeak, clip;
+	b->UseMeter(&loudness, Parent::METER_LOUDNESS);
+	b->UseMeter(&vu, Parent::METER_BALLISTICS);
+	CHECK(InArena(b, b->m_loudness, sizeof(Loudness)));
+	CHECK(InArena(b, b->m_ballistics, sizeof(Ballistics)));
+	CHECK(b->m_truePeak == NULL);
+
+	// after warm-up, neither the meters nor the spectra allocate
+	UINT64 nAllocs = 0;
+	const UINT32 nViolations = AllocGuard::s_nViolations;
+	for (int iUpdate = 0; iUpdate < s_nUpdates; ++iUpdate)
+	{
+		if (iUpdate == Parent::s_warmupUpdates) nAllocs = g_nAllocs;
+		b->ProcessChunk(&signal[0], s_nChunk, 0);
+		b->UpdateParent();
+	}
+	CHECK(g_nAllocs == nAllocs);
+	CHECK(AllocGuard::s_nViolations == nViolations);
+
+	// a meter requested later is carved from the arena, and the running meters keep their state
+	const double shortTerm = b->m_loudness->Value(Measure::LOUDNESS_SHORTTERM);
+	const double level = b->m_ballistics->Value(Measure::TYPE_VU, Measure::CHANNEL_FL);
+	CHECK(shortTerm > -20.0);
+	b->UseMeter(&truePeak, Parent::METER_TRUEPEAK);
+	CHECK(InArena(b, b->m_loudness, sizeof(Loudness)));
+	CHECK(InArena(b, b->m_truePeak, sizeof(TruePeak)));
+	CHECK(InArena(b, b->m_ballistics, sizeof(Ballistics)));
+	CHECK(b->m_loudness->Value(Measure::LOUDNESS_SHORTTERM) == shortTerm);
+	CHECK(b->m_ballistics->Value(Measure::TYPE_VU, Measure::CHANNEL_FL) == level);
+
+	for (int iUpdate = 0; iUpdate < s_nUpdates; ++iUpdate)
+	{
+		if (iUpdate == Parent::s_warmupUpdates) nAllocs = g_nAllocs;
+		b->ProcessChunk(&signal[0], s_nChunk, 0);
+		b->UpdateParent();
+	}
+	CHECK(g_nAllocs == nAllocs);
+	CHECK(AllocGuard::s_nViolations == nViolations);
+	CHECK_NEAR(b->m_truePeak->Value(Measure::CHANNEL_FL), 20.0 * log10(0.5), 1.0);
+
+	// a meter is released with the last measure using it, the other meters keep their state
+	const double peak = b->m_truePeak->Value(Measure::CHANNEL_FL);
+	const double clips = b->m_ballistics->Value(Measure::TYPE_CLIP, Measure::CHANNEL_FL);
+	b->UseMeter(&clip, Parent::METER_BALLISTICS);
+	b->UseMeter(&vu, 0);
+	b->UseMeter(&loudness, 0);
+	CHECK(b->m_meters == (Parent::METER_TRUEPEAK | Parent::METER_BALLISTICS));
+	CHECK(b->m_loudness == NULL);
+	CHECK(InArena(b, b->m_truePeak, sizeof(TruePeak)) && b->m_truePeak->Value(Measure::CHANNEL_FL) == peak);
+	CHECK(InArena(b, b->m_ballistics, sizeof(Ballistics)) && b->m_ballistics->Value(Measure::TYPE_CLIP, Measure::CHANNEL_FL) == clips);
+	b->UseMeter(&clip, 0);
+	b->UseMeter(&truePeak, 0);
+	CHECK(b->m_meters == 0 && b->m_truePeak == NULL && b->m_ballistics == NULL);
+
+	b->m_endpoint = NULL;
+	b->m_profile = NULL;
+	b->BuffersRelease();
+	CHECK(b->m_loudness == NULL && b->m_truePeak == NULL && b->m_ballistics == NULL);
+	delete b;
+
+	// the guard counts as a violation when an armed scope allocates
+	{
+		ALLOC_GUARD(true);
+		free(malloc(16));
+	}
+	CHECK(AllocGuard::s_nViolations == nViolations + 1);
+
+	// a parent that doesn't fit in memory throws instead of returning NULL
+	bool thrown = false;
+	try
+	{
+		Parent::operator new((size_t)-1 / 2);
+	}
+	catch (const std::bad_alloc&)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	return g_nFailed ? 1 : 0;
+}
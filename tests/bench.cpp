@@ -0,0 +1,313 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Pipeline benchmark: replays WAV files, or a synthetic signal, through the
+// parent pipeline for a matrix of settings and writes the time per frame and
+// the heap allocations as JSON.
+//
+//   bench [-o file.json] [input.wav ...]
+
+#include "harness.h"
+
+/**
+* Audio of one input, in a format the capture path converts (S16 or F32).
+*/
+struct Input
+{
+	std::string				m_name;
+	WAVEFORMATEX			m_wfx;
+	Measure::Format			m_format;
+	std::vector<BYTE>		m_data;
+	UINT32					m_nFrames;
+
+	bool ReadWav(const char* path);
+	void Synthesize(int sampleRate, int nChannels);
+};
+
+/**
+* Read a WAV file.  16-bit PCM and 32-bit float are replayed as captured, 24
+* and 32-bit PCM and 64-bit float are converted to 32-bit float.
+*
+* @param[in]	path			File name.
+* @return		False if the file could not be read or has an unsupported format.
+*/
+bool Input::ReadWav(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file) return false;
+
+	std::vector<BYTE> raw;
+	BYTE buffer[65536];
+	for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0;)
+	{
+		raw.insert(raw.end(), buffer, buffer + n);
+	}
+	fclose(file);
+
+	if (raw.size() < 12 || memcmp(&raw[0], "RIFF", 4) != 0 || memcmp(&raw[8], "WAVE", 4) != 0) return false;
+
+	WORD tag = 0, nChannels = 0, bits = 0;
+	DWORD sampleRate = 0;
+	const BYTE* data = NULL;
+	size_t nBytes = 0;
+	for (size_t pos = 12; pos + 8 <= raw.size();)
+	{
+		DWORD size;
+		memcpy(&size, &raw[pos + 4], 4);
+		size = (DWORD)min((size_t)size, raw.size() - pos - 8);
+
+		if (memcmp(&raw[pos], "fmt ", 4) == 0 && size >= 16)
+		{
+			memcpy(&tag, &raw[pos + 8], 2);
+			memcpy(&nChannels, &raw[pos + 10], 2);
+			memcpy(&sampleRate, &raw[pos + 12], 4);
+			memcpy(&bits, &raw[pos + 22], 2);
+
+			// WAVE_FORMAT_EXTENSIBLE: the format tag is the start of the sub-format GUID
+			if (tag == 0xfffe && size >= 26) memcpy(&tag, &raw[pos + 32], 2);
+		}
+		else if (memcmp(&raw[pos], "data", 4) == 0)
+		{
+			data = &raw[pos + 8];
+			nBytes = size;
+		}
+
+		pos += 8 + size + (size & 1);
+	}
+
+	if (!data || !nChannels || nChannels > Measure::MAX_CHANNELS || !sampleRate) return false;
+
+	const size_t nSamples = nBytes / (bits / 8);
+	m_nFrames = (UINT32)(nSamples / nChannels);
+	if (tag == WAVE_FORMAT_PCM && bits == 16)
+	{
+		m_format = Measure::FMT_PCM_S16;
+		m_data.assign(data, data + m_nFrames * nChannels * 2);
+	}
+	else if ((tag == WAVE_FORMAT_PCM && (bits == 24 || bits == 32)) || (tag == WAVE_FORMAT_IEEE_FLOAT && (bits == 32 || bits == 64)))
+	{
+		m_format = Measure::FMT_PCM_F32;
+		m_data.resize(m_nFrames * nChannels * sizeof(float));
+		float* out = (float*)&m_data[0];
+		for (size_t i = 0; i < (size_t)m_nFrames * nChannels; ++i)
+		{
+			const BYTE* s = data + i * (bits / 8);
+			if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) { memcpy(&out[i], s, 4); }
+			else if (tag == WAVE_FORMAT_IEEE_FLOAT) { double x; memcpy(&x, s, 8); out[i] = (float)x; }
+			else if (bits == 24) { out[i] = (float)((INT32)((UINT32)s[0] << 8 | (UINT32)s[1] << 16 | (UINT32)s[2] << 24) / 2147483648.0); }
+			else { INT32 x; memcpy(&x, s, 4); out[i] = (float)(x / 2147483648.0); }
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	if (!m_nFrames) return false;
+
+	m_name = path;
+	m_wfx = MakeFormat(m_format == Measure::FMT_PCM_S16 ? WAVE_FORMAT_PCM : WAVE_FORMAT_IEEE_FLOAT, nChannels, sampleRate);
+	return true;
+}
+
+/**
+* One second of S16 audio: three tones and white noise.
+*
+* @param[in]	sampleRate		Frames per second.
+* @param[in]	nChannels		Number of channels.
+*/
+void Input::Synthesize(int sampleRate, int nChannels)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "synthetic %d Hz %d ch", sampleRate, nChannels);
+	m_name = name;
+	m_format = Measure::FMT_PCM_S16;
+	m_wfx = MakeFormat(WAVE_FORMAT_PCM, nChannels, sampleRate);
+	m_nFrames = sampleRate;
+	m_data.resize(m_nFrames * m_wfx.nBlockAlign);
+
+	INT16* signal = (INT16*)&m_data[0];
+	UINT32 noise = 1;
+	for (UINT32 iFrame = 0; iFrame < m_nFrames; ++iFrame)
+	{
+		const double t = (double)iFrame / sampleRate;
+		const double tones = 0.2 * sin(TWOPI * 55.0 * t) + 0.1 * sin(TWOPI * 440.0 * t) + 0.05 * sin(TWOPI * 3520.0 * t);
+		for (int c = 0; c < nChannels; ++c)
+		{
+			noise = noise * 1664525 + 1013904223;
+			signal[iFrame * nChannels + c] = (INT16)(0x7fff * (tones + 0.05 * ((double)noise / 0xffffffff - 0.5)));
+		}
+	}
+}
+
+/**
+* Convert the frames of one update from an input that loops, as the capture path does.
+*
+* @param[in]	input			Input audio.
+* @param[in]	iFrame			First frame, wraps around the end of the input.
+* @param[in]	nFrames			Number of frames.
+* @param[out]	chunk			F32 samples.
+*/
+void ConvertLooped(const Input& input, UINT32 iFrame, UINT32 nFrames, float* chunk)
+{
+	const int nChannels = input.m_wfx.nChannels;
+	while (nFrames > 0)
+	{
+		iFrame %= input.m_nFrames;
+		const UINT32 n = min(nFrames, input.m_nFrames - iFrame);
+		ConvertChunk(input.m_format, &input.m_data[iFrame * input.m_wfx.nBlockAlign], chunk, n * nChannels);
+		chunk += n * nChannels;
+		iFrame += n;
+		nFrames -= n;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	static const int s_fftSize[] = { 1024, 4096, 16384 };
+	static const int s_padding[] = { 1, 2 };
+	static const int s_bands[] = { 32, 256 };
+	static const int s_smoothing[][2] = { { 0, 0 }, { 3, 0 }, { 3, 1 }, { 3, 2 } };
+	static const int s_waveSize[] = { 0, 2048 };
+	static const int s_dynamicVolume[] = { 0, 1 };
+	static const int s_channels[] = { 2, 8 };
+	static const int s_sampleRate[] = { 48000, 192000 };
+	static const int s_updatesPerSecond = 60;
+	static const int s_nWarmup = 10;
+	static const int s_nUpdates = 200;
+
+	// inputs: the WAV files on the command line, or the synthetic signal at every rate and channel count
+	const char* outPath = NULL;
+	std::vector<Input> inputs;
+	for (int iArg = 1; iArg < argc; ++iArg)
+	{
+		if (strcmp(argv[iArg], "-o") == 0 && iArg + 1 < argc)
+		{
+			outPath = argv[++iArg];
+			continue;
+		}
+
+		inputs.push_back(Input());
+		if (!inputs.back().ReadWav(argv[iArg]))
+		{
+			fprintf(stderr, "bench: couldn't read '%s', only 16/24/32-bit PCM and 32/64-bit float WAV files are supported.\n", argv[iArg]);
+			return 2;
+		}
+	}
+
+	if (inputs.empty())
+	{
+		for (int iRate = 0; iRate < (int)_countof(s_sampleRate); ++iRate)
+		{
+			for (int iChan = 0; iChan < (int)_countof(s_channels); ++iChan)
+			{
+				inputs.push_back(Input());
+				inputs.back().Synthesize(s_sampleRate[iRate], s_channels[iChan]);
+			}
+		}
+	}
+
+	FILE* file = outPath ? fopen(outPath, "w") : stdout;
+	if (!file)
+	{
+		fprintf(stderr, "bench: couldn't write '%s'.\n", outPath);
+		return 2;
+	}
+
+	fprintf(file, "{\n\t\"simd\": \"%s\",\n\t\"updatesPerSecond\": %d,\n\t\"results\": [", SIMD_SSE ? "sse" : "scalar", s_updatesPerSecond);
+
+	bool first = true;
+	int nAllocating = 0;
+	for (size_t iInput = 0; iInput < inputs.size(); ++iInput)
+	{
+		Input& input = inputs[iInput];
+		const int nChannels = input.m_wfx.nChannels;
+		const UINT32 nChunk = input.m_wfx.nSamplesPerSec / s_updatesPerSecond;
+		std::vector<float> chunk(nChunk * nChannels);
+
+		for (int iFFT = 0; iFFT < (int)_countof(s_fftSize); ++iFFT)
+		for (int iPad = 0; iPad < (int)_countof(s_padding); ++iPad)
+		for (int iBands = 0; iBands < (int)_countof(s_bands); ++iBands)
+		for (int iSmooth = 0; iSmooth < (int)_countof(s_smoothing); ++iSmooth)
+		for (int iWave = 0; iWave < (int)_countof(s_waveSize); ++iWave)
+		for (int iDyn = 0; iDyn < (int)_countof(s_dynamicVolume); ++iDyn)
+		{
+			// private parent with the settings of this configuration
+			const PrivateConfig config =
+			{
+				s_fftSize[iFFT], s_fftSize[iFFT] * s_padding[iPad], s_bands[iBands], s_smoothing[iSmooth][0], s_smoothing[iSmooth][1],
+				s_waveSize[iWave], s_dynamicVolume[iDyn], 1, 0
+			};
+
+			const UINT64 nSetupStart = g_nAllocs;
+			Parent* b = new Parent;
+			PrivateInit(b, &input.m_wfx, config);
+#if (PROFILE_STAGES)
+			Profile profile;
+			b->m_profile = &profile;
+#endif
+			const UINT64 nSetupAllocs = g_nAllocs - nSetupStart;
+
+			Clock::time_point start;
+			UINT64 nAllocStart = 0;
+			for (int iUpdate = 0; iUpdate < s_nWarmup + s_nUpdates; ++iUpdate)
+			{
+				if (iUpdate == s_nWarmup)
+				{
+#if (PROFILE_STAGES)
+					profile.Reset();
+#endif
+					nAllocStart = g_nAllocs;
+					start = Clock::now();
+				}
+
+				PROFILE_START(mark);
+				ConvertLooped(input, iUpdate * nChunk, nChunk, &chunk[0]);
+				PROFILE_LAP(b->m_profile, STAGE_CONVERT, mark);
+
+				b->ProcessChunk(&chunk[0], nChunk, 0);
+				b->UpdateParent();
+			}
+			const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / s_nUpdates;
+			const UINT64 nAllocs = g_nAllocs - nAllocStart;
+			if (nAllocs) ++nAllocating;
+
+			fprintf(file, "%s\n\t\t{ \"input\": \"%s\", \"fftSize\": %d, \"fftBufferSize\": %d, \"bands\": %d, \"smoothing\": %d, \"smoothingMode\": %d, "
+				"\"waveSize\": %d, \"dynamicVolume\": %d, \"channels\": %d, \"sampleRate\": %d, "
+				"\"nsPerFrame\": %.0f, \"framesPerSecond\": %.0f, \"bufferBytes\": %zu, \"setupAllocations\": %llu, \"allocations\": %llu",
+				first ? "" : ",", input.m_name.c_str(), b->m_fftSize, b->m_fftBufferSize, b->m_nBands, b->m_smoothing, b->m_smoothingMode,
+				b->m_waveSize, b->m_dynamicVolume, nChannels, (int)input.m_wfx.nSamplesPerSec,
+				ns, ns > 0.0 ? 1e9 / ns : 0.0, b->m_arenaSize, (unsigned long long)nSetupAllocs, (unsigned long long)nAllocs);
+#if (PROFILE_STAGES)
+			fprintf(file, ", \"stages\": {");
+			for (int iStage = Profile::STAGE_CONVERT; iStage < Profile::STAGE_TOTAL; ++iStage)
+			{
+				fprintf(file, "%s \"%ls\": %.0f", iStage == Profile::STAGE_CONVERT ? "" : ",",
+					Profile::s_stageName[iStage], profile.Value((Profile::Stage)iStage, Profile::STAT_MEAN));
+			}
+			fprintf(file, " }");
+			b->m_profile = NULL;
+#endif
+			fprintf(file, " }");
+			first = false;
+
+			b->BuffersRelease();
+			b->m_wfx = NULL;
+			delete b;
+		}
+	}
+
+	fprintf(file, "\n\t]\n}\n");
+	if (file != stdout) fclose(file);
+
+	if (nAllocating)
+	{
+		fprintf(stderr, "bench: %d configurations allocated on the heap after warm-up.\n", nAllocating);
+		return 1;
+	}
+	return 0;
+}
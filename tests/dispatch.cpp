@@ -0,0 +1,218 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Load simulation of the dispatcher: many skins with several paced parents each
+// post their update commands on every display tick.  Without batching every
+// parent executes its own bang, with batching every skin executes one merged
+// bang per tick, with each measure updated once and one redraw.  Then the tick
+// thread, the unregistration of one parent of a skin and a merged bang longer
+// than the commands of any parent.
+
+#include "harness.h"
+
+/**
+* A paced parent without a capture stream, in a skin.
+*/
+Parent* NewParent(MockSkin* skin, LPCWSTR msgUpdate, double updatesPerSecond = 60.0)
+{
+	Parent* parent = new Parent;
+	parent->m_skin = skin;
+	parent->m_updatesPerSecond = updatesPerSecond;
+	parent->m_pacer.SetRate(updatesPerSecond);
+	_snwprintf_s(parent->m_msgUpdate, _TRUNCATE, L"%s", msgUpdate);
+	return parent;
+}
+
+/**
+* Number of occurrences of a bang in a command.
+*/
+int Occurrences(const std::wstring& command, const WCHAR* bang)
+{
+	int n = 0;
+	for (size_t pos = command.find(bang); pos != std::wstring::npos; pos = command.find(bang, pos + 1)) ++n;
+	return n;
+}
+
+int main()
+{
+	static const int s_nTicks = 60;							// one second at 60 updates per second
+	static const int s_nSkins[] = { 1, 4, 16, 64 };
+	static const int s_nParents[] = { 1, 2, 4 };
+
+	printf("%6s %8s %12s %12s %10s\n", "skins", "parents", "unbatched/s", "batched/s", "reduction");
+
+	for (int iSkins = 0; iSkins < (int)_countof(s_nSkins); ++iSkins)
+	{
+		for (int iParents = 0; iParents < (int)_countof(s_nParents); ++iParents)
+		{
+			const int nSkins = s_nSkins[iSkins];
+			const int nParents = s_nParents[iParents];
+
+			// the parents of a skin update their own measure and a meter group shared within the skin
+			std::vector<MockSkin> skins(nSkins);
+			std::vector<Parent*> parents(nSkins * nParents);
+			for (int iParent = 0; iParent < (int)parents.size(); ++iParent)
+			{
+				WCHAR msgUpdate[256];
+				_snwprintf_s(msgUpdate, _TRUNCATE, L"[!UpdateMeasure Audio%d][!UpdateMeterGroup Audio][!Redraw]", iParent % nParents);
+				parents[iParent] = NewParent(&skins[iParent / nParents], msgUpdate);
+			}
+
+			// without the dispatcher every parent executes its own commands
+			UINT64 nExecuted = g_nExecuted;
+			for (int iTick = 0; iTick < s_nTicks; ++iTick)
+			{
+				for (size_t iParent = 0; iParent < parents.size(); ++iParent)
+				{
+					RmExecute(parents[iParent]->m_skin, parents[iParent]->m_msgUpdate);
+				}
+			}
+			const UINT64 nUnbatched = g_nExecuted - nExecuted;
+			CHECK(nUnbatched == (UINT64)s_nTicks * nSkins * nParents);
+
+			// with the dispatcher the commands of a skin are merged on each tick; it is used
+			// without Register, which would start the dispatch thread
+			for (int iSkin = 0; iSkin < nSkins; ++iSkin) skins[iSkin].m_nExecuted = 0;
+			Dispatcher d;
+			nExecuted = g_nExecuted;
+			for (int iTick = 0; iTick < s_nTicks; ++iTick)
+			{
+				for (size_t iParent = 0; iParent < parents.size(); ++iParent)
+				{
+					d.Post(parents[iParent], 0);
+				}
+				d.DoFlush();
+			}
+			const UINT64 nBatched = g_nExecuted - nExecuted;
+			CHECK(nBatched == (UINT64)s_nTicks * nSkins);
+			CHECK(d.m_nBangs == nBatched);
+
+			for (int iSkin = 0; iSkin < nSkins; ++iSkin)
+			{
+				const std::wstring& command = skins[iSkin].m_lastCommand;
+				CHECK(skins[iSkin].m_nExecuted == (UINT64)s_nTicks);
+				for (int iParent = 0; iParent < nParents; ++iParent)
+				{
+					WCHAR bang[64];
+					_snwprintf_s(bang, _TRUNCATE, L"[!UpdateMeasure Audio%d]", iParent);
+					CHECK(Occurrences(command, bang) == 1);
+				}
+				CHECK(Occurrences(command, L"[!UpdateMeterGroup Audio]") == 1);
+				CHECK(Occurrences(command, L"[!Redraw]") == 1);
+
+				// the meters are updated after all measures, followed by the redraw
+				CHECK(command.find(L"[!UpdateMeterGroup Audio]") > command.rfind(L"[!UpdateMeasure "));
+				CHECK(command.compare(command.size() - 9, 9, L"[!Redraw]") == 0);
+			}
+
+			printf("%6d %8d %12llu %12llu %9.1fx\n", nSkins, nParents,
+				(unsigned long long)nUnbatched, (unsigned long long)nBatched, (double)nUnbatched / nBatched);
+
+			for (size_t iParent = 0; iParent < parents.size(); ++iParent) delete parents[iParent];
+		}
+	}
+
+	// a skin without pending commands does not get a bang
+	{
+		MockSkin skin;
+		Parent* parent = NewParent(&skin, L"[!UpdateMeasure Audio]");
+		Dispatcher d;
+		d.DoFlush();
+		d.Post(parent, 0);
+		d.DoFlush();
+		d.DoFlush();
+		CHECK(skin.m_nExecuted == 1);
+		CHECK(skin.m_lastCommand == L"[!UpdateMeasure Audio]");
+		delete parent;
+	}
+
+	// the tick thread: started by the first parent, at the fastest rate, stopped by the last parent
+	{
+		MockSkin skin;
+		Parent* slow = NewParent(&skin, L"[!UpdateMeasure Slow][!UpdateMeter Slow][!Redraw]", 10.0);
+		Parent* fast = NewParent(&skin, L"[!UpdateMeasure Fast][!UpdateMeter Fast][!Redraw]", 100.0);
+		Dispatcher::Register(slow);
+		Dispatcher* d = s_dispatcher;
+		CHECK(d != NULL && slow->m_dispatcher == d);
+		CHECK(d->m_period == slow->m_pacer.m_period);
+		Dispatcher::Register(fast);
+		CHECK(fast->m_dispatcher == d && d->m_period == fast->m_pacer.m_period);
+
+		const UINT64 nExecuted = g_nExecuted;
+		d->Post(slow, 0);
+		d->Post(fast, 0);
+		for (int i = 0; i < 1000 && g_nExecuted == nExecuted; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		CHECK(g_nExecuted == nExecuted + 1);
+
+		// the slow parent is left, the tick follows it
+		Dispatcher::Unregister(fast);
+		CHECK(s_dispatcher == d && d->m_period == slow->m_pacer.m_period);
+		Dispatcher::Unregister(slow);
+		CHECK(s_dispatcher == NULL && slow->m_dispatcher == NULL);
+
+		// let the thread exit before the skin goes away
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		CHECK(skin.m_lastCommand == L"[!UpdateMeasure Slow][!UpdateMeasure Fast][!UpdateMeter Slow][!UpdateMeter Fast][!Redraw]");
+	}
+
+	// unregistering a parent drops its commands only, those of the other parent of the skin are executed
+	{
+		MockSkin skin;
+		Parent* a = NewParent(&skin, L"[!UpdateMeasure A][!UpdateMeter A][!Redraw]");
+		Parent* b = NewParent(&skin, L"[!UpdateMeasure B][!UpdateMeter B][!Redraw]");
+		Dispatcher d;
+		d.m_parents.push_back(a);
+		d.m_parents.push_back(b);
+		a->m_dispatcher = b->m_dispatcher = &d;
+		d.Post(a, 0);
+		d.Post(b, 0);
+		Dispatcher::Unregister(a);
+		CHECK(a->m_dispatcher == NULL && d.m_parents.size() == 1);
+		d.DoFlush();
+		CHECK(skin.m_nExecuted == 1);
+		CHECK(skin.m_lastCommand == L"[!UpdateMeasure B][!UpdateMeter B][!Redraw]");
+		d.m_parents.clear();
+		delete a;
+		delete b;
+	}
+
+	// the merged bang of many parents is longer than the commands of one parent, and keeps every bang whole
+	{
+		static const int s_nParents = 64;
+		MockSkin skin;
+		std::vector<Parent*> parents(s_nParents);
+		Dispatcher d;
+		for (int i = 0; i < s_nParents; ++i)
+		{
+			WCHAR msgUpdate[256];
+			_snwprintf_s(msgUpdate, _TRUNCATE, L"[!UpdateMeasure AudioLevelMeasure%02d][!UpdateMeterGroup AudioLevelGroup%02d][!Redraw]", i, i);
+			parents[i] = NewParent(&skin, msgUpdate);
+			d.Post(parents[i], 0);
+		}
+		d.DoFlush();
+
+		const std::wstring& command = skin.m_lastCommand;
+		CHECK(skin.m_nExecuted == 1);
+		CHECK(command.size() > 4 * _countof(parents[0]->m_msgUpdate));
+		CHECK(Occurrences(command, L"[!UpdateMeasure ") == s_nParents);
+		CHECK(Occurrences(command, L"[!UpdateMeterGroup ") == s_nParents);
+		CHECK(Occurrences(command, L"]") == 2 * s_nParents + 1);
+		CHECK(command.compare(command.size() - 9, 9, L"[!Redraw]") == 0);
+		for (int i = 0; i < s_nParents; ++i)
+		{
+			WCHAR bang[64];
+			_snwprintf_s(bang, _TRUNCATE, L"[!UpdateMeterGroup AudioLevelGroup%02d]", i);
+			CHECK(Occurrences(command, bang) == 1);
+			delete parents[i];
+		}
+	}
+
+	return g_nFailed ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Shared capture streams of a fake audio device: parents of the same device and
+// mode share one endpoint, and once the device is invalidated, in the polled
+// update and in the capture thread, new parents get a fresh working endpoint
+// while the parents of the failed one keep it until they are released.
+
+#include "harness.h"
+
+/**
+* Capture client without packets, failing with an injected error.
+*/
+struct FakeCapture : IAudioCaptureClient
+{
+	std::atomic<HRESULT>	m_hr;						// result of the next packet size query
+
+	FakeCapture() : m_hr(S_OK) {}
+
+	HRESULT GetBuffer(BYTE** data, UINT32* nFrames, DWORD* flags, UINT64* devPosition, UINT64* qpcPosition) { return AUDCLNT_S_BUFFER_EMPTY; }
+	HRESULT ReleaseBuffer(UINT32 nFrames) { return S_OK; }
+	HRESULT GetNextPacketSize(UINT32* nFrames) { *nFrames = 0; return m_hr; }
+
+	HRESULT QueryInterface(const IID& riid, void** object) { return E_NOINTERFACE; }
+	ULONG AddRef() { return 1; }
+	ULONG Release() { return 1; }
+};
+
+/**
+* Silent render client of the loopback event stream.
+*/
+struct FakeRender : IAudioRenderClient
+{
+	BYTE					m_data[4096 * 8];
+
+	HRESULT GetBuffer(UINT32 nFrames, BYTE** data) { *data = m_data; return S_OK; }
+	HRESULT ReleaseBuffer(UINT32 nFrames, DWORD flags) { return S_OK; }
+
+	HRESULT QueryInterface(const IID& riid, void** object) { return E_NOINTERFACE; }
+	ULONG AddRef() { return 1; }
+	ULONG Release() { return 1; }
+};
+
+/**
+* Audio client of a stereo F32 device at 48 kHz.  The first client activated on a
+* device serves the loopback events, the second one the capture.
+*/
+struct FakeClient : IAudioClient
+{
+	bool					m_events;					// client of the loopback events, with a render service
+	FakeRender				m_render;
+	FakeCapture				m_capture;
+
+	FakeClient(bool events) : m_events(events) {}
+
+	HRESULT Initialize(AUDCLNT_SHAREMODE mode, DWORD flags, REFERENCE_TIME duration, REFERENCE_TIME period, const WAVEFORMATEX* format, const GUID* session) { return S_OK; }
+	HRESULT GetBufferSize(UINT32* nFrames) { *nFrames = 4096; return S_OK; }
+	HRESULT GetStreamLatency(REFERENCE_TIME* latency) { *latency = 0; return S_OK; }
+	HRESULT GetCurrentPadding(UINT32* nFrames) { *nFrames = 0; return S_OK; }
+	HRESULT IsFormatSupported(AUDCLNT_SHAREMODE mode, const WAVEFORMATEX* format, WAVEFORMATEX** closest) { *closest = NULL; return S_OK; }
+	HRESULT GetDevicePeriod(REFERENCE_TIME* defaultPeriod, REFERENCE_TIME* minPeriod) { *defaultPeriod = *minPeriod = 100000; return S_OK; }
+	HRESULT Start() { return S_OK; }
+	HRESULT Stop() { return S_OK; }
+	HRESULT Reset() { return S_OK; }
+	HRESULT SetEventHandle(HANDLE event) { return S_OK; }
+
+	HRESULT GetMixFormat(WAVEFORMATEX** format)
+	{
+		// freed by the plugin with CoTaskMemFree
+		*format = (WAVEFORMATEX*)malloc(sizeof(WAVEFORMATEX));
+		**format = MakeFormat(WAVE_FORMAT_IEEE_FLOAT, 2, 48000);
+		return S_OK;
+	}
+
+	HRESULT GetService(const IID& iid, void** service)
+	{
+		*service = m_events ? (void*)static_cast<IAudioRenderClient*>(&m_render) : (void*)static_cast<IAudioCaptureClient*>(&m_capture);
+		return S_OK;
+	}
+
+	HRESULT QueryInterface(const IID& riid, void** object) { return E_NOINTERFACE; }
+	ULONG AddRef() { return 1; }
+	ULONG Release() { return 1; }
+};
+
+/**
+* Audio device handing out a new pair of clients for every stream.  The clients are
+* kept until the end of the program, the capture threads may still release them.
+*/
+struct FakeDevice : IMMDevice
+{
+	std::vector<FakeClient*> m_clients;				// all activated clients, in order
+
+	HRESULT Activate(const IID& iid, DWORD context, PROPVARIANT* params, void** object)
+	{
+		m_clients.push_back(new FakeClient(m_clients.size() % 2 == 0));
+		*object = static_cast<IAudioClient*>(m_clients.back());
+		return S_OK;
+	}
+
+	HRESULT OpenPropertyStore(DWORD access, IPropertyStore** store) { return E_NOTIMPL; }
+	HRESULT GetState(DWORD* state) { *state = DEVICE_STATE_ACTIVE; return S_OK; }
+
+	HRESULT GetId(LPWSTR* id)
+	{
+		*id = (LPWSTR)malloc(16 * sizeof(WCHAR));
+		wcscpy(*id, L"{fake}");
+		return S_OK;
+	}
+
+	HRESULT QueryInterface(const IID& riid, void** object) { return E_NOINTERFACE; }
+	ULONG AddRef() { return 1; }
+	ULONG Release() { return 1; }
+};
+
+/**
+* Capture client of an endpoint of the fake device.
+*/
+FakeCapture* CaptureOf(const Endpoint* ep)
+{
+	return static_cast<FakeCapture*>(ep->m_clCapture);
+}
+
+/**
+* A parent of the fake device, without a skin.
+*/
+Parent* NewParent(FakeDevice* dev, double updatesPerSecond)
+{
+	Parent* parent = new Parent;
+	parent->m_dev = dev;
+	parent->m_port = Measure::PORT_OUTPUT;
+	parent->m_updatesPerSecond = updatesPerSecond;
+	return parent;
+}
+
+void DeleteParent(Parent* parent)
+{
+	Endpoint::Release(parent);
+	parent->BuffersRelease();
+	delete parent;
+}
+
+int main()
+{
+	FakeDevice dev;
+
+	// polled capture: the update releases the invalidated device
+	{
+		Parent* a = NewParent(&dev, -2);
+		Parent* b = NewParent(&dev, -2);
+		Endpoint* ep = Endpoint::Acquire(a);
+		CHECK(ep != NULL && ep->m_polled && ep->m_clCapture != NULL);
+		CHECK(Endpoint::Acquire(b) == ep && ep->m_refCount == 2);
+
+		CaptureOf(ep)->m_hr = AUDCLNT_E_DEVICE_INVALIDATED;
+		Update(a);
+		CHECK(ep->m_clCapture == NULL);
+		CHECK(b->m_endpoint == ep);
+
+		// a new parent does not join the failed stream, the next one shares the new stream
+		Parent* c = NewParent(&dev, -2);
+		Parent* d = NewParent(&dev, -2);
+		Endpoint* fresh = Endpoint::Acquire(c);
+		CHECK(fresh != NULL && fresh != ep);
+		CHECK(fresh->m_clCapture != NULL && fresh->Capture() == S_FALSE);
+		CHECK(Endpoint::Acquire(d) == fresh && fresh->m_refCount == 2);
+		CHECK(std::count(s_endpoints.begin(), s_endpoints.end(), ep) == 1);
+
+		// the failed stream goes away with its last parent
+		DeleteParent(a);
+		DeleteParent(b);
+		CHECK(s_endpoints.size() == 1 && s_endpoints[0] == fresh);
+		DeleteParent(c);
+		DeleteParent(d);
+		CHECK(s_endpoints.empty());
+	}
+
+	// threaded capture: the capture thread releases the invalidated device on the next buffer event
+	{
+		Parent* a = NewParent(&dev, 0);
+		Endpoint* ep = Endpoint::Acquire(a);
+		CHECK(ep != NULL && !ep->m_polled && ep->m_captureThread != NULL);
+
+		CaptureOf(ep)->m_hr = AUDCLNT_E_SERVICE_NOT_RUNNING;
+		SetEvent(ep->m_hReadyEvent);
+
+		bool released = false;
+		for (int i = 0; i < 1000 && !released; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			std::lock_guard<std::mutex> lock(ep->m_lock);
+			released = ep->m_clCapture == NULL;
+		}
+		CHECK(released);
+
+		Parent* b = NewParent(&dev, 0);
+		Endpoint* fresh = Endpoint::Acquire(b);
+		CHECK(fresh != NULL && fresh != ep && fresh->m_captureThread != NULL);
+		{
+			std::lock_guard<std::mutex> lock(fresh->m_lock);
+			CHECK(fresh->m_clCapture != NULL);
+		}
+
+		DeleteParent(a);
+		DeleteParent(b);
+		CHECK(s_endpoints.empty());
+
+		// let the capture threads release the clients and exit
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	return g_nFailed ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// RMS and peak envelopes: the vectorized EnvelopeSample and EnvelopeBlock are
+// compared with a scalar reference for 1 to 10 channels and chunk sizes that
+// leave partial blocks, then the throughput of both kernels is measured.
+
+#include "harness.h"
+
+/**
+* Scalar reference of the envelopes, the per-sample and per-block attack/decay filters.
+*/
+struct Reference
+{
+	float					rms[Measure::CHANNEL_SUM];
+	float					peak[Measure::CHANNEL_SUM];
+
+	Reference()
+	{
+		memset(rms, 0, sizeof(rms));
+		memset(peak, 0, sizeof(peak));
+	}
+
+	void Sample(const Parent* b, const float* chunk, UINT32 nFrames, int nChannels)
+	{
+		const int nLanes = min(nChannels, (int)Measure::CHANNEL_SUM);
+		for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame, chunk += nChannels)
+		{
+			for (int iChan = 0; iChan < nLanes; ++iChan)
+			{
+				const float sqrX = chunk[iChan] * chunk[iChan];
+				const float absX = fabsf(chunk[iChan]);
+				rms[iChan] = sqrX + b->m_kRMS[sqrX < rms[iChan]] * (rms[iChan] - sqrX);
+				peak[iChan] = absX + b->m_kPeak[absX < peak[iChan]] * (peak[iChan] - absX);
+			}
+		}
+	}
+
+	void Block(const Parent* b, const float* chunk, UINT32 nFrames, int nChannels)
+	{
+		const int nLanes = min(nChannels, (int)Measure::CHANNEL_SUM);
+		for (UINT32 iBlock = 0; iBlock < nFrames; iBlock += ENVELOPE_BLOCK)
+		{
+			const UINT32 n = min(nFrames - iBlock, (UINT32)ENVELOPE_BLOCK);
+			for (int iChan = 0; iChan < nLanes; ++iChan)
+			{
+				float sum = 0.0f, max = 0.0f;
+				for (UINT32 iFrame = 0; iFrame < n; ++iFrame)
+				{
+					const float x = chunk[iFrame * nChannels + iChan];
+					sum += x * x;
+					max = fmaxf(max, fabsf(x));
+				}
+
+				const float sqrX = sum / n;
+				const float kRMS = powf(b->m_kRMS[sqrX < rms[iChan]], (float)n);
+				const float kPeak = powf(b->m_kPeak[max < peak[iChan]], (float)n);
+				rms[iChan] = sqrX + kRMS * (rms[iChan] - sqrX);
+				peak[iChan] = max + kPeak * (peak[iChan] - max);
+			}
+			chunk += n * nChannels;
+		}
+	}
+};
+
+/**
+* Noise with bursts, so the envelopes alternate between attack and decay.
+*/
+std::vector<float> Signal(int nChannels, UINT32 nFrames, int sampleRate)
+{
+	std::vector<float> signal(nFrames * nChannels);
+	UINT32 seed = 12345;
+	for (UINT32 iFrame = 0; iFrame < nFrames; ++iFrame)
+	{
+		const float gain = (iFrame / (sampleRate / 20)) % 3 == 0 ? 0.9f : 0.05f;
+		for (int iChan = 0; iChan < nChannels; ++iChan)
+		{
+			seed = seed * 1664525 + 1013904223;
+			signal[iFrame * nChannels + iChan] = gain * ((float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f) / (1 + iChan);
+		}
+	}
+	return signal;
+}
+
+int main()
+{
+	static const int s_sampleRate = 48000;
+	static const UINT32 s_nFrames = s_sampleRate;
+	static const UINT32 s_chunks[] = { 480, 1, 37, 64, 1000 };
+	static const double s_tolerance = 1e-5;					// relative to the signal level
+
+	WAVEFORMATEX wfx = MakeFormat(WAVE_FORMAT_IEEE_FLOAT, 2, s_sampleRate);
+	Parent* b = new Parent;
+	b->m_wfx = &wfx;
+	b->m_envRMS[0] = 10;
+	b->m_envRMS[1] = 300;
+	b->m_envPeak[0] = 1;
+	b->m_envPeak[1] = 500;
+	b->FiltersInit();
+
+	// the kernels follow the reference through every chunk, and leave the lanes without a channel alone
+	for (int nChannels = 1; nChannels <= 10; ++nChannels)
+	{
+		const std::vector<float> signal = Signal(nChannels, s_nFrames, s_sampleRate);
+		const int nLanes = min(nChannels, (int)Measure::CHANNEL_SUM);
+
+		for (int mode = 0; mode < 2; ++mode)
+		{
+			memset(b->m_rms, 0, sizeof(b->m_rms));
+			memset(b->m_peak, 0, sizeof(b->m_peak));
+			Reference ref;
+
+			double maxError = 0.0;
+			UINT32 iFrame = 0;
+			for (int iChunk = 0; iFrame < s_nFrames; ++iChunk)
+			{
+				const UINT32 n = min(s_chunks[iChunk % _countof(s_chunks)], s_nFrames - iFrame);
+				const float* chunk = &signal[iFrame * nChannels];
+				if (mode == 1)
+				{
+					b->EnvelopeBlock(chunk, n, nChannels);
+					ref.Block(b, chunk, n, nChannels);
+				}
+				else
+				{
+					b->EnvelopeSample(chunk, n, nChannels);
+					ref.Sample(b, chunk, n, nChannels);
+				}
+				iFrame += n;
+
+				for (int iChan = 0; iChan < nLanes; ++iChan)
+				{
+					maxError = max(maxError, fabs(b->m_rms[iChan] - ref.rms[iChan]) / max(ref.rms[iChan], 1e-3f));
+					maxError = max(maxError, fabs(b->m_peak[iChan] - ref.peak[iChan]) / max(ref.peak[iChan], 1e-3f));
+				}
+			}
+
+			printf("EnvelopeMode=%d, %2d channels: largest relative error %.2g\n", mode, nChannels, maxError);
+			CHECK(maxError <= s_tolerance);
+			for (int iChan = nLanes; iChan < Measure::MAX_CHANNELS; ++iChan)
+			{
+				CHECK(b->m_rms[iChan] == 0.0f && b->m_peak[iChan] == 0.0f);
+			}
+		}
+	}
+
+	// throughput of the kernels and the scalar reference, in device frames per second on one core
+	printf("\n%8s %14s %14s %14s %14s\n", "channels", "Sample", "Sample (ref)", "Block", "Block (ref)");
+	static const int s_benchChannels[] = { 1, 2, 6, 8 };
+	for (int i = 0; i < (int)_countof(s_benchChannels); ++i)
+	{
+		const int nChannels = s_benchChannels[i];
+		const std::vector<float> signal = Signal(nChannels, s_nFrames, s_sampleRate);
+		static const int s_nRepeats = 20;
+		static const UINT32 s_nChunk = 480;
+
+		double rate[4];
+		for (int kernel = 0; kernel < 4; ++kernel)
+		{
+			Reference ref;
+			memset(b->m_rms, 0, sizeof(b->m_rms));
+			memset(b->m_peak, 0, sizeof(b->m_peak));
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int iRepeat = 0; iRepeat < s_nRepeats; ++iRepeat)
+			{
+				for (UINT32 iFrame = 0; iFrame + s_nChunk <= s_nFrames; iFrame += s_nChunk)
+				{
+					const float* chunk = &signal[iFrame * nChannels];
+					switch (kernel)
+					{
+					case 0:		b->EnvelopeSample(chunk, s_nChunk, nChannels); break;
+					case 1:		ref.Sample(b, chunk, s_nChunk, nChannels); break;
+					case 2:		b->EnvelopeBlock(chunk, s_nChunk, nChannels); break;
+					default:	ref.Block(b, chunk, s_nChunk, nChannels); break;
+					}
+				}
+			}
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			rate[kernel] = (double)s_nRepeats * s_nFrames / seconds;
+
+			// keep the reference from being optimized away
+			if (ref.rms[0] < 0.0f) printf("%g\n", ref.rms[0]);
+		}
+		printf("%8d %12.1fM/s %12.1fM/s %12.1fM/s %12.1fM/s\n", nChannels, rate[0] * 1e-6, rate[1] * 1e-6, rate[2] * 1e-6, rate[3] * 1e-6);
+	}
+
+	b->m_wfx = NULL;
+	delete b;
+
+	return g_nFailed ? 1 : 0;
+}
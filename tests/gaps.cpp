@@ -0,0 +1,202 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Gaps in the capture stream: packets with holes in the device position and
+// with the discontinuity and timestamp error flags are drained by Capture from
+// a fake capture client, into three parents with GapMode Ignore, Zeros and Reset.
+
+#include <deque>
+#include "harness.h"
+
+/**
+* Capture client returning a queue of packets of a constant signal, in F32.
+*/
+struct FakeCapture : IAudioCaptureClient
+{
+	struct Packet
+	{
+		UINT64				devPosition;
+		UINT32				nFrames;
+		DWORD				flags;
+	};
+
+	std::deque<Packet>		m_packets;					// packets not captured yet
+	std::vector<float>		m_data;						// samples of the largest packet
+	UINT32					m_nReleased;				// number of released frames
+
+	FakeCapture(int nChannels, float value) :
+		m_data(4096 * nChannels, value),
+		m_nReleased(0)
+	{
+	}
+
+	void Queue(UINT64 devPosition, UINT32 nFrames, DWORD flags)
+	{
+		const Packet packet = { devPosition, nFrames, flags };
+		m_packets.push_back(packet);
+	}
+
+	HRESULT GetBuffer(BYTE** data, UINT32* nFrames, DWORD* flags, UINT64* devPosition, UINT64* qpcPosition)
+	{
+		if (m_packets.empty()) return AUDCLNT_S_BUFFER_EMPTY;
+
+		const Packet& p = m_packets.front();
+		*data = (BYTE*)&m_data[0];
+		*nFrames = p.nFrames;
+		*flags = p.flags;
+		*devPosition = p.devPosition;
+		*qpcPosition = 0;
+		return S_OK;
+	}
+
+	HRESULT ReleaseBuffer(UINT32 nFrames)
+	{
+		m_nReleased += nFrames;
+		m_packets.pop_front();
+		return S_OK;
+	}
+
+	HRESULT GetNextPacketSize(UINT32* nFrames)
+	{
+		*nFrames = m_packets.empty() ? 0 : m_packets.front().nFrames;
+		return S_OK;
+	}
+
+	HRESULT QueryInterface(const IID& riid, void** object) { return E_NOINTERFACE; }
+	ULONG AddRef() { return 1; }
+	ULONG Release() { return 1; }
+};
+
+/**
+* True if the ring buffer of the first analysis channel holds the value in [begin, end).
+*/
+bool RingEquals(const Parent* b, UINT32 begin, UINT32 end, float value)
+{
+	for (UINT32 i = begin; i < end; ++i)
+	{
+		if (b->m_ringBuffer[i] != value) return false;
+	}
+	return true;
+}
+
+int main()
+{
+	static const UINT32 s_nPacket = 480;
+
+	WAVEFORMATEX wfx = MakeFormat(WAVE_FORMAT_IEEE_FLOAT, 2, 48000);
+	FakeCapture capture(2, 0.5f);
+	std::vector<float> chunk(4096 * 2);
+
+	Endpoint ep;
+	ep.m_wfx = &wfx;
+	ep.m_format = Measure::FMT_PCM_F32;
+	ep.m_bufChunk = &chunk[0];
+	ep.m_bufFrames = 4096;
+	ep.m_clCapture = &capture;
+
+	// one parent per gap mode, with a ring buffer long enough to keep the whole test
+	static const Measure::GapMode s_modes[] = { Measure::GAP_IGNORE, Measure::GAP_ZEROS, Measure::GAP_RESET };
+	const PrivateConfig config = { 4096, 4096, 16, 0, 0, 0, 0, 1, 0 };
+	Parent* parents[3];
+#if (PROFILE_STAGES)
+	Profile profiles[3];
+#endif
+	for (int i = 0; i < 3; ++i)
+	{
+		parents[i] = new Parent;
+		PrivateInit(parents[i], &wfx, config);
+		parents[i]->m_gapMode = s_modes[i];
+#if (PROFILE_STAGES)
+		parents[i]->m_profile = &profiles[i];
+#endif
+		ep.m_parents.push_back(parents[i]);
+	}
+	Parent* ignore = parents[0];
+	Parent* zeros = parents[1];
+	Parent* reset = parents[2];
+
+	// the discontinuity flag of the first packet of a stream is not a glitch
+	capture.Queue(0, s_nPacket, AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY);
+	capture.Queue(s_nPacket, s_nPacket, 0);
+	CHECK(ep.Capture() == S_OK);
+	CHECK(capture.m_nReleased == 2 * s_nPacket);
+	CHECK(ep.m_gaps.m_nGlitches == 0 && ep.m_gaps.m_nDropped == 0);
+
+	const float value = ignore->m_ringBuffer[0];
+	CHECK(value != 0.0f);
+	for (int i = 0; i < 3; ++i)
+	{
+		CHECK(parents[i]->m_ringBufW == 2 * s_nPacket);
+		CHECK(RingEquals(parents[i], 0, 2 * s_nPacket, value));
+	}
+	const float rms = ignore->m_rms[Measure::CHANNEL_FL];
+
+	// a packet starting one packet late: 480 frames dropped
+	capture.Queue(3 * s_nPacket, s_nPacket, 0);
+	CHECK(ep.Capture() == S_OK);
+	CHECK(ep.m_gaps.m_nGlitches == 1);
+	CHECK(ep.m_gaps.m_nDropped == s_nPacket);
+
+	// Ignore: the packet follows the previous one
+	CHECK(ignore->m_ringBufW == 3 * s_nPacket);
+	CHECK(RingEquals(ignore, 0, 3 * s_nPacket, value));
+	CHECK(ignore->m_rms[Measure::CHANNEL_FL] >= rms);
+
+	// Zeros: the missing frames are silence, the packet follows in time
+	CHECK(zeros->m_ringBufW == 4 * s_nPacket);
+	CHECK(RingEquals(zeros, 0, 2 * s_nPacket, value));
+	CHECK(RingEquals(zeros, 2 * s_nPacket, 3 * s_nPacket, 0.0f));
+	CHECK(RingEquals(zeros, 3 * s_nPacket, 4 * s_nPacket, value));
+	CHECK(zeros->m_rms[Measure::CHANNEL_FL] < ignore->m_rms[Measure::CHANNEL_FL]);
+
+	// Reset: the audio before the gap is cleared, the envelopes start over
+	CHECK(reset->m_ringBufW == 3 * s_nPacket);
+	CHECK(RingEquals(reset, 0, 2 * s_nPacket, 0.0f));
+	CHECK(RingEquals(reset, 2 * s_nPacket, 3 * s_nPacket, value));
+	CHECK(reset->m_rms[Measure::CHANNEL_FL] < rms);
+
+	// a discontinuity without a hole in the position is a glitch without dropped frames
+	capture.Queue(4 * s_nPacket, s_nPacket, AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY);
+	CHECK(ep.Capture() == S_OK);
+	CHECK(ep.m_gaps.m_nGlitches == 2);
+	CHECK(ep.m_gaps.m_nDropped == s_nPacket);
+	CHECK(ignore->m_ringBufW == 4 * s_nPacket);
+	CHECK(zeros->m_ringBufW == 5 * s_nPacket);
+	CHECK(RingEquals(reset, 0, 3 * s_nPacket, 0.0f));
+
+	// after a timestamp error the position resynchronizes on the next packet without a glitch
+	capture.Queue(123456789, s_nPacket, AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR);
+	capture.Queue(100 * s_nPacket, s_nPacket, 0);
+	capture.Queue(101 * s_nPacket, s_nPacket, 0);
+	CHECK(ep.Capture() == S_OK);
+	CHECK(ep.m_gaps.m_nGlitches == 2);
+	CHECK(ep.m_gaps.m_nDropped == s_nPacket);
+	CHECK(ep.m_gaps.m_nPackets == 7);
+	CHECK(zeros->m_ringBufW == 8 * s_nPacket);
+
+	// a hole longer than the ring buffer is filled with at most one second of silence
+	capture.Queue(101 * s_nPacket + 48000 * 3, s_nPacket, 0);
+	CHECK(ep.Capture() == S_OK);
+	CHECK(ep.m_gaps.m_nGlitches == 3);
+	CHECK(ep.m_gaps.m_nDropped == 48000 * 3);
+	CHECK(zeros->m_ringBufW == (int)((8 * s_nPacket + 48000 + s_nPacket) % zeros->m_ringBufferSize));
+	CHECK(ignore->m_ringBufW == 8 * s_nPacket);
+
+	// nothing left to capture
+	CHECK(ep.Capture() == S_FALSE);
+
+	ep.m_clCapture = NULL;
+	ep.m_bufChunk = NULL;
+	ep.m_wfx = NULL;
+	for (int i = 0; i < 3; ++i)
+	{
+		parents[i]->m_profile = NULL;
+		delete parents[i];
+	}
+
+	return g_nFailed ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Golden outputs of the DSP kernels: four test signals through four parent
+// configurations, compared with the outputs of the scalar build recorded in
+// data/golden_scalar.txt.  Exits with 1 if a value is out of tolerance, or if
+// an update allocates on the heap after warm-up.
+//
+//   golden [file]            verify against the file (default: data/golden_scalar.txt)
+//   golden --record file     record the outputs of this build
+
+#include "harness.h"
+
+/**
+* Outputs of the golden corpus, with their tolerance budgets: a value passes if it
+* differs from the reference by at most rel * max(|reference|, floor * largest
+* |reference| of the block).
+*/
+enum GoldenOutput
+{
+	GOLDEN_RMS,
+	GOLDEN_PEAK,
+	GOLDEN_FFT,
+	GOLDEN_BAND,
+	GOLDEN_WAVEBAND,
+	// ... //
+	NUM_GOLDEN_OUTPUTS
+};
+
+static const struct
+{
+	const char*				name;
+	double					rel;						// relative tolerance
+	double					floor;						// fraction of the block maximum below which the tolerance is absolute
+} s_golden[NUM_GOLDEN_OUTPUTS] =
+{
+	{ "RMS",		1e-4,	1e-3 },
+	{ "Peak",		1e-4,	1e-3 },
+	{ "FFT",		1e-3,	1e-4 },
+	{ "Band",		1e-3,	1e-2 },
+	{ "WaveBand",	1e-4,	1e-2 },
+};
+
+/**
+* Run the golden corpus: every input signal through every configuration of a
+* private parent, and pass the outputs at each checkpoint to a callback.
+*
+* @param[in]	output			Called with the configuration, signal, update, output and values.
+* @param[in]	data			Passed to the callback.
+* @return		False if the callback stopped the run.
+*/
+bool GoldenRun(bool (*output)(void* data, int iConfig, int iSignal, int iUpdate, GoldenOutput out, const float* values, int n), void* data)
+{
+	static const PrivateConfig s_config[] =
+	{
+		// FFTSize, FFTBufferSize, Bands, Smoothing, SmoothingMode, WAVESize, DynamicVolume, analysis channels, EnvelopeMode
+		{ 1024,	1024,	32,		0,	0,	0,		0,	1,	0 },
+		{ 2048,	4096,	64,		2,	1,	1024,	1,	2,	1 },
+		{ 4096,	4096,	128,	3,	2,	4096,	0,	1,	0 },
+		{ 1024,	2048,	48,		1,	0,	512,	0,	2,	1 },
+	};
+	static const int s_nSignals = 4;
+	static const int s_sampleRate = 48000;
+	static const int s_nChannels = 2;
+	static const int s_nChunk = 800;							// frames per update, 60 updates per second
+	static const int s_nUpdates = 60;
+	static const int s_checkpoint[] = { 29, 59 };				// updates after which the outputs are compared
+
+	WAVEFORMATEX wfx = { 0 };
+	wfx.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+	wfx.nChannels = s_nChannels;
+	wfx.nSamplesPerSec = s_sampleRate;
+	wfx.wBitsPerSample = 32;
+	wfx.nBlockAlign = s_nChannels * sizeof(float);
+	wfx.nAvgBytesPerSec = s_sampleRate * wfx.nBlockAlign;
+
+	float* signal = (float*)malloc(s_nUpdates * s_nChunk * s_nChannels * sizeof(float));
+	bool ok = true;
+
+	for (int iSignal = 0; iSignal < s_nSignals && ok; ++iSignal)
+	{
+		// deterministic input signals: sweep, noise, impulses, and a tone that stops halfway
+		UINT32 noise = 1;
+		for (int iFrame = 0; iFrame < s_nUpdates * s_nChunk; ++iFrame)
+		{
+			const double t = (double)iFrame / s_sampleRate;
+			double x = 0.0;
+			switch (iSignal)
+			{
+			case 0: x = 0.5 * sin(TWOPI * 20.0 * (pow(1000.0, t) - 1.0) / log(1000.0)); break;
+			case 1: noise = noise * 1664525 + 1013904223; x = 0.25 * ((double)noise / 0xffffffff - 0.5); break;
+			case 2: x = iFrame % 480 == 0 ? 0.9 : 0.0; break;
+			case 3: x = t < 0.5 ? 0.3 * sin(TWOPI * 1000.0 * t) + 0.2 * sin(TWOPI * 60.0 * t) : 0.0; break;
+			}
+			signal[iFrame * s_nChannels] = (float)x;
+			signal[iFrame * s_nChannels + 1] = (float)(0.5 * x);
+		}
+
+		for (int iConfig = 0; iConfig < (int)_countof(s_config) && ok; ++iConfig)
+		{
+			Parent b;
+			PrivateInit(&b, &wfx, s_config[iConfig]);
+#if (PROFILE_STAGES)
+			Profile profile;
+			b.m_profile = &profile;
+#endif
+
+			for (int iUpdate = 0, iCheck = 0; iUpdate < s_nUpdates && ok; ++iUpdate)
+			{
+				b.ProcessChunk(&signal[iUpdate * s_nChunk * s_nChannels], s_nChunk, 0);
+				b.UpdateParent();
+
+				if (iCheck < (int)_countof(s_checkpoint) && iUpdate == s_checkpoint[iCheck])
+				{
+					++iCheck;
+					ok = output(data, iConfig, iSignal, iUpdate, GOLDEN_RMS, b.m_rms, Measure::MAX_CHANNELS) &&
+						output(data, iConfig, iSignal, iUpdate, GOLDEN_PEAK, b.m_peak, Measure::MAX_CHANNELS) &&
+						output(data, iConfig, iSignal, iUpdate, GOLDEN_FFT, b.m_fftOut, b.m_fftBufferSize * b.m_nAnalysis) &&
+						output(data, iConfig, iSignal, iUpdate, GOLDEN_BAND, b.m_bandOut, b.m_nBands * b.m_nAnalysis) &&
+						(!b.m_waveSize || output(data, iConfig, iSignal, iUpdate, GOLDEN_WAVEBAND, b.m_waveBandOut, b.m_nBands * b.m_nAnalysis));
+				}
+			}
+
+			b.m_profile = NULL;
+			b.BuffersRelease();
+			b.m_wfx = NULL;
+		}
+	}
+
+	free(signal);
+	return ok;
+}
+
+/**
+* Write the golden outputs of the current build, as blocks of a header line
+* (configuration, signal, update, output, number of values, output name) and one
+* value per line.
+*
+* @param[in]	path			Output file.
+* @return		False if the file could not be written.
+*/
+bool GoldenRecord(const char* path)
+{
+	struct Writer
+	{
+		static bool Output(void* data, int iConfig, int iSignal, int iUpdate, GoldenOutput out, const float* values, int n)
+		{
+			FILE* file = (FILE*)data;
+			fprintf(file, "# %d %d %d %d %d %s\n", iConfig, iSignal, iUpdate, out, n, s_golden[out].name);
+			for (int i = 0; i < n; ++i)
+			{
+				fprintf(file, "%.9g\n", values[i]);
+			}
+			return true;
+		}
+	};
+
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		fprintf(stderr, "golden: couldn't write '%s'.\n", path);
+		return false;
+	}
+
+	fprintf(file, "AudioLevel golden outputs, %s\n", SIMD_SSE ? "sse" : "scalar");
+	GoldenRun(Writer::Output, file);
+	fclose(file);
+
+	printf("golden outputs written to '%s'.\n", path);
+	return true;
+}
+
+/**
+* Compare the outputs of the current build with recorded golden outputs, and
+* print the largest error of each output relative to its tolerance budget.
+*
+* @param[in]	path			Golden outputs written by GoldenRecord.
+* @return		False if the file does not match the configurations or a value is out of tolerance.
+*/
+bool GoldenVerify(const char* path)
+{
+	struct Verifier
+	{
+		FILE*				file;
+		std::vector<float>	ref;
+		double				worst[NUM_GOLDEN_OUTPUTS];		// largest error in units of the tolerance
+		UINT64				nFailed[NUM_GOLDEN_OUTPUTS];
+		UINT64				nValues[NUM_GOLDEN_OUTPUTS];
+		bool				mismatch;						// the corpus does not match the current configurations
+
+		static bool Output(void* data, int iConfig, int iSignal, int iUpdate, GoldenOutput out, const float* values, int n)
+		{
+			Verifier* v = (Verifier*)data;
+
+			int config, signal, update, output, count;
+			if (fscanf(v->file, " # %d %d %d %d %d %*[^\n]", &config, &signal, &update, &output, &count) != 5 ||
+				config != iConfig || signal != iSignal || update != iUpdate || output != out || count != n)
+			{
+				v->mismatch = true;
+				return false;
+			}
+
+			v->ref.resize(n);
+			double refMax = 0.0;
+			for (int i = 0; i < n; ++i)
+			{
+				if (fscanf(v->file, "%f", &v->ref[i]) != 1)
+				{
+					v->mismatch = true;
+					return false;
+				}
+				refMax = max(refMax, fabs(v->ref[i]));
+			}
+
+			for (int i = 0; i < n; ++i)
+			{
+				const double tolerance = s_golden[out].rel * max(fabs(v->ref[i]), s_golden[out].floor * refMax);
+				const double error = fabs(values[i] - v->ref[i]);
+				const double units = tolerance > 0.0 ? error / tolerance : (error > 0.0 ? 1e30 : 0.0);
+				v->worst[out] = max(v->worst[out], units);
+				if (units > 1.0) ++v->nFailed[out];
+			}
+			v->nValues[out] += n;
+			return true;
+		}
+	};
+
+	Verifier v = { NULL };
+	char header[128];
+	v.file = fopen(path, "r");
+	if (!v.file || !fgets(header, sizeof(header), v.file))
+	{
+		fprintf(stderr, "golden: couldn't read '%s'.\n", path);
+		if (v.file) fclose(v.file);
+		return false;
+	}
+
+	const UINT32 nViolations = AllocGuard::s_nViolations;
+	GoldenRun(Verifier::Output, &v);
+	fclose(v.file);
+
+	if (v.mismatch)
+	{
+		fprintf(stderr, "golden: the outputs in '%s' do not match the current configurations, record them again.\n", path);
+		return false;
+	}
+
+	bool passed = true;
+	for (int out = 0; out < NUM_GOLDEN_OUTPUTS; ++out)
+	{
+		printf("%-8s %llu of %llu values out of tolerance, largest error %.3g of the budget.\n",
+			s_golden[out].name, (unsigned long long)v.nFailed[out], (unsigned long long)v.nValues[out], v.worst[out]);
+		passed = passed && !v.nFailed[out];
+	}
+
+	// the processing path must not allocate once the warm-up updates after a (re)initialization are done
+	if (AllocGuard::s_nViolations != nViolations)
+	{
+		printf("%u updates allocated on the heap after warm-up.\n", AllocGuard::s_nViolations - nViolations);
+		passed = false;
+	}
+
+	printf("golden outputs %s.\n", passed ? "passed" : "failed");
+	return passed;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 3 && strcmp(argv[1], "--record") == 0)
+	{
+		return GoldenRecord(argv[2]) ? 0 : 2;
+	}
+
+	return GoldenVerify(argc > 1 ? argv[1] : "data/golden_scalar.txt") ? 0 : 1;
+}
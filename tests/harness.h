@@ -0,0 +1,123 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Test harness: builds the plugin into the test program, counts the heap
+// allocations and collects the failed checks.  Include it from exactly one
+// translation unit of each test program.
+
+#pragma once
+
+// the allocator below drives the allocation guards of the processing path
+#define TRACK_ALLOCATIONS		1
+
+#include "../PluginAudioLevelBeta.cpp"
+#include "stub/mock.h"
+
+extern "C"
+{
+	void* __libc_malloc(size_t size);
+	void* __libc_calloc(size_t n, size_t size);
+	void* __libc_realloc(void* p, size_t size);
+	void* __libc_memalign(size_t alignment, size_t size);
+	void __libc_free(void* p);
+}
+
+// heap allocations of all threads since the start of the program
+std::atomic<UINT64> g_nAllocs(0);
+
+extern "C"
+{
+	void* malloc(size_t size) { ++g_nAllocs; AllocGuard::Count(); return __libc_malloc(size); }
+	void* calloc(size_t n, size_t size) { ++g_nAllocs; AllocGuard::Count(); return __libc_calloc(n, size); }
+	void* realloc(void* p, size_t size) { ++g_nAllocs; AllocGuard::Count(); return __libc_realloc(p, size); }
+	void* memalign(size_t alignment, size_t size) { ++g_nAllocs; AllocGuard::Count(); return __libc_memalign(alignment, size); }
+	void* aligned_alloc(size_t alignment, size_t size) { ++g_nAllocs; AllocGuard::Count(); return __libc_memalign(alignment, size); }
+	int posix_memalign(void** p, size_t alignment, size_t size) { ++g_nAllocs; AllocGuard::Count(); *p = __libc_memalign(alignment, size); return *p ? 0 : ENOMEM; }
+	void free(void* p) { __libc_free(p); }
+}
+
+// number of failed checks, the exit code of the test program
+int g_nFailed = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { ++g_nFailed; fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+	do { const double v_ = (value), e_ = (expected); if (!(fabs(v_ - e_) <= (tolerance))) { ++g_nFailed; \
+		fprintf(stderr, "%s:%d: check failed: %s = %.6g, expected %.6g +- %.3g\n", __FILE__, __LINE__, #value, v_, e_, (double)(tolerance)); } } while (0)
+
+/**
+* Audio format of the test signals.
+*
+* @param[in]	tag				WAVE_FORMAT_PCM (16 bits) or WAVE_FORMAT_IEEE_FLOAT (32 bits).
+* @param[in]	nChannels		Number of channels.
+* @param[in]	sampleRate		Frames per second.
+* @return		Format.
+*/
+inline WAVEFORMATEX MakeFormat(WORD tag, int nChannels, int sampleRate)
+{
+	WAVEFORMATEX wfx = { 0 };
+	wfx.wFormatTag = tag;
+	wfx.nChannels = (WORD)nChannels;
+	wfx.nSamplesPerSec = sampleRate;
+	wfx.wBitsPerSample = tag == WAVE_FORMAT_PCM ? 16 : 32;
+	wfx.nBlockAlign = (WORD)(nChannels * wfx.wBitsPerSample / 8);
+	wfx.nAvgBytesPerSec = sampleRate * wfx.nBlockAlign;
+	return wfx;
+}
+
+/**
+* Settings of a private parent, which runs the pipeline outside of the skins.
+*/
+struct PrivateConfig
+{
+	int						fftSize;
+	int						fftBufferSize;
+	int						nBands;
+	int						smoothing;
+	int						smoothingMode;
+	int						waveSize;
+	int						dynamicVolume;
+	int						nAnalysis;					// 1: Sum, 2: L and R
+	int						envelopeMode;
+};
+
+/**
+* Set up a private parent measure, which runs the pipeline without a capture stream.
+*
+* @param[out]	b				Default constructed measure.
+* @param[in]	wfx				Audio format, must outlive the measure.
+* @param[in]	config			Settings.
+*/
+void PrivateInit(Parent* b, WAVEFORMATEX* wfx, const PrivateConfig& config)
+{
+	b->m_wfx = wfx;
+	b->m_fftSize = config.fftSize;
+	b->m_fftBufferSize = config.fftBufferSize;
+	b->m_nBands = config.nBands;
+	b->m_smoothing = config.smoothing;
+	b->m_smoothingMode = config.smoothingMode;
+	b->m_smoothingScalar = 1.0f / ((float)b->m_smoothing * 2.0f + 1.0f);
+	b->m_waveSize = config.waveSize;
+	b->m_dynamicVolume = config.dynamicVolume;
+	b->m_envelopeMode = config.envelopeMode;
+	b->m_sensitivity = 10 / (10 * log10(b->m_fftSize));
+
+	if (config.nAnalysis == 2)
+	{
+		b->m_nAnalysis = 2;
+		b->m_analysis[0] = Measure::CHANNEL_FL;
+		b->m_analysis[1] = Measure::CHANNEL_FR;
+		memset(b->m_downmix, 0, sizeof(b->m_downmix));
+		b->m_downmix[Measure::CHANNEL_FL][0] = 1.0f;
+		b->m_downmix[Measure::CHANNEL_FR][1] = 1.0f;
+	}
+
+	b->BuffersInit(0, Parent::REBUILD_ALL);
+	b->FiltersInit();
+	b->SelectUpdate();
+}
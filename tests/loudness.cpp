@@ -0,0 +1,184 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Loudness meter: the synthetic test cases of EBU Tech 3341 (1 kHz sines at 48
+// kHz, +-0.1 LU), and the relative gate of the histograms at a bin boundary.
+
+#include "harness.h"
+
+/**
+* A segment of a test case: a 1 kHz sine with a level per channel.
+*/
+struct Segment
+{
+	double					seconds;
+	double					dBFS[6];					// peak level per channel, below -200 for silence
+};
+
+/**
+* Feed a sequence of segments to a loudness meter, in chunks of 10ms.
+*
+* @param[in]	meter			Loudness meter, initialized for 48 kHz.
+* @param[in]	segments		Segments to feed.
+* @param[in]	nSegments		Number of segments.
+* @param[in]	repeat			Number of times the sequence is fed.
+* @param[in]	nChannels		Number of channels.
+* @param[in]	check			Called after each chunk from the given time on, with the meter.
+* @param[in]	checkFrom		Time in seconds from which the check is called.
+*/
+template<typename Check>
+void Feed(Loudness* meter, const Segment* segments, int nSegments, int repeat, int nChannels, Check check, double checkFrom)
+{
+	static const int s_sampleRate = 48000;
+	static const UINT32 s_nChunk = 480;
+
+	std::vector<float> chunk(s_nChunk * nChannels);
+	UINT64 iFrame = 0;
+	for (int iRepeat = 0; iRepeat < repeat; ++iRepeat)
+	{
+		for (int iSegment = 0; iSegment < nSegments; ++iSegment)
+		{
+			const Segment& seg = segments[iSegment];
+			const UINT64 nFrames = (UINT64)(seg.seconds * s_sampleRate + 0.5);
+			for (UINT64 iSeg = 0; iSeg < nFrames; iSeg += s_nChunk)
+			{
+				const UINT32 n = (UINT32)min((UINT64)s_nChunk, nFrames - iSeg);
+				for (UINT32 i = 0; i < n; ++i)
+				{
+					const double phase = sin(TWOPI * 1000.0 * (iFrame + i) / s_sampleRate);
+					for (int iChan = 0; iChan < nChannels; ++iChan)
+					{
+						chunk[i * nChannels + iChan] = seg.dBFS[iChan] < -200.0 ? 0.0f : (float)(pow(10.0, seg.dBFS[iChan] / 20.0) * phase);
+					}
+				}
+				meter->Process(&chunk[0], n, nChannels);
+				iFrame += n;
+
+				if ((double)iFrame / s_sampleRate >= checkFrom) check(meter);
+			}
+		}
+	}
+}
+
+void NoCheck(Loudness*) {}
+
+int main()
+{
+	static const double s_tolerance = 0.1;
+
+	WAVEFORMATEX stereo = MakeFormat(WAVE_FORMAT_IEEE_FLOAT, 2, 48000);
+	WAVEFORMATEX surround = MakeFormat(WAVE_FORMAT_IEEE_FLOAT, 6, 48000);
+	Loudness* meter = new Loudness;
+
+	// cases 1 and 2: stereo sines at -23 and -33 dBFS read the same in all three values
+	static const double s_levels[] = { -23.0, -33.0 };
+	for (int i = 0; i < (int)_countof(s_levels); ++i)
+	{
+		const Segment tone = { 20.0, { s_levels[i], s_levels[i] } };
+		meter->Init(&stereo);
+		Feed(meter, &tone, 1, 1, 2, NoCheck, 0.0);
+		CHECK_NEAR(meter->Value(Measure::LOUDNESS_MOMENTARY), s_levels[i], s_tolerance);
+		CHECK_NEAR(meter->Value(Measure::LOUDNESS_SHORTTERM), s_levels[i], s_tolerance);
+		CHECK_NEAR(meter->Value(Measure::LOUDNESS_INTEGRATED), s_levels[i], s_tolerance);
+	}
+
+	// cases 3 to 5: the relative gate removes the quiet segments, the absolute gate the silent ones
+	{
+		const Segment case3[] = { { 10.0, { -36.0, -36.0 } }, { 60.0, { -23.0, -23.0 } }, { 10.0, { -36.0, -36.0 } } };
+		meter->Init(&stereo);
+		Feed(meter, case3, _countof(case3), 1, 2, NoCheck, 0.0);
+		CHECK_NEAR(meter->Value(Measure::LOUDNESS_INTEGRATED), -23.0, s_tolerance);
+	}
+	{
+		const Segment case4[] =
+		{
+			{ 10.0, { -72.0, -72.0 } }, { 10.0, { -36.0, -36.0 } }, { 60.0, { -23.0, -23.0 } }, { 10.0, { -36.0, -36.0 } }, { 10.0, { -72.0, -72.0 } }
+		};
+		meter->Init(&stereo);
+		Feed(meter, case4, _countof(case4), 1, 2, NoCheck, 0.0);
+		CHECK_NEAR(meter->Value(Measure::LOUDNESS_INTEGRATED), -23.0, s_tolerance);
+	}
+	{
+		const Segment case5[] = { { 20.0, { -26.0, -26.0 } }, { 20.1, { -20.0, -20.0 } }, { 20.0, { -26.0, -26.0 } } };
+		meter->Init(&stereo);
+		Feed(meter, case5, _countof(case5), 1, 2, NoCheck, 0.0);
+		CHECK_NEAR(meter->Value(Measure::LOUDNESS_INTEGRATED), -23.0, s_tolerance);
+	}
+
+	// case 6: 5.0 channels, the surround channels are weighted +1.5 dB (the LFE channel is silent)
+	{
+		const Segment case6 = { 20.0, { -28.0, -28.0, -24.0, -999.0, -30.0, -30.0 } };
+		meter->Init(&surround);
+		Feed(meter, &case6, 1, 1, 6, NoCheck, 0.0);
+		CHECK_NEAR(meter->Value(Measure::LOUDNESS_INTEGRATED), -23.0, s_tolerance);
+	}
+
+	// case 9: the short-term loudness of a tone switching between -20 and -30 dBFS every 1.34 and 1.66s is constant
+	{
+		const Segment case9[] = { { 1.34, { -20.0, -20.0 } }, { 1.66, { -30.0, -30.0 } } };
+		double lowest = 0.0, highest = -100.0;
+		meter->Init(&stereo);
+		Feed(meter, case9, _countof(case9), 20, 2, [&](Loudness* l)
+		{
+			lowest = min(lowest, l->Value(Measure::LOUDNESS_SHORTTERM));
+			highest = max(highest, l->Value(Measure::LOUDNESS_SHORTTERM));
+		}, 3.0);
+		CHECK_NEAR(lowest, -23.0, s_tolerance);
+		CHECK_NEAR(highest, -23.0, s_tolerance);
+	}
+
+	// case 12: the momentary loudness of a tone switching between -20 and -30 dBFS every 0.18 and 0.22s is constant
+	{
+		const Segment case12[] = { { 0.18, { -20.0, -20.0 } }, { 0.22, { -30.0, -30.0 } } };
+		double lowest = 0.0, highest = -100.0;
+		meter->Init(&stereo);
+		Feed(meter, case12, _countof(case12), 25, 2, [&](Loudness* l)
+		{
+			lowest = min(lowest, l->Value(Measure::LOUDNESS_MOMENTARY));
+			highest = max(highest, l->Value(Measure::LOUDNESS_MOMENTARY));
+		}, 0.4);
+		CHECK_NEAR(lowest, -23.0, s_tolerance);
+		CHECK_NEAR(highest, -23.0, s_tolerance);
+	}
+
+	delete meter;
+
+	// a bin containing the gate counts with its part above the gate: 10 blocks at -20 LUFS,
+	// and 10 blocks in the middle of the bin that contains the gate
+	{
+		UINT32 count[Loudness::s_nBins] = { 0 };
+		double power[Loudness::s_nBins] = { 0.0 };
+		const double loud = pow(10.0, (-20.0 + 0.691) / 10.0);
+		const int iLoud = (int)((-20.0 - Loudness::s_floor) * 10.0 + 0.5);
+		count[iLoud] = 10;
+		power[iLoud] = 10 * loud;
+
+		// the gate is at the mean minus 10 LU, find the quiet bin that contains it
+		double quiet = loud * 0.1;
+		int iQuiet = 0;
+		for (int i = 0; i < 50; ++i)
+		{
+			const double gate = Loudness::ToLUFS((10 * loud + 10 * quiet) / 20) - 10.0;
+			iQuiet = (int)((gate - Loudness::s_floor) * 10.0);
+			const double level = Loudness::s_floor + (iQuiet + 0.5) * 0.1;
+			quiet = pow(10.0, (level + 0.691) / 10.0);
+		}
+		count[iQuiet] = 10;
+		power[iQuiet] = 10 * quiet;
+
+		int first;
+		double weight, n, sum;
+		Loudness::Gate(count, power, -10.0, &first, &weight, &n, &sum);
+		const double gate = (Loudness::ToLUFS((10 * loud + 10 * quiet) / 20) - 10.0 - Loudness::s_floor) * 10.0;
+		CHECK(first == iQuiet);
+		CHECK_NEAR(weight, 1.0 - (gate - iQuiet), 1e-9);
+		CHECK_NEAR(n, 10.0 + 10.0 * weight, 1e-9);
+		CHECK(n > 10.0 && n < 20.0);
+	}
+
+	return g_nFailed ? 1 : 0;
+}
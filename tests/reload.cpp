@@ -0,0 +1,185 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Reload of a parent measure: only the stages whose settings changed start over.
+// A Smoothing change keeps the arena and every buffer, the pffft setup follows
+// FFTBufferSize only, and other analysis channels clear the ring buffers even
+// when their number stays the same.  An invalid Downmix keeps the channels, and
+// the meters are released with the last child measure using them.
+
+#include "harness.h"
+
+static const int s_sampleRate = 48000;
+static const UINT32 s_nChunk = 480;
+
+/**
+* Feed a stereo chunk with different tones left and right, and update the spectra.
+*/
+void Feed(Parent* b, int nChunks)
+{
+	std::vector<float> chunk(s_nChunk * 2);
+	for (int iChunk = 0; iChunk < nChunks; ++iChunk)
+	{
+		for (UINT32 i = 0; i < s_nChunk; ++i)
+		{
+			chunk[i * 2] = (float)(0.5 * sin(TWOPI * 1000.0 * i / s_sampleRate));
+			chunk[i * 2 + 1] = (float)(0.25 * sin(TWOPI * 3000.0 * i / s_sampleRate));
+		}
+		b->ProcessChunk(&chunk[0], s_nChunk, 0);
+		b->UpdateParent();
+	}
+}
+
+/**
+* True if the buffer only holds zeros.
+*/
+bool IsZero(const float* p, int n)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		if (p[i] != 0.0f) return false;
+	}
+	return true;
+}
+
+int main()
+{
+	WAVEFORMATEX wfx = MakeFormat(WAVE_FORMAT_IEEE_FLOAT, 2, s_sampleRate);
+
+	// a parent without a capture stream, the format is set as if the device had one
+	MockSkin skin;
+	MockMeasure rm(&skin, L"Audio");
+	rm.Set(L"UpdatesPerSecond", L"0").Set(L"FFTSize", L"2048").Set(L"FFTBufferSize", L"4096").Set(L"Bands", L"32").Set(L"Channels", L"L");
+
+	void* data = NULL;
+	double maxValue = 1.0;
+	Initialize(&data, &rm);
+	Parent* b = static_cast<Parent*>((Measure*)data);
+	b->m_wfx = &wfx;
+	Reload(data, &rm, &maxValue);
+	CHECK(b->m_fftCfg != NULL && b->m_fftCfgSize == 4096);
+
+	// the reload of unchanged settings allocates (the mock API), a Smoothing change allocates no more than that
+	UINT64 nAllocs = g_nAllocs;
+	Reload(data, &rm, &maxValue);
+	const UINT64 nReloadAllocs = g_nAllocs - nAllocs;
+
+	Feed(b, 20);
+
+	std::vector<float> ring(b->m_ringBuffer, b->m_ringBuffer + b->m_ringBufferSize);
+	std::vector<float> spectrum(b->m_fftOut, b->m_fftOut + b->m_fftBufferSize);
+	CHECK(!IsZero(&ring[0], (int)ring.size()) && !IsZero(&spectrum[0], (int)spectrum.size()));
+
+	// Smoothing: the arena, the pffft setup and all contents stay, down to the bands
+	{
+		const BYTE* arena = b->m_arena;
+		const PFFFT_Setup* setup = b->m_fftCfg;
+		const int ringBufW = b->m_ringBufW;
+		const std::vector<float> bands(b->m_bandOut, b->m_bandOut + b->m_nBands);
+		rm.Set(L"Smoothing", L"2");
+		nAllocs = g_nAllocs;
+		Reload(data, &rm, &maxValue);
+		CHECK(g_nAllocs - nAllocs == nReloadAllocs);
+		CHECK(b->m_arena == arena && b->m_fftCfg == setup);
+		CHECK(b->m_smoothing == 2 && b->m_smoothingScalar == 1.0f / 5.0f);
+		CHECK(b->m_bandTmpOut != NULL && b->m_waveBandTmpOut == NULL);
+		CHECK(b->m_ringBufW == ringBufW);
+		CHECK(memcmp(b->m_ringBuffer, &ring[0], ring.size() * sizeof(float)) == 0);
+		CHECK(memcmp(b->m_fftOut, &spectrum[0], spectrum.size() * sizeof(float)) == 0);
+		CHECK(memcmp(b->m_bandOut, &bands[0], bands.size() * sizeof(float)) == 0);
+		Feed(b, 2);
+	}
+
+	// FFTSize with the same FFTBufferSize: the window starts over, the pffft setup stays
+	{
+		const PFFFT_Setup* setup = b->m_fftCfg;
+		rm.Set(L"FFTSize", L"1024");
+		Reload(data, &rm, &maxValue);
+		CHECK(b->m_fftCfg == setup && b->m_fftCfgSize == 4096);
+		CHECK(b->m_ringBufferSize == 1024);
+		Feed(b, 20);
+	}
+
+	// FFTBufferSize: a new pffft setup
+	{
+		rm.Set(L"FFTBufferSize", L"2048");
+		Reload(data, &rm, &maxValue);
+		CHECK(b->m_fftCfg != NULL && b->m_fftCfgSize == 2048);
+		Feed(b, 20);
+		CHECK(!IsZero(b->m_ringBuffer, b->m_ringBufferSize));
+	}
+
+	// Channels with the same number of analysis channels: the ring buffer and spectrum of L are not kept for R
+	{
+		rm.Set(L"Channels", L"R");
+		Reload(data, &rm, &maxValue);
+		CHECK(b->m_nAnalysis == 1 && b->m_analysis[0] == Measure::CHANNEL_FR);
+		CHECK(b->m_ringBufW == 0);
+		CHECK(IsZero(b->m_ringBuffer, b->m_ringBufferSize));
+		CHECK(IsZero(b->m_fftOut, b->m_fftBufferSize));
+		Feed(b, 20);
+	}
+
+	// the same channels again: nothing starts over
+	{
+		const int ringBufW = b->m_ringBufW;
+		ring.assign(b->m_ringBuffer, b->m_ringBuffer + b->m_ringBufferSize);
+		Reload(data, &rm, &maxValue);
+		CHECK(b->m_ringBufW == ringBufW);
+		CHECK(memcmp(b->m_ringBuffer, &ring[0], ring.size() * sizeof(float)) == 0);
+	}
+
+	// Downmix: a matrix replaces the analysis channels, an invalid matrix is logged and keeps them
+	{
+		rm.Set(L"Downmix", L"0.5 0.5; 0.5 -0.5");
+		Reload(data, &rm, &maxValue);
+		CHECK(b->m_nAnalysis == 2 && b->m_downmix[Measure::CHANNEL_FR][1] == -0.5f);
+
+		static const LPCWSTR s_invalid[] = { L"0.5 0.5; x", L"0.5 0.5;  ", L"1 1 1 1 1 1 1 1 1", L"Stereo" };
+		for (int i = 0; i < (int)_countof(s_invalid); ++i)
+		{
+			const UINT64 nErrors = g_nLogErrors;
+			rm.Set(L"Downmix", s_invalid[i]);
+			Reload(data, &rm, &maxValue);
+			CHECK(g_nLogErrors == nErrors + 1);
+			CHECK(b->m_nAnalysis == 1 && b->m_analysis[0] == Measure::CHANNEL_FR);
+			CHECK(b->m_downmix[Measure::CHANNEL_FR][0] == 1.0f && b->m_downmixMask == 1u << Measure::CHANNEL_FR);
+		}
+		rm.Set(L"Downmix", L"");
+	}
+
+	// meters follow the types of the children, a meter goes with the last child using it
+	{
+		MockMeasure rmLoudness(&skin, L"Loudness");
+		MockMeasure rmVU(&skin, L"VU");
+		rmLoudness.Set(L"Parent", L"Audio").Set(L"Type", L"Loudness");
+		rmVU.Set(L"Parent", L"Audio").Set(L"Type", L"VU");
+		void* loudness = NULL;
+		void* vu = NULL;
+		Initialize(&loudness, &rmLoudness);
+		Reload(loudness, &rmLoudness, &maxValue);
+		Initialize(&vu, &rmVU);
+		Reload(vu, &rmVU, &maxValue);
+		CHECK(b->m_meters == (Parent::METER_LOUDNESS | Parent::METER_BALLISTICS));
+		CHECK(b->m_loudness != NULL && b->m_ballistics != NULL);
+
+		const size_t arenaSize = b->m_arenaSize;
+		rmLoudness.Set(L"Type", L"RMS");
+		Reload(loudness, &rmLoudness, &maxValue);
+		CHECK(b->m_meters == Parent::METER_BALLISTICS && b->m_loudness == NULL && b->m_ballistics != NULL);
+		CHECK(b->m_arenaSize < arenaSize);
+
+		Finalize(vu);
+		CHECK(b->m_meters == 0 && b->m_ballistics == NULL);
+		Finalize(loudness);
+	}
+
+	b->m_wfx = NULL;
+	Finalize(data);
+
+	return g_nFailed ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Rainmeter plugin API for the tests, implemented by the mock in rainmeter.cpp.
+
+#pragma once
+#include <Windows.h>
+
+#define PLUGIN_EXPORT extern "C"
+
+enum RmGetType
+{
+	RMG_MEASURENAME		= 0,
+	RMG_SKIN			= 1,
+	RMG_SETTINGSFILE	= 2,
+	RMG_SKINNAME		= 3,
+	RMG_SKINWINDOWHANDLE	= 4
+};
+
+enum LOGLEVEL
+{
+	LOG_ERROR			= 1,
+	LOG_WARNING			= 2,
+	LOG_NOTICE			= 3,
+	LOG_DEBUG			= 4
+};
+
+LPCWSTR RmReadString(void* rm, LPCWSTR option, LPCWSTR defValue, BOOL replaceMeasures = TRUE);
+double RmReadFormula(void* rm, LPCWSTR option, double defValue);
+LPCWSTR RmReplaceVariables(void* rm, LPCWSTR str);
+LPCWSTR RmPathToAbsolute(void* rm, LPCWSTR relativePath);
+void RmExecute(void* skin, LPCWSTR command);
+void* RmGet(void* rm, int type);
+void RmLog(void* rm, int level, LPCWSTR message);
+void RmLogF(void* rm, int level, LPCWSTR format, ...);
+
+inline int RmReadInt(void* rm, LPCWSTR option, int defValue)
+{
+	return (int)RmReadFormula(rm, option, defValue);
+}
+
+inline double RmReadDouble(void* rm, LPCWSTR option, double defValue)
+{
+	return RmReadFormula(rm, option, defValue);
+}
+
+inline LPCWSTR RmGetMeasureName(void* rm)
+{
+	return (LPCWSTR)RmGet(rm, RMG_MEASURENAME);
+}
+
+inline void* RmGetSkin(void* rm)
+{
+	return RmGet(rm, RMG_SKIN);
+}
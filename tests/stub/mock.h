@@ -0,0 +1,60 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Mock skins and measures behind the Rainmeter API of the tests.
+
+#pragma once
+#include <Windows.h>
+#include <map>
+
+/**
+* A skin receiving the commands of RmExecute.
+*/
+struct MockSkin
+{
+	std::wstring			m_name;
+	UINT64					m_nExecuted;				// number of executed commands
+	std::wstring			m_lastCommand;				// most recent command
+
+	MockSkin(LPCWSTR name = L"Skin") :
+		m_name(name),
+		m_nExecuted(0)
+	{
+	}
+};
+
+/**
+* The rm context of one measure: its name, skin and options, as read from the skin file.
+*/
+struct MockMeasure
+{
+	struct NoCase
+	{
+		bool operator()(const std::wstring& a, const std::wstring& b) const { return _wcsicmp(a.c_str(), b.c_str()) < 0; }
+	};
+
+	MockSkin*				m_skin;
+	std::wstring			m_name;
+	std::map<std::wstring, std::wstring, NoCase> m_options;
+
+	MockMeasure(MockSkin* skin, LPCWSTR name) :
+		m_skin(skin),
+		m_name(name)
+	{
+	}
+
+	MockMeasure& Set(LPCWSTR option, LPCWSTR value) { m_options[option] = value; return *this; }
+};
+
+// number of commands executed in all skins
+extern std::atomic<UINT64> g_nExecuted;
+
+// number of messages logged with LOG_ERROR
+extern std::atomic<UINT64> g_nLogErrors;
+
+// most verbose level printed to stderr, LOG_WARNING by default
+extern int g_logLevel;
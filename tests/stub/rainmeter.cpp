@@ -0,0 +1,90 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Mock of the Rainmeter plugin API: options are read from a MockMeasure, and
+// commands and log messages are counted.
+
+#include "API/RainmeterAPI.h"
+#include "mock.h"
+
+std::atomic<UINT64> g_nExecuted(0);
+std::atomic<UINT64> g_nLogErrors(0);
+int g_logLevel = LOG_WARNING;
+
+LPCWSTR RmReadString(void* rm, LPCWSTR option, LPCWSTR defValue, BOOL replaceMeasures)
+{
+	const MockMeasure* m = (const MockMeasure*)rm;
+	if (!m) return defValue;
+
+	std::map<std::wstring, std::wstring, MockMeasure::NoCase>::const_iterator iter = m->m_options.find(option);
+	return iter != m->m_options.end() ? iter->second.c_str() : defValue;
+}
+
+double RmReadFormula(void* rm, LPCWSTR option, double defValue)
+{
+	LPCWSTR value = RmReadString(rm, option, L"");
+	return *value ? wcstod(value, NULL) : defValue;
+}
+
+LPCWSTR RmReplaceVariables(void* rm, LPCWSTR str)
+{
+	return str;
+}
+
+LPCWSTR RmPathToAbsolute(void* rm, LPCWSTR relativePath)
+{
+	return relativePath;
+}
+
+void RmExecute(void* skin, LPCWSTR command)
+{
+	MockSkin* s = (MockSkin*)skin;
+	if (s)
+	{
+		++s->m_nExecuted;
+		s->m_lastCommand = command;
+	}
+	++g_nExecuted;
+}
+
+void* RmGet(void* rm, int type)
+{
+	MockMeasure* m = (MockMeasure*)rm;
+	if (!m) return NULL;
+
+	switch (type)
+	{
+	case RMG_MEASURENAME:	return (void*)m->m_name.c_str();
+	case RMG_SKIN:			return m->m_skin;
+	case RMG_SKINNAME:		return m->m_skin ? (void*)m->m_skin->m_name.c_str() : NULL;
+	}
+
+	return NULL;
+}
+
+void RmLog(void* rm, int level, LPCWSTR message)
+{
+	static const char* const s_level[] = { "", "ERROR", "WARNING", "NOTICE", "DEBUG" };
+
+	if (level == LOG_ERROR) ++g_nLogErrors;
+	if (level <= g_logLevel)
+	{
+		const MockMeasure* m = (const MockMeasure*)rm;
+		fprintf(stderr, "%s (%ls) %ls\n", s_level[level], m ? m->m_name.c_str() : L"", message);
+	}
+}
+
+void RmLogF(void* rm, int level, LPCWSTR format, ...)
+{
+	WCHAR message[1024];
+	va_list args;
+	va_start(args, format);
+	_vsnwprintf_s(message, _countof(message), _TRUNCATE, format, args);
+	va_end(args);
+
+	RmLog(rm, level, message);
+}
@@ -0,0 +1,302 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Win32 functions used by the plugin, implemented on the C++ standard library.
+// Events and waitable timers share one lock and condition variable, so a wait on
+// several objects wakes up for any of them.
+
+#include <Windows.h>
+#include <AudioClient.h>
+#include <MMDeviceApi.h>
+#include <FunctionDiscoveryKeys_devpkey.h>
+#include <avrt.h>
+#include <cwctype>
+
+typedef std::chrono::steady_clock Clock;
+
+const PROPERTYKEY PKEY_Device_FriendlyName = { { 0xa45c254e }, 14 };
+
+/**
+* Event or waitable timer.  A timer is signaled from its due time on.
+*/
+struct KernelObject
+{
+	bool					m_manualReset;				// stays signaled after a wait
+	bool					m_signaled;					// event is set
+	bool					m_timer;					// object is a waitable timer
+	bool					m_armed;					// the timer has a due time
+	Clock::time_point		m_due;						// due time of the timer
+
+	bool IsSignaled(Clock::time_point now) const
+	{
+		return m_signaled || (m_timer && m_armed && now >= m_due);
+	}
+
+	void Consume()
+	{
+		if (m_manualReset) return;
+		m_signaled = false;
+		m_armed = false;
+	}
+};
+
+std::mutex s_kernelLock;
+std::condition_variable s_kernelSignal;
+
+static HANDLE CreateObject(bool manualReset, bool signaled, bool timer)
+{
+	KernelObject* o = new KernelObject;
+	o->m_manualReset = manualReset;
+	o->m_signaled = signaled;
+	o->m_timer = timer;
+	o->m_armed = false;
+	return o;
+}
+
+HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, LPCWSTR name)
+{
+	return CreateObject(manualReset != FALSE, initialState != FALSE, false);
+}
+
+BOOL SetEvent(HANDLE event)
+{
+	{
+		std::lock_guard<std::mutex> lock(s_kernelLock);
+		((KernelObject*)event)->m_signaled = true;
+	}
+	s_kernelSignal.notify_all();
+	return TRUE;
+}
+
+BOOL ResetEvent(HANDLE event)
+{
+	std::lock_guard<std::mutex> lock(s_kernelLock);
+	((KernelObject*)event)->m_signaled = false;
+	return TRUE;
+}
+
+HANDLE CreateWaitableTimer(void* attributes, BOOL manualReset, LPCWSTR name)
+{
+	return CreateObject(manualReset != FALSE, false, true);
+}
+
+HANDLE CreateWaitableTimerExW(void* attributes, LPCWSTR name, DWORD flags, DWORD access)
+{
+	return CreateObject(false, false, true);
+}
+
+BOOL SetWaitableTimer(HANDLE timer, const LARGE_INTEGER* dueTime, LONG period, void* completion, void* arg, BOOL resume)
+{
+	// only relative due times (negative, in 100ns units) are used by the plugin
+	const LONGLONG due = dueTime->QuadPart < 0 ? -dueTime->QuadPart : 0;
+	{
+		std::lock_guard<std::mutex> lock(s_kernelLock);
+		KernelObject* o = (KernelObject*)timer;
+		o->m_signaled = false;
+		o->m_armed = true;
+		o->m_due = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(due * 100));
+	}
+	s_kernelSignal.notify_all();
+	return TRUE;
+}
+
+BOOL CancelWaitableTimer(HANDLE timer)
+{
+	std::lock_guard<std::mutex> lock(s_kernelLock);
+	((KernelObject*)timer)->m_armed = false;
+	return TRUE;
+}
+
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds)
+{
+	const Clock::time_point deadline = milliseconds == INFINITE ? (Clock::time_point::max)() :
+		Clock::now() + std::chrono::milliseconds(milliseconds);
+
+	std::unique_lock<std::mutex> lock(s_kernelLock);
+	while (true)
+	{
+		const Clock::time_point now = Clock::now();
+		Clock::time_point wake = deadline;
+		for (DWORD i = 0; i < count; ++i)
+		{
+			KernelObject* o = (KernelObject*)handles[i];
+			if (o->IsSignaled(now))
+			{
+				o->Consume();
+				return WAIT_OBJECT_0 + i;
+			}
+			if (o->m_timer && o->m_armed) wake = min(wake, o->m_due);
+		}
+
+		if (now >= deadline) return WAIT_TIMEOUT;
+
+		if (wake == (Clock::time_point::max)())
+		{
+			s_kernelSignal.wait(lock);
+		}
+		else
+		{
+			s_kernelSignal.wait_until(lock, wake);
+		}
+	}
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds)
+{
+	return WaitForMultipleObjects(1, &handle, FALSE, milliseconds);
+}
+
+BOOL CloseHandle(HANDLE handle)
+{
+	std::lock_guard<std::mutex> lock(s_kernelLock);
+	delete (KernelObject*)handle;
+	return TRUE;
+}
+
+DWORD GetLastError()
+{
+	return 0;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+	count->QuadPart = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+	frequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+HRESULT CoCreateInstance(const CLSID& clsid, IUnknown* outer, DWORD context, const IID& iid, void** object)
+{
+	// there are no audio devices, the tests drive the capture clients themselves
+	*object = NULL;
+	return REGDB_E_CLASSNOTREG;
+}
+
+void CoTaskMemFree(void* p)
+{
+	free(p);
+}
+
+void PropVariantInit(PROPVARIANT* pv)
+{
+	memset(pv, 0, sizeof(*pv));
+}
+
+HRESULT PropVariantClear(PROPVARIANT* pv)
+{
+	CoTaskMemFree(pv->pwszVal);
+	PropVariantInit(pv);
+	return S_OK;
+}
+
+HANDLE AvSetMmThreadCharacteristics(LPCWSTR task, DWORD* taskIndex)
+{
+	static int s_task;
+	return &s_task;
+}
+
+BOOL AvSetMmThreadPriority(HANDLE task, AVRT_PRIORITY priority)
+{
+	return TRUE;
+}
+
+BOOL AvRevertMmThreadCharacteristics(HANDLE task)
+{
+	return TRUE;
+}
+
+/**
+* Format with the conventions of the Microsoft CRT: %s and %c take wide
+* arguments in the wide functions, %S and %C narrow ones.
+*/
+int _vsnwprintf_s(wchar_t* buffer, size_t size, size_t count, const wchar_t* format, va_list args)
+{
+	std::wstring fmt;
+	for (const wchar_t* f = format; *f; ++f)
+	{
+		fmt += *f;
+		if (*f != L'%') continue;
+
+		// copy the flags, width and precision, then translate the conversion
+		++f;
+		while (*f && wcschr(L"-+ #0123456789.*", *f)) fmt += *f++;
+		const bool sized = *f && wcschr(L"hlLzjt", *f);
+		while (*f && wcschr(L"hlLzjtI", *f)) fmt += *f++;
+		if (!*f) break;
+
+		if (!sized && (*f == L's' || *f == L'c')) fmt += L'l';
+		fmt += (*f == L'S' || *f == L'C') && !sized ? (wchar_t)towlower(*f) : *f;
+	}
+
+	const size_t n = count == _TRUNCATE ? size : min(size, count + 1);
+	int written = vswprintf(buffer, n, fmt.c_str(), args);
+	if (written < 0)
+	{
+		// truncated
+		buffer[n - 1] = L'\0';
+		written = count == _TRUNCATE ? -1 : (int)wcslen(buffer);
+	}
+	return written;
+}
+
+int _snwprintf_s(wchar_t* buffer, size_t size, size_t count, const wchar_t* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	const int n = _vsnwprintf_s(buffer, size, count, format, args);
+	va_end(args);
+	return n;
+}
+
+int wcsncat_s(wchar_t* dest, size_t size, const wchar_t* src, size_t count)
+{
+	const size_t len = wcslen(dest);
+	size_t n = wcslen(src);
+	if (count != _TRUNCATE) n = min(n, count);
+	n = min(n, size - len - 1);
+	wmemcpy(dest + len, src, n);
+	dest[len + n] = L'\0';
+	return 0;
+}
+
+wchar_t* wcstok_s(wchar_t* str, const wchar_t* delim, wchar_t** context)
+{
+	return wcstok(str, delim, context);
+}
+
+int _wcsicmp(const wchar_t* a, const wchar_t* b)
+{
+	return wcscasecmp(a, b);
+}
+
+int _wcsnicmp(const wchar_t* a, const wchar_t* b, size_t count)
+{
+	return wcsncasecmp(a, b, count);
+}
+
+wchar_t* _wcsdup(const wchar_t* str)
+{
+	return wcsdup(str);
+}
+
+int _wfopen_s(FILE** file, const wchar_t* path, const wchar_t* mode)
+{
+	char p[1024], m[16];
+	if (wcstombs(p, path, sizeof(p)) == (size_t)-1 || wcstombs(m, mode, sizeof(m)) == (size_t)-1)
+	{
+		*file = NULL;
+		return 1;
+	}
+
+	*file = fopen(p, m);
+	return *file ? 0 : 1;
+}
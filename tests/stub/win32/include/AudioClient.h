@@ -0,0 +1,55 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+#pragma once
+#include <Windows.h>
+
+enum AUDCLNT_SHAREMODE
+{
+	AUDCLNT_SHAREMODE_SHARED,
+	AUDCLNT_SHAREMODE_EXCLUSIVE
+};
+
+#define AUDCLNT_STREAMFLAGS_LOOPBACK			0x00020000
+#define AUDCLNT_STREAMFLAGS_EVENTCALLBACK		0x00040000
+#define AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY	0x1
+#define AUDCLNT_BUFFERFLAGS_SILENT				0x2
+#define AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR		0x4
+#define AUDCLNT_S_BUFFER_EMPTY					((HRESULT)0x08890001L)
+#define AUDCLNT_E_DEVICE_INVALIDATED			((HRESULT)0x88890004L)
+#define AUDCLNT_E_UNSUPPORTED_FORMAT			((HRESULT)0x88890008L)
+#define AUDCLNT_E_SERVICE_NOT_RUNNING			((HRESULT)0x88890010L)
+#define AUDCLNT_E_BUFFER_ERROR					((HRESULT)0x88890018L)
+
+struct IAudioClient : IUnknown
+{
+	virtual HRESULT Initialize(AUDCLNT_SHAREMODE mode, DWORD flags, REFERENCE_TIME duration, REFERENCE_TIME period, const WAVEFORMATEX* format, const GUID* session) = 0;
+	virtual HRESULT GetBufferSize(UINT32* nFrames) = 0;
+	virtual HRESULT GetStreamLatency(REFERENCE_TIME* latency) = 0;
+	virtual HRESULT GetCurrentPadding(UINT32* nFrames) = 0;
+	virtual HRESULT IsFormatSupported(AUDCLNT_SHAREMODE mode, const WAVEFORMATEX* format, WAVEFORMATEX** closest) = 0;
+	virtual HRESULT GetMixFormat(WAVEFORMATEX** format) = 0;
+	virtual HRESULT GetDevicePeriod(REFERENCE_TIME* defaultPeriod, REFERENCE_TIME* minPeriod) = 0;
+	virtual HRESULT Start() = 0;
+	virtual HRESULT Stop() = 0;
+	virtual HRESULT Reset() = 0;
+	virtual HRESULT SetEventHandle(HANDLE event) = 0;
+	virtual HRESULT GetService(const IID& iid, void** service) = 0;
+};
+
+struct IAudioCaptureClient : IUnknown
+{
+	virtual HRESULT GetBuffer(BYTE** data, UINT32* nFrames, DWORD* flags, UINT64* devPosition, UINT64* qpcPosition) = 0;
+	virtual HRESULT ReleaseBuffer(UINT32 nFrames) = 0;
+	virtual HRESULT GetNextPacketSize(UINT32* nFrames) = 0;
+};
+
+struct IAudioRenderClient : IUnknown
+{
+	virtual HRESULT GetBuffer(UINT32 nFrames, BYTE** data) = 0;
+	virtual HRESULT ReleaseBuffer(UINT32 nFrames, DWORD flags) = 0;
+};
@@ -0,0 +1,56 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+#pragma once
+#include <Windows.h>
+
+enum EDataFlow
+{
+	eRender,
+	eCapture,
+	eAll
+};
+
+enum ERole
+{
+	eConsole,
+	eMultimedia,
+	eCommunications
+};
+
+#define DEVICE_STATE_ACTIVE		0x00000001
+#define DEVICE_STATE_DISABLED	0x00000002
+#define DEVICE_STATE_NOTPRESENT	0x00000004
+#define DEVICE_STATE_UNPLUGGED	0x00000008
+
+struct IPropertyStore : IUnknown
+{
+	virtual HRESULT GetValue(const PROPERTYKEY& key, PROPVARIANT* value) = 0;
+};
+
+struct IMMDevice : IUnknown
+{
+	virtual HRESULT Activate(const IID& iid, DWORD context, PROPVARIANT* params, void** object) = 0;
+	virtual HRESULT OpenPropertyStore(DWORD access, IPropertyStore** store) = 0;
+	virtual HRESULT GetId(LPWSTR* id) = 0;
+	virtual HRESULT GetState(DWORD* state) = 0;
+};
+
+struct IMMDeviceCollection : IUnknown
+{
+	virtual HRESULT GetCount(UINT* count) = 0;
+	virtual HRESULT Item(UINT index, IMMDevice** device) = 0;
+};
+
+struct IMMDeviceEnumerator : IUnknown
+{
+	virtual HRESULT EnumAudioEndpoints(EDataFlow flow, DWORD stateMask, IMMDeviceCollection** devices) = 0;
+	virtual HRESULT GetDefaultAudioEndpoint(EDataFlow flow, ERole role, IMMDevice** device) = 0;
+	virtual HRESULT GetDevice(LPCWSTR id, IMMDevice** device) = 0;
+};
+
+struct MMDeviceEnumerator;
@@ -0,0 +1,185 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+// Minimal Win32 declarations to build the plugin for the tests on Linux.  Only the
+// types and functions used by the plugin are declared, the kernel objects are
+// implemented in win32.cpp.
+
+#pragma once
+
+// the C++ headers are included before the min/max macros, as with NOMINMAX unset on Windows
+#include <cstdint>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cmath>
+#include <new>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+typedef int					BOOL;
+typedef unsigned char		BYTE;
+typedef uint16_t			WORD;
+typedef uint32_t			DWORD;
+typedef int16_t				INT16;
+typedef int32_t				INT32;
+typedef int32_t				LONG;
+typedef uint32_t			ULONG;
+typedef unsigned int		UINT;
+typedef uint32_t			UINT32;
+typedef int64_t				INT64;
+typedef uint64_t			UINT64;
+typedef int64_t				LONGLONG;
+typedef int64_t				REFERENCE_TIME;
+typedef int32_t				HRESULT;
+typedef wchar_t				WCHAR;
+typedef wchar_t*			LPWSTR;
+typedef const wchar_t*		LPCWSTR;
+typedef void*				HANDLE;
+
+typedef union
+{
+	struct
+	{
+		DWORD				LowPart;
+		LONG				HighPart;
+	};
+	LONGLONG				QuadPart;
+} LARGE_INTEGER;
+
+struct GUID
+{
+	DWORD					Data1;
+};
+typedef GUID IID;
+typedef GUID CLSID;
+
+struct PROPERTYKEY
+{
+	GUID					fmtid;
+	DWORD					pid;
+};
+
+#define TRUE				1
+#define FALSE				0
+#define WINAPI
+#define CALLBACK
+#define __cdecl
+
+#define S_OK				((HRESULT)0)
+#define S_FALSE				((HRESULT)1)
+#define E_FAIL				((HRESULT)0x80004005L)
+#define E_OUTOFMEMORY		((HRESULT)0x8007000EL)
+#define E_NOTIMPL			((HRESULT)0x80004001L)
+#define E_NOINTERFACE		((HRESULT)0x80004002L)
+#define REGDB_E_CLASSNOTREG	((HRESULT)0x80040154L)
+#define FAILED(hr)			(((HRESULT)(hr)) < 0)
+#define SUCCEEDED(hr)		(((HRESULT)(hr)) >= 0)
+
+#define INFINITE			0xFFFFFFFF
+#define WAIT_OBJECT_0		0
+#define WAIT_TIMEOUT		258
+#define WAIT_FAILED			0xFFFFFFFF
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION	0x00000002
+#define TIMER_ALL_ACCESS	0x001F0003
+#define CLSCTX_ALL			23
+#define STGM_READ			0
+#define _TRUNCATE			((size_t)-1)
+
+#define ARRAYSIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define _countof(a)			(sizeof(a) / sizeof((a)[0]))
+#define __uuidof(x)			GUID()
+
+#ifndef max
+#define max(a, b)			(((a) > (b)) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a, b)			(((a) < (b)) ? (a) : (b))
+#endif
+
+#define WAVE_FORMAT_PCM			1
+#define WAVE_FORMAT_IEEE_FLOAT	3
+
+typedef struct
+{
+	WORD					wFormatTag;
+	WORD					nChannels;
+	DWORD					nSamplesPerSec;
+	DWORD					nAvgBytesPerSec;
+	WORD					nBlockAlign;
+	WORD					wBitsPerSample;
+	WORD					cbSize;
+} WAVEFORMATEX;
+
+typedef struct
+{
+	WORD					vt;
+	LPWSTR					pwszVal;
+} PROPVARIANT;
+
+struct IUnknown
+{
+	virtual HRESULT QueryInterface(const IID& riid, void** object) = 0;
+	virtual ULONG AddRef() = 0;
+	virtual ULONG Release() = 0;
+};
+
+// kernel objects: events and waitable timers
+HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, LPCWSTR name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+HANDLE CreateWaitableTimer(void* attributes, BOOL manualReset, LPCWSTR name);
+HANDLE CreateWaitableTimerExW(void* attributes, LPCWSTR name, DWORD flags, DWORD access);
+BOOL SetWaitableTimer(HANDLE timer, const LARGE_INTEGER* dueTime, LONG period, void* completion, void* arg, BOOL resume);
+BOOL CancelWaitableTimer(HANDLE timer);
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds);
+BOOL CloseHandle(HANDLE handle);
+DWORD GetLastError();
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+
+HRESULT CoCreateInstance(const CLSID& clsid, IUnknown* outer, DWORD context, const IID& iid, void** object);
+void CoTaskMemFree(void* p);
+void PropVariantInit(PROPVARIANT* pv);
+HRESULT PropVariantClear(PROPVARIANT* pv);
+
+// CRT extensions, with the format strings of the Microsoft CRT (%s is a wide string)
+int _vsnwprintf_s(wchar_t* buffer, size_t size, size_t count, const wchar_t* format, va_list args);
+int _snwprintf_s(wchar_t* buffer, size_t size, size_t count, const wchar_t* format, ...);
+int wcsncat_s(wchar_t* dest, size_t size, const wchar_t* src, size_t count);
+wchar_t* wcstok_s(wchar_t* str, const wchar_t* delim, wchar_t** context);
+int _wcsicmp(const wchar_t* a, const wchar_t* b);
+int _wcsnicmp(const wchar_t* a, const wchar_t* b, size_t count);
+wchar_t* _wcsdup(const wchar_t* str);
+int _wfopen_s(FILE** file, const wchar_t* path, const wchar_t* mode);
+#define fscanf_s			fscanf
+
+template <size_t N>
+inline int _snwprintf_s(wchar_t (&buffer)[N], size_t count, const wchar_t* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	const int n = _vsnwprintf_s(buffer, N, count, format, args);
+	va_end(args);
+	return n;
+}
+
+template <size_t N>
+inline int wcsncat_s(wchar_t (&dest)[N], const wchar_t* src, size_t count)
+{
+	return wcsncat_s(dest, N, src, count);
+}
@@ -0,0 +1,21 @@
+/* Copyright (C) 2014 Rainmeter Project Developers
+*
+* This Source Code Form is subject to the terms of the GNU General Public
+* License; either version 2 of the License, or (at your option) any later
+* version. If a copy of the GPL was not distributed with this file, You can
+* obtain one at <https://www.gnu.org/licenses/gpl-2.0.html>. */
+
+#pragma once
+#include <Windows.h>
+
+enum AVRT_PRIORITY
+{
+	AVRT_PRIORITY_LOW = -1,
+	AVRT_PRIORITY_NORMAL,
+	AVRT_PRIORITY_HIGH,
+	AVRT_PRIORITY_CRITICAL
+};
+
+HANDLE AvSetMmThreadCharacteristics(LPCWSTR task, DWORD* taskIndex);
+BOOL AvSetMmThreadPriority(HANDLE task, AVRT_PRIORITY priority);
+BOOL AvRevertMmThreadCharacteristics(HANDLE task);